@@ -10,8 +10,15 @@
 #include <d3dcompiler.h>
 #include <Rig3D/Graphics/Camera.h>
 #include "Rig3D/Intersection.h"
+#include "Rig3D/RigidBodySystem.h"
+#include "Rig3D/ContactSolver.h"
 #include <vector>
+#include <algorithm>
+#include <functional>
 
+#define CONTACT_SOLVER_SIMULATION		1				// Takes precedence over EVENT_DRIVEN_SIMULATION
+#define EVENT_DRIVEN_SIMULATION			1
+#define MAX_EVENTS_PER_FRAME			1024
 #define DYNAMIC_COLLISION_TEST			0
 #define PI								3.1415926535f
 #define BALL_COUNT						16
@@ -40,6 +47,10 @@
 #define TABLE_DEPTH						2.15183771f
 #define TABLE_WIDTH						0.20663416f
 #define PHYSICS_TIME_STEP				0.1f			// ms
+#define SOLVER_TIME_STEP				2.0f			// ms
+#define SOLVER_ITERATIONS				4
+#define BALL_BALL_FRICTION				0.05f
+#define CUSHION_FRICTION				0.2f
 #define GRAVITY_CONSTANT				0.0000098196f	// m/ms^2
 #define LINEAR_VELOCITY_THRESHOLD		0.000995f
 #define ANGULAR_VELOCITY_THRESHOLD		0.001f
@@ -72,17 +83,6 @@ public:
 		vec2f UV;
 	};
 
-	struct RigidBody
-	{
-		vec3f	velocity;
-		vec3f	angularVelocity;
-		vec3f	forces;
-		vec3f	torques;
-		float	inverseMass;
-
-		RigidBody() : velocity(0.0f), angularVelocity(0.0f), forces(0.0f), torques(0.0f), inverseMass(INVERSE_BALL_MASS) {};
-	};
-
 	struct Collision
 	{
 		vec3f	poi;
@@ -93,6 +93,21 @@ public:
 		Collision(vec3f poi, float t, int s0, int s1) : poi(poi), t(t), s0(s0), s1(s1) {};
 	};
 
+	// Predicted time of impact. The event is stale once either ball has collided again since it was predicted.
+	struct ImpactEvent
+	{
+		float		t;			// ms from the start of the frame
+		int			s0;
+		int			s1;			// Ball index, or plane index when isPlane is set
+		uint32_t	c0;			// Event counts of the balls at prediction
+		uint32_t	c1;
+		bool		isPlane;
+
+		ImpactEvent(float t, int s0, int s1, uint32_t c0, uint32_t c1, bool isPlane) : t(t), s0(s0), s1(s1), c0(c0), c1(c1), isPlane(isPlane) {};
+
+		bool operator>(const ImpactEvent& other) const { return t > other.t; }
+	};
+
 	struct PoolTable
 	{
 		IMesh*	legs;
@@ -115,11 +130,14 @@ public:
 	mat4f							mBallWorldMatrices[BALL_COUNT];
 	mat4f							mTableWorldMatrix;
 
-	RigidBody						mRigidBodies[BALL_COUNT];
+	RigidBodySystem					mRigidBodies;
 	Sphere							mSpheres[BALL_COUNT];
 	Plane							mPlanes[PLANE_COUNT];
 	std::vector<Collision>			mSphereCollisions;
 	std::vector<Collision>			mPlaneCollisions;
+	std::vector<ImpactEvent>		mEvents;		// Min heap on t
+	uint32_t						mEventCounts[BALL_COUNT];
+	ContactSolver					mContactSolver;
 
 	Camera							mCamera;
 
@@ -177,7 +195,8 @@ public:
 		mSamplerState(nullptr),
 		mViewProjectionBuffer(nullptr),
 		mBallTransformBuffer(nullptr),
-		mTableTransformBuffer(nullptr)
+		mTableTransformBuffer(nullptr),
+		mContactSolver(SOLVER_ITERATIONS)
 	{
 		mOptions.mWindowCaption = "Billiards Sample";
 		mOptions.mWindowWidth = 1200;
@@ -187,6 +206,9 @@ public:
 		mMeshLibrary.SetAllocator(&mAllocator);
 		mSphereCollisions.reserve(BALL_COUNT);
 		mPlaneCollisions.reserve(BALL_COUNT);
+		mEvents.reserve(BALL_COUNT * (BALL_COUNT + PLANE_COUNT));
+		memset(mEventCounts, 0, sizeof(mEventCounts));
+		mContactSolver.SetRestitutionThreshold(LINEAR_VELOCITY_THRESHOLD);
 	}
 
 	~BilliardsSample()
@@ -259,6 +281,7 @@ public:
 		mBallTransforms[0].SetPosition(position);
 		mSpheres[0].origin = position;
 		mSpheres[0].radius = BALL_RADIUS;
+		mRigidBodies.AddBody(position, INVERSE_BALL_MASS, gSphereInverseTensorVector);
 
 		float diameter = BALL_RADIUS * 2.0f;
 		float xOffset = 0;
@@ -274,6 +297,7 @@ public:
 				mBallTransforms[i].SetPosition(position);
 				mSpheres[i].origin = position;
 				mSpheres[i].radius = BALL_RADIUS;
+				mRigidBodies.AddBody(position, INVERSE_BALL_MASS, gSphereInverseTensorVector);
 				xOffset += diameter + FLT_EPSILON;
 				i++;
 			}
@@ -532,7 +556,12 @@ public:
 		static int frame = 0;
 		HandleInput();
 
-		
+#if CONTACT_SOLVER_SIMULATION != 0
+		SimulateContacts(milliseconds);
+#elif EVENT_DRIVEN_SIMULATION != 0
+		ApplyFriction(mSpheres, mRigidBodies, BALL_COUNT);
+		SimulateEvents(milliseconds);
+#else
 		if (frame % 2 == 0)
 		{
 			// Physics
@@ -549,6 +578,7 @@ public:
 			ResolveSphereSphereCollisions(&mSphereCollisions, mSpheres, mBallTransforms, mRigidBodies);
 			ResolvePlaneSphereCollisions(&mPlaneCollisions, mPlanes, mSpheres, mRigidBodies);
 		}
+#endif
 		// TO DO: Interpolate State 
 		
 		// Update Renderable Structures
@@ -586,7 +616,7 @@ public:
 			mat3f rotMat = mCamera.mTransform.GetRotationMatrix();
 			vec3f f = vec3f(0.0f, 0.0f, 1.0f) * rotMat;
 			vec3f cameraForward = mCamera.mTransform.GetForward();
-			ApplyImpulse(mSpheres[0], mRigidBodies[0], vec3f(0.0f, 0.0f, 1.0f));
+			ApplyImpulse(mSpheres[0], mRigidBodies, 0, vec3f(0.0f, 0.0f, 1.0f));
 		}
 
 
@@ -621,25 +651,25 @@ public:
 		}
 
 		// CUE Ball
-		position = mBallTransforms[0].GetPosition();
+		position = mRigidBodies.GetPosition(0);
 		if (Input::SharedInstance().GetKey(KEYCODE_UP)) {
 			position += mBallTransforms[0].GetForward() * CAMERA_SPEED * 0.01f;
-			mBallTransforms[0].SetPosition(position);
+			SetBallPosition(0, position);
 		}
 
 		if (Input::SharedInstance().GetKey(KEYCODE_LEFT)) {
 			position += mBallTransforms[0].GetRight() * -CAMERA_SPEED * 0.01f;
-			mBallTransforms[0].SetPosition(position);
+			SetBallPosition(0, position);
 		}
 
 		if (Input::SharedInstance().GetKey(KEYCODE_RIGHT)) {
 			position += mBallTransforms[0].GetRight() * CAMERA_SPEED * 0.01f;
-			mBallTransforms[0].SetPosition(position);
+			SetBallPosition(0, position);
 		}
 
 		if (Input::SharedInstance().GetKey(KEYCODE_DOWN)) {
 			position += mBallTransforms[0].GetForward() * -CAMERA_SPEED * 0.01f;
-			mBallTransforms[0].SetPosition(position);
+			SetBallPosition(0, position);
 		}
 	}
 
@@ -763,106 +793,261 @@ public:
 		int i = 0;
 		while (accumulator >= PHYSICS_TIME_STEP)
 		{
-			//Euler(mBallTransforms, mSpheres, mRigidBodies, PHYSICS_TIME_STEP, BALL_COUNT);
-			RK4(mBallTransforms, mSpheres, mRigidBodies, PHYSICS_TIME_STEP, BALL_COUNT);
+			//mRigidBodies.IntegrateEuler(PHYSICS_TIME_STEP);
+			mRigidBodies.IntegrateRK4(PHYSICS_TIME_STEP);
+			mRigidBodies.ClearForces();
+
+			for (int b = 0; b < BALL_COUNT; b++)
+			{
+				mRigidBodies.SetAngularVelocity(b, mRigidBodies.GetAngularVelocity(b) * vec3f(1.0f, 0.02f, 1.0f));
+			}
+
 			accumulator -= PHYSICS_TIME_STEP;
 			i++;
 		}
 
-		quatf r = mBallTransforms[0].GetRotation();
-		vec3f v = mRigidBodies[0].velocity;
+		UpdateBallColliders();
+
+		vec3f v = mRigidBodies.GetVelocity(0);
+		vec3f w = mRigidBodies.GetAngularVelocity(0);
+		float FPS = 1.0f / (frameTime / 1000.0f);
+		char str[256];
+		sprintf_s(str, "Billiards FPS %f FT %f STEPS %d CUE Velocity %3f %3f %3f Angular Velocity %3f %3f %3f", FPS, frameTime, i, v.x, v.y, v.z, w.x, w.y, w.z);
+		mRenderer->SetWindowCaption(str);
+	}
+
+	// Every contact of a step is solved together over SOLVER_ITERATIONS passes, warm started from the last step's impulses, so the
+	// rack stays settled at a much longer step than resolving each contact once needs.
+	void SimulateContacts(double milliseconds)
+	{
+		float frameTime = static_cast<float>(milliseconds);
+		if (frameTime > 16.67f)
+		{
+			frameTime = 16.67f;
+		}
+
+		static float accumulator = 0.0f;
+		accumulator += frameTime;
+
+		int i = 0;
+		while (accumulator >= SOLVER_TIME_STEP)
+		{
+			ApplyFriction(mSpheres, mRigidBodies, BALL_COUNT);
+			mRigidBodies.IntegrateVelocities(SOLVER_TIME_STEP);
+			mRigidBodies.ClearForces();
+
+			AddBallContacts(SOLVER_TIME_STEP);
+			mContactSolver.Solve(mRigidBodies, SOLVER_TIME_STEP);
+
+			mRigidBodies.IntegratePositions(SOLVER_TIME_STEP);
+			for (int b = 0; b < BALL_COUNT; b++)
+			{
+				mRigidBodies.SetAngularVelocity(b, mRigidBodies.GetAngularVelocity(b) * vec3f(1.0f, 0.02f, 1.0f));
+			}
+
+			accumulator -= SOLVER_TIME_STEP;
+			i++;
+		}
+
+		UpdateBallColliders();
+
+		vec3f v = mRigidBodies.GetVelocity(0);
 		float FPS = 1.0f / (frameTime / 1000.0f);
 		char str[256];
-		sprintf_s(str, "Billiards FPS %f FT %f STEPS %d CUE Velocity %3f %3f %3f Angular Velocity %3f %3f %3f", FPS, frameTime, i, v.x, v.y, v.z, mRigidBodies[0].angularVelocity.x, mRigidBodies[0].angularVelocity.y, mRigidBodies[0].angularVelocity.z);
+		sprintf_s(str, "Billiards FPS %f FT %f STEPS %d CONTACTS %u WARM %u CUE Velocity %3f %3f %3f", FPS, frameTime, i, mContactSolver.GetContactCount(), mContactSolver.GetWarmStartedCount(), v.x, v.y, v.z);
 		mRenderer->SetWindowCaption(str);
 	}
 
-	void Euler(Transform* transforms, Sphere* spheres, RigidBody* rigidBodies, float dt, int count)
+	// Pairs closer than they can travel toward each other in dt become contacts, so fast balls are stopped at the surface instead of
+	// passing through it.
+	void AddBallContacts(float dt)
 	{
 		for (int i = 0; i < BALL_COUNT; i++)
 		{
-			// Initial State
-			vec3f acceleration			= rigidBodies[i].forces * rigidBodies[i].inverseMass;
-			vec3f angularAcceleration	= rigidBodies[i].torques * gSphereInverseTensorVector;
-			vec3f velocity				= rigidBodies[i].velocity;
-			vec3f angularVelocity		= rigidBodies[i].angularVelocity;
-			vec3f position				= transforms[i].GetPosition();
-			quatf rotation				= transforms[i].GetRotation();
-
-			// Integrate
-			angularVelocity	+= angularAcceleration * dt;
-			velocity		+= acceleration * dt;
-			position		+= velocity * dt;
-			rotation		+= (rotation * quatf(0.0f, angularVelocity)) * 0.5f * dt;
-
-			// Next State
-			rigidBodies[i].forces = rigidBodies[i].torques = vec3f(0.0f);
-			rigidBodies[i].angularVelocity	= angularVelocity;
-			rigidBodies[i].velocity			= velocity;
-			spheres[i].origin				= position;
-			transforms[i].SetPosition(position);
-			transforms[i].SetRotation(cliqCity::graphicsMath::normalize(rotation));
+			vec3f p0 = mRigidBodies.GetPosition(i);
+			vec3f v0 = mRigidBodies.GetVelocity(i);
+
+			for (int j = i + 1; j < BALL_COUNT; j++)
+			{
+				vec3f distance = mRigidBodies.GetPosition(j) - p0;
+				float distanceMagnitude = cliqCity::graphicsMath::magnitude(distance);
+				float separation = distanceMagnitude - (BALL_RADIUS + BALL_RADIUS);
+				float margin = cliqCity::graphicsMath::magnitude(mRigidBodies.GetVelocity(j) - v0) * dt;
+				if (separation < margin && distanceMagnitude > FLT_EPSILON)
+				{
+					vec3f normal = distance / distanceMagnitude;
+					mContactSolver.AddContact(i, j, p0 + normal * (BALL_RADIUS + separation * 0.5f), normal, separation, BALL_BALL_FRICTION, ELASTIC_CONSTANT);
+				}
+			}
+
+			for (int p = 0; p < PLANE_COUNT; p++)
+			{
+				float separation = cliqCity::graphicsMath::dot(mPlanes[p].normal, p0) - mPlanes[p].distance - BALL_RADIUS;
+				float margin = cliqCity::graphicsMath::magnitude(v0) * dt;
+				if (separation < margin)
+				{
+					mContactSolver.AddStaticContact(i, p, p0 - mPlanes[p].normal * (BALL_RADIUS + separation), mPlanes[p].normal, separation, CUSHION_FRICTION, PLANE_SPHERE_ELASTIC_CONSTANT);
+				}
+			}
+		}
+	}
+
+	// Velocities are held constant over the frame, so balls move in straight lines between impacts and each impact time is
+	// solved exactly. Only the pairs of the balls an impact changes are predicted again. Friction is applied at the end of the frame.
+	void SimulateEvents(double milliseconds)
+	{
+		float frameTime = static_cast<float>(milliseconds);
+		if (frameTime > 16.67f)
+		{
+			frameTime = 16.67f;
 		}
+
+		// Input and friction changed velocities since the last frame, so start from a fresh queue.
+		mEvents.clear();
+		for (int i = 0; i < BALL_COUNT; i++)
+		{
+			for (int j = i + 1; j < BALL_COUNT; j++)
+			{
+				PredictSphereSphereEvent(i, j, 0.0f);
+			}
+
+			for (int p = 0; p < PLANE_COUNT; p++)
+			{
+				PredictPlaneSphereEvent(p, i, 0.0f);
+			}
+		}
+
+		float time = 0.0f;
+		int eventCount = 0;
+		while (!mEvents.empty() && mEvents.front().t <= frameTime && eventCount < MAX_EVENTS_PER_FRAME)
+		{
+			ImpactEvent e = mEvents.front();
+			std::pop_heap(mEvents.begin(), mEvents.end(), std::greater<ImpactEvent>());
+			mEvents.pop_back();
+
+			if (e.c0 != mEventCounts[e.s0] || (!e.isPlane && e.c1 != mEventCounts[e.s1]))
+			{
+				continue;
+			}
+
+			AdvanceBalls(e.t - time);
+			time = e.t;
+
+			if (e.isPlane)
+			{
+				mPlaneCollisions.push_back(Collision(mSpheres[e.s0].origin, 0.0f, e.s1, e.s0));
+				ResolvePlaneSphereCollisions(&mPlaneCollisions, mPlanes, mSpheres, mRigidBodies);
+				mEventCounts[e.s0]++;
+				PredictBallEvents(e.s0, -1, time);
+			}
+			else
+			{
+				vec3f poi = (mSpheres[e.s0].origin + mSpheres[e.s1].origin) * 0.5f;
+				mSphereCollisions.push_back(Collision(poi, 0.0f, e.s0, e.s1));
+				ResolveSphereSphereCollisions(&mSphereCollisions, mSpheres, mBallTransforms, mRigidBodies);
+				mEventCounts[e.s0]++;
+				mEventCounts[e.s1]++;
+				PredictBallEvents(e.s0, e.s1, time);
+				PredictBallEvents(e.s1, -1, time);
+			}
+
+			eventCount++;
+		}
+
+		AdvanceBalls(frameTime - time);
+		mRigidBodies.IntegrateVelocities(frameTime);
+		mRigidBodies.ClearForces();
+
+		vec3f v = mRigidBodies.GetVelocity(0);
+		vec3f w = mRigidBodies.GetAngularVelocity(0);
+		float FPS = 1.0f / (frameTime / 1000.0f);
+		char str[256];
+		sprintf_s(str, "Billiards FPS %f FT %f EVENTS %d CUE Velocity %3f %3f %3f Angular Velocity %3f %3f %3f", FPS, frameTime, eventCount, v.x, v.y, v.z, w.x, w.y, w.z);
+		mRenderer->SetWindowCaption(str);
+	}
+
+	// Predicts ball i against every plane and every other ball except skip.
+	void PredictBallEvents(int i, int skip, float time)
+	{
+		for (int j = 0; j < BALL_COUNT; j++)
+		{
+			if (j != i && j != skip)
+			{
+				PredictSphereSphereEvent(i, j, time);
+			}
+		}
+
+		for (int p = 0; p < PLANE_COUNT; p++)
+		{
+			PredictPlaneSphereEvent(p, i, time);
+		}
+	}
+
+	void PredictSphereSphereEvent(int i, int j, float time)
+	{
+		// Touching balls that are already separating would report an impact at t = 0 again.
+		vec3f v0 = mRigidBodies.GetVelocity(i);
+		vec3f v1 = mRigidBodies.GetVelocity(j);
+		vec3f relativeVelocity = v1 - v0;
+		if (cliqCity::graphicsMath::dot(relativeVelocity, mSpheres[j].origin - mSpheres[i].origin) >= 0.0f)
+		{
+			return;
+		}
+
+		vec3f poi;
+		float t;
+		if (IntersectDynamicSphereSphere<vec3f>(mSpheres[i], v0, mSpheres[j], v1, poi, t))
+		{
+			mEvents.push_back(ImpactEvent(time + t, i, j, mEventCounts[i], mEventCounts[j], false));
+			std::push_heap(mEvents.begin(), mEvents.end(), std::greater<ImpactEvent>());
+		}
+	}
+
+	void PredictPlaneSphereEvent(int p, int i, float time)
+	{
+		// Same for a ball leaving a cushion it is touching.
+		float distance = cliqCity::graphicsMath::dot(mPlanes[p].normal, mSpheres[i].origin) - mPlanes[p].distance;
+		vec3f velocity = mRigidBodies.GetVelocity(i);
+		if (distance * cliqCity::graphicsMath::dot(mPlanes[p].normal, velocity) >= 0.0f)
+		{
+			return;
+		}
+
+		vec3f poi;
+		float t;
+		if (IntersectDynamicSpherePlane<vec3f>(mSpheres[i], velocity, mPlanes[p], poi, t))
+		{
+			mEvents.push_back(ImpactEvent(time + t, i, p, mEventCounts[i], 0, true));
+			std::push_heap(mEvents.begin(), mEvents.end(), std::greater<ImpactEvent>());
+		}
+	}
+
+	void AdvanceBalls(float dt)
+	{
+		mRigidBodies.IntegratePositions(dt);
+		UpdateBallColliders();
 	}
 
-	void RK4(Transform* transforms, Sphere* spheres, RigidBody* rigidBodies, float dt, int count)
+	// The rigid bodies own ball state. Spheres and transforms are copies for collision tests and rendering.
+	void UpdateBallColliders()
 	{
 		for (int i = 0; i < BALL_COUNT; i++)
 		{
-			// Initial State
-			quatf rotation				= transforms[i].GetRotation();
-			vec3f position				= transforms[i].GetPosition();
-			vec3f velocity				= rigidBodies[i].velocity;
-			vec3f angularVelocity		= rigidBodies[i].angularVelocity;
-			vec3f acceleration			= rigidBodies[i].forces * rigidBodies[i].inverseMass;
-			vec3f angularAcceleration	= rigidBodies[i].torques * gSphereInverseTensorVector;
-			quatf spin					= rotation * quatf(0.0f, angularVelocity) * 0.5f;
-
-			// Derivatives
-			vec3f v0, v1, v2, v3; // Velocity
-			vec3f w0, w1, w2, w3; // Angular Velocity
-			vec3f a0, a1, a2, a3; // Acceleration
-			vec3f l0, l1, l2, l3; // Angular Acceleration
-			quatf s0, s1, s2, s3; // Spin
-
-			RK4Evaluate(transforms[i], rigidBodies[i], 0.0f, acceleration, angularAcceleration, spin, v0, w0, a0, l0, s0);
-			RK4Evaluate(transforms[i], rigidBodies[i], dt * 0.5f, a0, l0, s0, v1, w1, a1, l1, s1);
-			RK4Evaluate(transforms[i], rigidBodies[i], dt * 0.5f, a1, l1, s1, v2, w2, a2, l2, s2);
-			RK4Evaluate(transforms[i], rigidBodies[i], dt, a2, l2, s2, v3, w3, a3, l3, s3);
-
-			vec3f vf = 1.0f / 6.0f * (v0 + 2.0f * (v1 + v2) + v3);		// Final Velocity
-			vec3f af = 1.0f / 6.0f * (a0 + 2.0f * (a1 + a2) + a3);		// Final Acceleration
-			vec3f wf = 1.0f / 6.0f * (w0 + 2.0f * (w1 + w2) + w3);		// Final Angular Velocity
-			vec3f lf = 1.0f / 6.0f * (l0 + 2.0f * (l1 + l2) + l3);		// Final Angular Acceleration
-			quatf sf = (s0 + ((s1 + s2) * 2.0f) + s3) * 1.0f / 6.0f;	
-
-			// Integration
-			position		+= vf * dt;
-			velocity		+= af * dt;
-			angularVelocity += lf * dt;
-			//rotation		+= sf * dt;
-			rotation		+= rotation * quatf(0.0f, wf) * 0.5f * dt;
-
-			// Set Dynamics State
-			rigidBodies[i].forces = rigidBodies[i].torques = vec3f(0.0f);
-			rigidBodies[i].angularVelocity	= angularVelocity * vec3f(1.0f, 0.02f, 1.0f);
-			rigidBodies[i].velocity			= velocity;
-			spheres[i].origin				= position;
-			transforms[i].SetPosition(position);
-			transforms[i].SetRotation(cliqCity::graphicsMath::normalize(rotation));
+			vec3f position = mRigidBodies.GetPosition(i);
+			mSpheres[i].origin = position;
+			mBallTransforms[i].SetPosition(position);
+			mBallTransforms[i].SetRotation(mRigidBodies.GetOrientation(i));
 		}
 	}
 
-	inline void RK4Evaluate(const Transform& transform, const RigidBody& rigidBody, float dt, vec3f aIn, vec3f lIn, quatf sIn, vec3f& vOut, vec3f& wOut, vec3f& aOut, vec3f& lOut, quatf& sOut)
+	void SetBallPosition(int i, const vec3f& position)
 	{
-		vOut = rigidBody.velocity + aIn * dt;
-		wOut = rigidBody.angularVelocity + lIn * dt;
-		sOut = transform.GetRotation() + sIn * dt;
-		aOut = aIn;
-		lOut = lIn;
+		mRigidBodies.SetPosition(i, position);
+		mSpheres[i].origin = position;
+		mBallTransforms[i].SetPosition(position);
 	}
 
-	void DetectPlaneSphereCollisions(std::vector<Collision>* collisions, Plane* planes, int planeCount, Sphere* spheres, RigidBody* rigidBodies, int sphereCount)
+	void DetectPlaneSphereCollisions(std::vector<Collision>* collisions, Plane* planes, int planeCount, Sphere* spheres, RigidBodySystem& rigidBodies, int sphereCount)
 	{
 		vec3f poi;
 		float t;
@@ -872,7 +1057,7 @@ public:
 			for (int j = 0; j < sphereCount; j++)
 			{
 #if DYNAMIC_COLLISION_TEST != 0
-				if (IntersectDynamicSpherePlane<vec3f>(spheres[j], rigidBodies[j].velocity, planes[i], poi, t))
+				if (IntersectDynamicSpherePlane<vec3f>(spheres[j], rigidBodies.GetVelocity(j), planes[i], poi, t))
 				{
 					collisions->push_back(Collision(poi, t, i, j));
 				}
@@ -888,7 +1073,7 @@ public:
 		}
 	}
 
-	void DetectSphereSphereCollisions(std::vector<Collision>* collisions, Sphere* spheres, RigidBody* rigidBodies, int count)
+	void DetectSphereSphereCollisions(std::vector<Collision>* collisions, Sphere* spheres, RigidBodySystem& rigidBodies, int count)
 	{
 		vec3f poi;
 		float t;
@@ -898,7 +1083,7 @@ public:
 			for (int j = i + 1; j < count; j++)
 			{
 #if DYNAMIC_COLLISION_TEST != 0
-				if (IntersectDynamicSphereSphere<vec3f>(spheres[i], rigidBodies[i].velocity, spheres[j], rigidBodies[j].velocity, poi, t))
+				if (IntersectDynamicSphereSphere<vec3f>(spheres[i], rigidBodies.GetVelocity(i), spheres[j], rigidBodies.GetVelocity(j), poi, t))
 				{
 					collisions->push_back(Collision(poi, t, i, j));
 				}
@@ -914,7 +1099,7 @@ public:
 		}
 	}
 
-	void ResolvePlaneSphereCollisions(std::vector<Collision>* collisions, Plane* planes, Sphere* spheres, Transform* transforms, RigidBody* rigidBodies)
+	void ResolvePlaneSphereCollisions(std::vector<Collision>* collisions, Plane* planes, Sphere* spheres, Transform* transforms, RigidBodySystem& rigidBodies)
 	{
 		for (auto i = 0; i < collisions->size(); i++)
 		{
@@ -929,17 +1114,16 @@ public:
 			vec3f p0 =  cliqCity::graphicsMath::cross(vec3f(0.0f, 1.0f, 0.0f), contactNormal) * s;
 			vec3f p1 = poi - spheres[i].origin;
 
-			float k = CalculatePlaneSphereImpulse(spheres[i1], J1, rigidBodies[i1], contactNormal, p0, p1);
-			vec3f g = k * contactNormal * rigidBodies[i1].inverseMass;
-			rigidBodies[i1].velocity += k * contactNormal * rigidBodies[i1].inverseMass;
-			rigidBodies[i1].angularVelocity += cliqCity::graphicsMath::cross(p1, k * contactNormal) * gSphereInverseTensor;
+			float k = CalculatePlaneSphereImpulse(spheres[i1], J1, rigidBodies, i1, contactNormal, p0, p1);
+			rigidBodies.SetVelocity(i1, rigidBodies.GetVelocity(i1) + k * contactNormal * rigidBodies.GetInverseMass(i1));
+			rigidBodies.SetAngularVelocity(i1, rigidBodies.GetAngularVelocity(i1) + cliqCity::graphicsMath::cross(p1, k * contactNormal) * gSphereInverseTensor);
 		}
 
 		collisions->clear();
 		collisions->reserve(BALL_COUNT);
 	}
 
-	void ResolvePlaneSphereCollisions(std::vector<Collision>* collisions, Plane* planes, Sphere* spheres, RigidBody* rigidBodies)
+	void ResolvePlaneSphereCollisions(std::vector<Collision>* collisions, Plane* planes, Sphere* spheres, RigidBodySystem& rigidBodies)
 	{
 		for (auto i = 0; i < collisions->size(); i++)
 		{
@@ -948,15 +1132,15 @@ public:
 			int i1 = collisions->at(i).s1;
 			vec3f contactNormal = planes[i0].normal;
 
-			float k = CalculatePlaneSphereImpulse(spheres[i1], rigidBodies[i1], contactNormal);
-			rigidBodies[i1].velocity += k * contactNormal * rigidBodies[i1].inverseMass;
+			float k = CalculatePlaneSphereImpulse(spheres[i1], rigidBodies, i1, contactNormal);
+			rigidBodies.SetVelocity(i1, rigidBodies.GetVelocity(i1) + k * contactNormal * rigidBodies.GetInverseMass(i1));
 		}
 
 		collisions->clear();
 		collisions->reserve(BALL_COUNT);
 	}
 
-	void ResolveSphereSphereCollisions(std::vector<Collision>* collisions, Sphere* spheres, Transform* transforms, RigidBody* rigidBodies)
+	void ResolveSphereSphereCollisions(std::vector<Collision>* collisions, Sphere* spheres, Transform* transforms, RigidBodySystem& rigidBodies)
 	{
 		for (auto i = 0; i < collisions->size(); i++)
 		{
@@ -974,15 +1158,15 @@ public:
 			vec3f p1 = poi - spheres[i1].origin;
 
 #if ROTATIONAL_DYNAMICS == 1
-			float k = CalculateSphereSphereImpulse(spheres[i0], spheres[i1], J0, J1, rigidBodies[i0], rigidBodies[i1], contactNormal, p0, p1);
-			rigidBodies[i0].velocity -= k * contactNormal * rigidBodies[i0].inverseMass;
-			rigidBodies[i1].velocity += k * contactNormal * rigidBodies[i1].inverseMass;
-			rigidBodies[i0].angularVelocity -= cliqCity::graphicsMath::cross(p0, k * contactNormal) * gSphereInverseTensor;
-			rigidBodies[i1].angularVelocity += cliqCity::graphicsMath::cross(p1, k * contactNormal) * gSphereInverseTensor;
+			float k = CalculateSphereSphereImpulse(spheres[i0], spheres[i1], J0, J1, rigidBodies, i0, i1, contactNormal, p0, p1);
+			rigidBodies.SetVelocity(i0, rigidBodies.GetVelocity(i0) - k * contactNormal * rigidBodies.GetInverseMass(i0));
+			rigidBodies.SetVelocity(i1, rigidBodies.GetVelocity(i1) + k * contactNormal * rigidBodies.GetInverseMass(i1));
+			rigidBodies.SetAngularVelocity(i0, rigidBodies.GetAngularVelocity(i0) - cliqCity::graphicsMath::cross(p0, k * contactNormal) * gSphereInverseTensor);
+			rigidBodies.SetAngularVelocity(i1, rigidBodies.GetAngularVelocity(i1) + cliqCity::graphicsMath::cross(p1, k * contactNormal) * gSphereInverseTensor);
 #else
-			float k = CalculateSphereSphereImpulse(spheres[i0], spheres[i1], rigidBodies[i0], rigidBodies[i1], contactNormal);
-			rigidBodies[i0].velocity -= k * contactNormal * rigidBodies[i0].inverseMass;
-			rigidBodies[i1].velocity += k * contactNormal * rigidBodies[i1].inverseMass;
+			float k = CalculateSphereSphereImpulse(spheres[i0], spheres[i1], rigidBodies, i0, i1, contactNormal);
+			rigidBodies.SetVelocity(i0, rigidBodies.GetVelocity(i0) - k * contactNormal * rigidBodies.GetInverseMass(i0));
+			rigidBodies.SetVelocity(i1, rigidBodies.GetVelocity(i1) + k * contactNormal * rigidBodies.GetInverseMass(i1));
 #endif
 
 			float m = ((BALL_RADIUS + BALL_RADIUS) - distanceMagnitude) * 0.5f;
@@ -992,25 +1176,27 @@ public:
 			spheres[i1].origin = iPos;
 			transforms[i0].SetPosition(jPos);
 			transforms[i1].SetPosition(iPos);
+			rigidBodies.SetPosition(i0, jPos);
+			rigidBodies.SetPosition(i1, iPos);
 		}
 
 		collisions->clear();
 		collisions->reserve(BALL_COUNT);
 	}
 
-	inline float CalculateSphereSphereImpulse(Sphere& s0, Sphere& s1, mat3f& J0, mat3f& J1, RigidBody& r0, RigidBody& r1, vec3f& normal, vec3f& poi0, vec3f& poi1)
+	inline float CalculateSphereSphereImpulse(Sphere& s0, Sphere& s1, mat3f& J0, mat3f& J1, RigidBodySystem& rigidBodies, int i0, int i1, vec3f& normal, vec3f& poi0, vec3f& poi1)
 	{
 		//                              ((e + 1) * uRel * n)
 		// -------------------------------------------------------------------------------
 		// [((1/m1 + 1/m2) * n) + ((r1 x n) * J1^-1) x r1) + ((r2 x n) * J2^-1) x r2)] * n
 
 		// uRel: Relative point velocity
-		vec3f u0 = r0.velocity + cliqCity::graphicsMath::cross(r0.angularVelocity, poi0);
-		vec3f u1 = r1.velocity + cliqCity::graphicsMath::cross(r1.angularVelocity, poi1);
+		vec3f u0 = rigidBodies.GetVelocity(i0) + cliqCity::graphicsMath::cross(rigidBodies.GetAngularVelocity(i0), poi0);
+		vec3f u1 = rigidBodies.GetVelocity(i1) + cliqCity::graphicsMath::cross(rigidBodies.GetAngularVelocity(i1), poi1);
 		vec3f uRel = u0 - u1;
 
 		float numerator = (ELASTIC_CONSTANT + 1.0f) * cliqCity::graphicsMath::dot(uRel, normal);
-		vec3f sumInverseMassxN = (r0.inverseMass + r1.inverseMass) * normal;
+		vec3f sumInverseMassxN = (rigidBodies.GetInverseMass(i0) + rigidBodies.GetInverseMass(i1)) * normal;
 		vec3f p0CrossN = cliqCity::graphicsMath::cross(poi0, normal);
 		vec3f p1CrossN = cliqCity::graphicsMath::cross(poi1, normal);
 		vec3f p0CrossNxJ0 = p0CrossN * J0;
@@ -1019,20 +1205,20 @@ public:
 		return numerator / denominator;
 	}
 
-	inline float CalculateSphereSphereImpulse(Sphere& s0, Sphere& s1, RigidBody& r0, RigidBody& r1, vec3f& normal)
+	inline float CalculateSphereSphereImpulse(Sphere& s0, Sphere& s1, RigidBodySystem& rigidBodies, int i0, int i1, vec3f& normal)
 	{
-		vec3f vRel = r0.velocity - r1.velocity;
+		vec3f vRel = rigidBodies.GetVelocity(i0) - rigidBodies.GetVelocity(i1);
 		float numerator = (ELASTIC_CONSTANT + 1.0f) * cliqCity::graphicsMath::dot(vRel, normal);
-		float denominator = cliqCity::graphicsMath::dot((r0.inverseMass + r1.inverseMass) * normal, normal);
+		float denominator = cliqCity::graphicsMath::dot((rigidBodies.GetInverseMass(i0) + rigidBodies.GetInverseMass(i1)) * normal, normal);
 		return numerator / denominator;
 	}
 
-	inline float CalculatePlaneSphereImpulse(Sphere& sphere, mat3f& J1, RigidBody& rigidBody, vec3f& normal, vec3f& poi0, vec3f& poi1)
+	inline float CalculatePlaneSphereImpulse(Sphere& sphere, mat3f& J1, RigidBodySystem& rigidBodies, int i, vec3f& normal, vec3f& poi0, vec3f& poi1)
 	{
-		vec3f uRel = rigidBody.velocity + cliqCity::graphicsMath::cross(rigidBody.angularVelocity, poi1);
+		vec3f uRel = rigidBodies.GetVelocity(i) + cliqCity::graphicsMath::cross(rigidBodies.GetAngularVelocity(i), poi1);
 
 		float numerator = (PLANE_SPHERE_ELASTIC_CONSTANT + 1.0f) * cliqCity::graphicsMath::dot(-uRel, normal);
-		vec3f sumInverseMassxN = (PLANE_INVERSE_MASS + rigidBody.inverseMass) * normal;
+		vec3f sumInverseMassxN = (PLANE_INVERSE_MASS + rigidBodies.GetInverseMass(i)) * normal;
 		vec3f p0CrossN = cliqCity::graphicsMath::cross(poi0, normal);
 		vec3f p1CrossN = cliqCity::graphicsMath::cross(poi1, normal);
 		vec3f p0CrossNxJ0 = vec3f(0.0f);//p0CrossN * gPlaneInverseTensor;
@@ -1041,57 +1227,59 @@ public:
 		return numerator / denominator;
 	}
 
-	inline float CalculatePlaneSphereImpulse(Sphere& sphere, RigidBody& rigidBody, vec3f& normal)
+	inline float CalculatePlaneSphereImpulse(Sphere& sphere, RigidBodySystem& rigidBodies, int i, vec3f& normal)
 	{
-		vec3f vRel = rigidBody.velocity;
+		vec3f vRel = rigidBodies.GetVelocity(i);
 		float numerator = (PLANE_SPHERE_ELASTIC_CONSTANT + 1.0f) * cliqCity::graphicsMath::dot(-vRel, normal);
-		float denominator = cliqCity::graphicsMath::dot((rigidBody.inverseMass) * normal, normal);
+		float denominator = cliqCity::graphicsMath::dot((rigidBodies.GetInverseMass(i)) * normal, normal);
 		return numerator / denominator;
 	}
 
-	inline float CalculateImpulse(vec3f incoming, Sphere& sphere, RigidBody& rigidBody, vec3f& normal, vec3f& poi)
+	inline float CalculateImpulse(vec3f incoming, Sphere& sphere, RigidBodySystem& rigidBodies, int i, vec3f& normal, vec3f& poi)
 	{
-		vec3f vRel = incoming - rigidBody.velocity;
+		vec3f vRel = incoming - rigidBodies.GetVelocity(i);
 		float numerator = (PLANE_SPHERE_ELASTIC_CONSTANT + 1.0f) * cliqCity::graphicsMath::dot(vRel, normal);
-		float denominator = (CUE_INVERSE_MASS + rigidBody.inverseMass) * cliqCity::graphicsMath::dot(normal, normal);
+		float denominator = (CUE_INVERSE_MASS + rigidBodies.GetInverseMass(i)) * cliqCity::graphicsMath::dot(normal, normal);
 		return numerator / denominator;
 	}
 
-	void ApplyFriction(Sphere* spheres, RigidBody* rigidBodies, int count)
+	void ApplyFriction(Sphere* spheres, RigidBodySystem& rigidBodies, int count)
 	{
 		vec3f r = { 0.0f, -BALL_RADIUS, 0.0f };
 		for (int i = 0; i < count; i++)
 		{
+			vec3f v = rigidBodies.GetVelocity(i);
 
 			// NOT MOVING
-			if ((-LINEAR_VELOCITY_THRESHOLD <= rigidBodies[i].velocity.x && rigidBodies[i].velocity.x <= LINEAR_VELOCITY_THRESHOLD) &&
-				(-LINEAR_VELOCITY_THRESHOLD <= rigidBodies[i].velocity.z && rigidBodies[i].velocity.z <= LINEAR_VELOCITY_THRESHOLD))
+			if ((-LINEAR_VELOCITY_THRESHOLD <= v.x && v.x <= LINEAR_VELOCITY_THRESHOLD) &&
+				(-LINEAR_VELOCITY_THRESHOLD <= v.z && v.z <= LINEAR_VELOCITY_THRESHOLD))
 			{
-				rigidBodies[i].velocity = rigidBodies[i].angularVelocity = vec3f(0.0f);
+				rigidBodies.SetVelocity(i, vec3f(0.0f));
+				rigidBodies.SetAngularVelocity(i, vec3f(0.0f));
 			}
 			else
 			{
-				float velocity			= cliqCity::graphicsMath::magnitude(rigidBodies[i].velocity);
-				float angularVelocity	= cliqCity::graphicsMath::magnitude(rigidBodies[i].angularVelocity * BALL_RADIUS);
-				vec3f normal			= -(rigidBodies[i].velocity / velocity);
+				float velocity			= cliqCity::graphicsMath::magnitude(v);
+				float angularVelocity	= cliqCity::graphicsMath::magnitude(rigidBodies.GetAngularVelocity(i) * BALL_RADIUS);
+				vec3f normal			= -(v / velocity);
 				float slidingPercentage = angularVelocity / velocity;
 
 				vec3f f1 = normal * gKineticFriction * (1 - min(slidingPercentage, 1.0f));	// Applies torque in direction opposite linear velocity 
 				vec3f f2 = normal * gStaticFriction * min(slidingPercentage, 1.0f);			// Applies torque in direction of linear velocity
 				vec3f t1 = cliqCity::graphicsMath::cross(r, f1);
 				vec3f t2 = cliqCity::graphicsMath::cross(r, f2);
-				rigidBodies[i].forces	+= f1 + f2;
-				rigidBodies[i].torques	+= t1 - t2;
+				rigidBodies.AddForce(i, f1 + f2);
+				rigidBodies.AddTorque(i, t1 - t2);
 			}
 		}
 	}
 
-	void ApplyImpulse(Sphere& sphere, RigidBody& rigidBody, vec3f normal)
+	void ApplyImpulse(Sphere& sphere, RigidBodySystem& rigidBodies, int i, vec3f normal)
 	{
 		vec3f poi = sphere.origin - sphere.radius * normal;
 		vec3f velocity = normal * CUE_SPEED;
-		float k = CalculateImpulse(velocity, sphere, rigidBody, normal, poi);
- 		rigidBody.velocity += k * normal * rigidBody.inverseMass;
+		float k = CalculateImpulse(velocity, sphere, rigidBodies, i, normal, poi);
+ 		rigidBodies.SetVelocity(i, rigidBodies.GetVelocity(i) + k * normal * rigidBodies.GetInverseMass(i));
 	}
 };
 
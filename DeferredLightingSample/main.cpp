@@ -14,7 +14,6 @@
 #define SATURATE_RANDOM				FLT_EPSILON + (float)(rand()) / ((float)(RAND_MAX / (1.0f - FLT_EPSILON)))
 #define PI							3.1415926535f
 #define MULTITHREAD					1
-#define THREAD_COUNT				4
 #define MAX_LIGHTS					120
 #define MIN_LIGHTS					0
 #define LIGHT_POSITION_RADIUS_I		3.0f
@@ -25,11 +24,12 @@
 #define MESH_COUNT					5
 #define POINT_LIGHT_SCALE			0.2f
 #define POINT_LIGHT_VOLUME_SCALE	5.0f
+#define TASK_COUNT					16
 
 using namespace Rig3D;
 
 uint8_t gMemory[10240];
-uint8_t gTaskMemory[1024];
+alignas(cliqCity::multicore::Task) uint8_t gTaskMemory[sizeof(cliqCity::multicore::Task) * TASK_COUNT];
 static const vec4f gAmbientColor = { 0.02f, 0.2f, 0.2f, 1.0f };
 static const float gRadian = PI / 180.f;
 
@@ -48,17 +48,6 @@ struct Vertex3
 
 std::mutex gMemoryMutex;
 
-void PerformModelLoadTask(const cliqCity::multicore::TaskData& data)
-{
-	OBJBasicResource<Vertex3> resource(reinterpret_cast<const char*>(data.mKernelData));
-	MeshLibrary<LinearAllocator>* meshLibrary = reinterpret_cast<MeshLibrary<LinearAllocator>*>(data.mStream.in[0]);
-	TSingleton<IRenderer, DX3D11Renderer>* drawContext = reinterpret_cast<TSingleton<IRenderer, DX3D11Renderer>*>(data.mStream.in[1]);
-	IMesh** mesh = reinterpret_cast<IMesh**>(data.mStream.in[2]);
-
-	std::lock_guard<std::mutex> lock(gMemoryMutex);
-	meshLibrary->LoadMesh(mesh, drawContext, resource);
-}
-
 class DeferredLightingScene : public IScene, public virtual IRendererDelegate
 {
 public:
@@ -679,8 +668,6 @@ public:
 	void InitializeGeometry()
 	{
 #ifdef MULTITHREAD
-		cliqCity::multicore::Thread threads[THREAD_COUNT];
-		cliqCity::multicore::TaskData modelData[MESH_COUNT];
 		char* fileNames[MESH_COUNT] = {
 			"Models\\torus.obj",
 			"Models\\cylinder.obj",
@@ -699,15 +686,20 @@ public:
 
 		cliqCity::multicore::TaskID taskIDs[MESH_COUNT];
 
-		cliqCity::multicore::TaskDispatcher dispatchQueue(threads, THREAD_COUNT, gTaskMemory, 1024);
+		cliqCity::multicore::TaskDispatcher dispatchQueue(gTaskMemory, sizeof(gTaskMemory));
 		dispatchQueue.Start();
+		// Initialization waits on every load, so any thread may take them. Background priority is for streaming while the sample runs.
 		for (int i = 0; i < MESH_COUNT; i++)
 		{
-			modelData[i].mKernelData = fileNames[i];
-			modelData[i].mStream.in[0] = &mMeshLibrary;
-			modelData[i].mStream.in[1] = mRenderer;
-			modelData[i].mStream.in[2] = meshes[i];
-			taskIDs[i] = dispatchQueue.AddTask(modelData[i], PerformModelLoadTask);
+			const char* fileName = fileNames[i];
+			IMesh** mesh = meshes[i];
+			taskIDs[i] = dispatchQueue.AddTask([this, fileName, mesh]()
+			{
+				OBJBasicResource<Vertex3> resource(fileName);
+
+				std::lock_guard<std::mutex> lock(gMemoryMutex);
+				mMeshLibrary.LoadMesh(mesh, mRenderer, resource);
+			}, cliqCity::multicore::TASK_PRIORITY_NORMAL);
 		}
 #else
 		OBJBasicResource<Vertex3> torusResource("Models\\torus.obj");
@@ -9,6 +9,8 @@
 #include "Rig3D\Graphics\Interface\IShaderResource.h"
 #include "Rig3D/Intersection.h"
 #include "Rig3D/Visibility.h"
+#include "Rig3D/UniformGrid.h"
+#include "Rig3D/RigidBodySystem.h"
 #include "Rig3D/Graphics/Camera.h"
 #include <d3d11.h>
 #include <ctime>
@@ -21,7 +23,7 @@
 #define CAMERA_ROTATION_SPEED		0.1f
 #define RADIAN						3.1415926535f / 180.0f
 #define INSTANCE_COUNT				20
-#define SCENE_MEMORY				10240
+#define SCENE_MEMORY				(10240 + INSTANCE_COUNT * sizeof(vec3f) * 2)
 #define BOID_NEIGHBOR_RADIUS		2.5f
 #define BOID_SEPARATION_RADIUS		(BOID_NEIGHBOR_RADIUS * 0.6f)
 #define OBSTACLE_AVOIDANCE_WEIGHT	0.2f
@@ -48,12 +50,6 @@ struct Vertex3
 	vec2f UV;
 };
 
-struct RigidBody
-{
-	vec3f velocity;
-	vec3f forces;
-};
-
 struct Boid
 {
 	vec3f			nPositions[3];
@@ -62,7 +58,6 @@ struct Boid
 	uint32_t		nIndices[3];
 	
 	Transform*		transform;
-	RigidBody*		rigidBody;
 	SphereCollider* collider;
 };
 
@@ -87,10 +82,14 @@ public:
 	mat4f*				mBoidWorldMatrices;
 	
 	Transform*			mBoidTransforms;
-	RigidBody*			mBoidRigidBodies;
+	RigidBodySystem		mBoidBodies;
 	SphereCollider*		mBoidColliders;
 	Boid*				mBoids;
 
+	UniformGrid			mBoidGrid;
+	vec3f*				mBoidPositions;
+	vec3f*				mSortedBoidVelocities;
+
 	TSingleton<IRenderer, DX3D11Renderer>*	mRenderer;
 	IShader*			mBoidVertexShader;
 	IShader*			mBoidPixelShader;
@@ -133,6 +132,8 @@ GroupMotionSample::GroupMotionSample() :
 	mBoidRigidBodies(nullptr),
 	mBoidColliders(nullptr),
 	mBoids(nullptr),
+	mBoidPositions(nullptr),
+	mSortedBoidVelocities(nullptr),
 	mRenderer(nullptr),
 	mBoidVertexShader(nullptr),
 	mBoidPixelShader(nullptr),
@@ -229,10 +230,12 @@ void GroupMotionSample::InitializePhysics()
 {
 	mBoidWorldMatrices	= reinterpret_cast<mat4f*>(mLinearAllocator.Allocate(sizeof(mat4f) * INSTANCE_COUNT, alignof(mat4f), 0));
 	mBoidTransforms		= reinterpret_cast<Transform*>(mLinearAllocator.Allocate(sizeof(Transform) * INSTANCE_COUNT, alignof(Transform), 0));
-	mBoidRigidBodies	= reinterpret_cast<RigidBody*>(mLinearAllocator.Allocate(sizeof(RigidBody) * INSTANCE_COUNT, alignof(RigidBody), 0));
 	mBoidColliders		= reinterpret_cast<SphereCollider*>(mLinearAllocator.Allocate(sizeof(SphereCollider) * INSTANCE_COUNT, alignof(SphereCollider), 0));
 	mBoids				= reinterpret_cast<Boid*>(mLinearAllocator.Allocate(sizeof(Boid) * INSTANCE_COUNT, alignof(Boid), 0));
 
+	mBoidPositions			= reinterpret_cast<vec3f*>(mLinearAllocator.Allocate(sizeof(vec3f) * INSTANCE_COUNT, alignof(vec3f), 0));
+	mSortedBoidVelocities	= reinterpret_cast<vec3f*>(mLinearAllocator.Allocate(sizeof(vec3f) * INSTANCE_COUNT, alignof(vec3f), 0));
+
 	ResetBoids();
 }
 
@@ -289,13 +292,13 @@ void GroupMotionSample::VUpdate(double milliseconds)
 
 	UpdateShaderResources();	
 
-	Boid* b = &mBoids[0];
-	Boid* b1 = &mBoids[1];
+	vec3f v0 = mBoidBodies.GetVelocity(0);
+	vec3f v1 = mBoidBodies.GetVelocity(1);
 
 	vec3f p = b->transform->GetPosition();
 	char str[256];
-	sprintf_s(str, "Group Motion Sample  S: %f  A: %f  C: %f  B0: %f %f %f B1: %f %f %f", gSeparationWeight, gAlignmentWeight, gCohesionWeight, b->rigidBody->velocity.x, b->rigidBody->velocity.y, b->rigidBody->velocity.z,
-		b1->rigidBody->velocity.x, b1->rigidBody->velocity.y, b1->rigidBody->velocity.z);
+	sprintf_s(str, "Group Motion Sample  S: %f  A: %f  C: %f  B0: %f %f %f B1: %f %f %f", gSeparationWeight, gAlignmentWeight, gCohesionWeight, v0.x, v0.y, v0.z,
+		v1.x, v1.y, v1.z);
 	mRenderer->SetWindowCaption(str);
 }
 
@@ -375,9 +378,31 @@ void GroupMotionSample::UpdateInput(Input& input)
 
 void GroupMotionSample::UpdateBoidBehaviors()
 {
+	// Neighbors are read from a snapshot sorted into grid cells, so every boid sees the others as they were at the start of the update.
 	for (int i = 0; i < INSTANCE_COUNT; i++)
 	{
-		Boid* boid = &mBoids[i];
+		mBoidPositions[i] = mBoids[i].transform->GetPosition();
+	}
+
+	mBoidGrid.Build(mBoidPositions, INSTANCE_COUNT, BOID_NEIGHBOR_RADIUS);
+
+	const float* neighborX = mBoidGrid.GetPositionsX();
+	const float* neighborY = mBoidGrid.GetPositionsY();
+	const float* neighborZ = mBoidGrid.GetPositionsZ();
+	const uint32_t* sortedIndices = mBoidGrid.GetIndices();
+
+	for (int i = 0; i < INSTANCE_COUNT; i++)
+	{
+		mSortedBoidVelocities[i] = mBoidBodies.GetVelocity(sortedIndices[i]);
+	}
+
+	// Visit boids in cell order so consecutive queries read the same cells.
+	for (int slot = 0; slot < INSTANCE_COUNT; slot++)
+	{
+		uint32_t index = sortedIndices[slot];
+		Boid* boid = &mBoids[index];
+		vec3f position = { neighborX[slot], neighborY[slot], neighborZ[slot] };
+		vec3f velocity = mSortedBoidVelocities[slot];
 
 		vec3f separation = vec3f(0.0f);
 		vec3f alignment = vec3f(0.0f);
@@ -391,32 +416,28 @@ void GroupMotionSample::UpdateBoidBehaviors()
 		float alignmentMagnitude = 0.0f;
 		float cohesionMagnitude = 0.0f;
 
-		for (int j = 0; j < INSTANCE_COUNT; j++)
+		mBoidGrid.ForEachNeighbor(position, BOID_NEIGHBOR_RADIUS, [&](uint32_t neighbor, float distanceSquared)
 		{
-			if (i == j)
-			{
-				continue;
-			}
-
-			vec3f nPosition = mBoids[j].transform->GetPosition();
-			vec3f toNeighbor = nPosition - boid->transform->GetPosition();
-			float distance = cliqCity::graphicsMath::magnitude(toNeighbor);
+			float distance = sqrtf(distanceSquared);
 
 			if (distance > FLT_EPSILON && distance < BOID_NEIGHBOR_RADIUS)
 			{
+				vec3f nPosition = { neighborX[neighbor], neighborY[neighbor], neighborZ[neighbor] };
+				vec3f toNeighbor = nPosition - position;
+
 				if (distance < BOID_SEPARATION_RADIUS)
 				{
 					separation += (toNeighbor * (BOID_SEPARATION_RADIUS / -distance));
 					separationCount++;
 				}
 
-				alignment += mBoids[j].rigidBody->velocity;
+				alignment += mSortedBoidVelocities[neighbor];
 				cohesion += nPosition;
 
 				alignmentCount++;
 				cohesionCount++;
 			}
-		}
+		});
 
 		if (separationCount > 0.0f)
 		{
@@ -437,7 +458,7 @@ void GroupMotionSample::UpdateBoidBehaviors()
 		if (cohesionCount > 0.0f)
 		{
 			cohesion /= cohesionCount;
-			cohesion -= boid->transform->GetPosition();
+			cohesion -= position;
 
 			cohesionMagnitude = cliqCity::graphicsMath::magnitude(cohesion);
 
@@ -455,20 +476,22 @@ void GroupMotionSample::UpdateBoidBehaviors()
 			//	cohesion *= 5.0f;
 			//}
 
-			cohesion -= boid->rigidBody->velocity;
+			cohesion -= velocity;
 		}
 
 		separation	*= gSeparationWeight;
 		cohesion	*= gCohesionWeight;
 		alignment	*= gAlignmentWeight;
 
-		boid->rigidBody->velocity += separation + alignment + cohesion;
+		velocity += separation + alignment + cohesion;
 
-		float speed = cliqCity::graphicsMath::magnitude(boid->rigidBody->velocity);
+		float speed = cliqCity::graphicsMath::magnitude(velocity);
 		if (speed > MAX_BOID_SPEED)
 		{
-			boid->rigidBody->velocity *= (MAX_BOID_SPEED / speed);
+			velocity *= (MAX_BOID_SPEED / speed);
 		}
+
+		mBoidBodies.SetVelocity(index, velocity);
 	}
 }
 
@@ -496,7 +519,7 @@ void GroupMotionSample::UpdateBoidForces()
 
 	//	obstacleAvoidance /= 6.0f;
 
-		boid->rigidBody->forces += obstacleAvoidance;
+		mBoidBodies.AddForce(i, obstacleAvoidance);
 	}
 }
 
@@ -512,30 +535,22 @@ void GroupMotionSample::IntegrateBoids(float deltaTime)
 
 	while (accumulator >= PHYSICS_TIME_STEP)
 	{
-		static const vec3f zero = vec3f(0.0f);
+		mBoidBodies.IntegrateEuler(deltaTime);
+		mBoidBodies.ClearForces();
 
 		for (int i = 0; i < INSTANCE_COUNT; i++)
 		{
 			Boid* boid = &mBoids[i];
-			vec3f acceleration = boid->rigidBody->forces * BOID_INVERSE_MASS;
-			vec3f velocity = boid->rigidBody->velocity;
-			vec3f position = boid->transform->GetPosition();
-
-
-			vec3f rotation = boid->transform->GetRollPitchYaw();
-
-			velocity += acceleration * deltaTime;
-			position += velocity * deltaTime;
+			vec3f velocity = mBoidBodies.GetVelocity(i);
+			vec3f position = mBoidBodies.GetPosition(i);
 
 			float cosAngle = cliqCity::graphicsMath::dot(boid->transform->GetForward(), cliqCity::graphicsMath::normalize(velocity)) * 0.1f;
 
-			rotation = { PI * 0.5f, acos(cosAngle), 0.0f };
+			vec3f rotation = { PI * 0.5f, acos(cosAngle), 0.0f };
 
-			boid->rigidBody->velocity = velocity;
 			boid->transform->SetPosition(position);
 			boid->transform->SetRotation(rotation);
 			boid->collider->origin = position;
-			boid->rigidBody->forces = zero;
 		}
 
 		accumulator -= PHYSICS_TIME_STEP;
@@ -545,6 +560,7 @@ void GroupMotionSample::IntegrateBoids(float deltaTime)
 void GroupMotionSample::ResetBoids()
 {
 	float angle = 2.0f * PI / INSTANCE_COUNT;
+	mBoidBodies.Clear();
 	for (int i = 0; i < INSTANCE_COUNT; i++)
 	{
 		vec3f scale = { 1.0f, 1.0f, 1.0f };
@@ -556,13 +572,13 @@ void GroupMotionSample::ResetBoids()
 		mBoidTransforms[i].SetScale(scale);
 		mBoidTransforms[i].SetRotation(rotation);
 
-		mBoidRigidBodies[i].velocity = velocity;
+		mBoidBodies.AddBody(position, BOID_INVERSE_MASS, { 0.0f, 0.0f, 0.0f });
+		mBoidBodies.SetVelocity(i, velocity);
 
 		mBoidColliders[i].origin = position;
 		mBoidColliders[i].radius = BOID_NEIGHBOR_RADIUS;
 
 		mBoids[i].transform = &mBoidTransforms[i];
-		mBoids[i].rigidBody = &mBoidRigidBodies[i];
 		mBoids[i].collider = &mBoidColliders[i];
 
 		mBoids[i].nDistances[0] = FLT_MAX;
@@ -570,9 +586,9 @@ void GroupMotionSample::ResetBoids()
 		mBoids[i].nDistances[2] = FLT_MAX;
 	}
 
-	mBoids[0].rigidBody->velocity = { -5.0f, 5.0f, 0.0f };
-	mBoids[1].rigidBody->velocity = { 5.0f, -5.0f, 0.0f };
-	mBoids[2].rigidBody->velocity = { 5.0f, 5.0f, 0.0f };
+	mBoidBodies.SetVelocity(0, { -5.0f, 5.0f, 0.0f });
+	mBoidBodies.SetVelocity(1, { 5.0f, -5.0f, 0.0f });
+	mBoidBodies.SetVelocity(2, { 5.0f, 5.0f, 0.0f });
 
 }
 
@@ -0,0 +1,1105 @@
+#include "BVH.h"
+#include "Intersection.h"
+#include "TaskDispatch/TaskDispatcher.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+
+using namespace Rig3D;
+using namespace cliqCity::multicore;
+
+static const uint32_t BVH_FILE_MAGIC = 0x48564252;		// "RBVH"
+static const uint32_t BVH_FILE_VERSION = 1;
+static const uint32_t BVH_TASK_SIZE = 4096;				// Smaller subtrees are built on the task that split them.
+static const uint32_t BVH_PARALLEL_BIN_SIZE = 65536;	// Larger nodes bin their primitives in parallel.
+static const float BVH_TRAVERSAL_COST = 1.0f;			// Relative to one primitive test.
+
+namespace Rig3D
+{
+	struct BVHBuildPrimitive
+	{
+		float		min[3];
+		float		max[3];
+		float		centroid[3];
+		uint32_t	index;
+	};
+}
+
+namespace
+{
+	struct BVHBounds
+	{
+		float min[3];
+		float max[3];
+
+		void Reset()
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				min[axis] = FLT_MAX;
+				max[axis] = -FLT_MAX;
+			}
+		}
+
+		void Grow(const float* pMin, const float* pMax)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				min[axis] = (pMin[axis] < min[axis]) ? pMin[axis] : min[axis];
+				max[axis] = (pMax[axis] > max[axis]) ? pMax[axis] : max[axis];
+			}
+		}
+
+		float GetHalfArea() const
+		{
+			float x = max[0] - min[0];
+			float y = max[1] - min[1];
+			float z = max[2] - min[2];
+			return (x < 0.0f) ? 0.0f : x * y + y * z + z * x;
+		}
+	};
+
+	struct BVHNodeBounds
+	{
+		BVHBounds bounds;
+		BVHBounds centroids;
+	};
+
+	struct BVHBins
+	{
+		BVHBounds	bounds[3][RIG_BVH_BIN_COUNT];
+		uint32_t	counts[3][RIG_BVH_BIN_COUNT];
+	};
+
+	struct BVHBuildContext
+	{
+		TaskDispatcher*			mDispatcher;
+		TaskID					mRootID;
+		BVHBuildPrimitive*		mPrimitives;
+		BVHNode*				mNodes;
+		std::atomic<uint32_t>	mNodeCount;
+		std::atomic<uint32_t>	mDepth;
+	};
+
+	struct BVHRay
+	{
+		float	origin[3];
+		float	ood[3];
+		bool	isParallel[3];
+	};
+
+	struct BVHStackEntry
+	{
+		uint32_t	nodeIndex;
+		float		t;
+	};
+
+	struct BVHFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t type;
+		uint32_t nodeCount;
+		uint32_t primitiveCount;
+		uint32_t depth;
+	};
+
+	enum BVHOverlap
+	{
+		BVH_OVERLAP_NONE,
+		BVH_OVERLAP_PARTIAL,
+		BVH_OVERLAP_CONTAINED
+	};
+
+	// Large nodes split the reduction across the dispatcher. min and max are exact, so the result does not depend on the chunking.
+	template<class T, class Reduce, class Combine>
+	T ReducePrimitives(BVHBuildContext* context, uint32_t begin, uint32_t end, const T& identity, const Reduce& reduce, const Combine& combine)
+	{
+		if (context->mDispatcher && end - begin >= BVH_PARALLEL_BIN_SIZE)
+		{
+			return context->mDispatcher->ParallelReduce(begin, end, BVH_PARALLEL_BIN_SIZE / 8, identity, reduce, combine);
+		}
+
+		return reduce(begin, end);
+	}
+
+	BVHNodeBounds ComputeNodeBounds(BVHBuildContext* context, uint32_t begin, uint32_t end)
+	{
+		BVHNodeBounds identity;
+		identity.bounds.Reset();
+		identity.centroids.Reset();
+
+		const BVHBuildPrimitive* primitives = context->mPrimitives;
+		return ReducePrimitives(context, begin, end, identity, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+		{
+			BVHNodeBounds result = identity;
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				result.bounds.Grow(primitives[i].min, primitives[i].max);
+				result.centroids.Grow(primitives[i].centroid, primitives[i].centroid);
+			}
+
+			return result;
+		},
+		[](const BVHNodeBounds& a, const BVHNodeBounds& b)
+		{
+			BVHNodeBounds result = a;
+			result.bounds.Grow(b.bounds.min, b.bounds.max);
+			result.centroids.Grow(b.centroids.min, b.centroids.max);
+			return result;
+		});
+	}
+
+	inline uint32_t GetBin(const BVHBuildPrimitive& primitive, uint32_t axis, const BVHBounds& centroids, float scale)
+	{
+		uint32_t bin = static_cast<uint32_t>((primitive.centroid[axis] - centroids.min[axis]) * scale);
+		return (bin < RIG_BVH_BIN_COUNT) ? bin : RIG_BVH_BIN_COUNT - 1;
+	}
+
+	// Finds the cheapest of the bin boundaries on every axis by the surface area heuristic. Returns false if every centroid coincides.
+	bool FindSplit(BVHBuildContext* context, uint32_t begin, uint32_t end, const BVHBounds& centroids, uint32_t* splitAxis, uint32_t* splitBin, float* splitCost, float* scales)
+	{
+		BVHBins identity;
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			float extent = centroids.max[axis] - centroids.min[axis];
+			scales[axis] = (extent > 0.0f) ? RIG_BVH_BIN_COUNT / extent : 0.0f;
+
+			for (uint32_t b = 0; b < RIG_BVH_BIN_COUNT; b++)
+			{
+				identity.bounds[axis][b].Reset();
+				identity.counts[axis][b] = 0;
+			}
+		}
+
+		const BVHBuildPrimitive* primitives = context->mPrimitives;
+		BVHBins bins = ReducePrimitives(context, begin, end, identity, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+		{
+			BVHBins result = identity;
+			for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					uint32_t bin = GetBin(primitives[i], axis, centroids, scales[axis]);
+					result.bounds[axis][bin].Grow(primitives[i].min, primitives[i].max);
+					result.counts[axis][bin]++;
+				}
+			}
+
+			return result;
+		},
+		[](const BVHBins& a, const BVHBins& b)
+		{
+			BVHBins result = a;
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				for (uint32_t bin = 0; bin < RIG_BVH_BIN_COUNT; bin++)
+				{
+					result.bounds[axis][bin].Grow(b.bounds[axis][bin].min, b.bounds[axis][bin].max);
+					result.counts[axis][bin] += b.counts[axis][bin];
+				}
+			}
+
+			return result;
+		});
+
+		bool isFound = false;
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			if (scales[axis] == 0.0f)
+			{
+				continue;
+			}
+
+			// Sweep from the right to get the area and count of everything above each boundary, then from the left to price each split.
+			float rightAreas[RIG_BVH_BIN_COUNT];
+			uint32_t rightCounts[RIG_BVH_BIN_COUNT];
+
+			BVHBounds right;
+			right.Reset();
+			uint32_t rightCount = 0;
+			for (uint32_t bin = RIG_BVH_BIN_COUNT - 1; bin > 0; bin--)
+			{
+				right.Grow(bins.bounds[axis][bin].min, bins.bounds[axis][bin].max);
+				rightCount += bins.counts[axis][bin];
+				rightAreas[bin] = right.GetHalfArea();
+				rightCounts[bin] = rightCount;
+			}
+
+			BVHBounds left;
+			left.Reset();
+			uint32_t leftCount = 0;
+			for (uint32_t bin = 1; bin < RIG_BVH_BIN_COUNT; bin++)
+			{
+				left.Grow(bins.bounds[axis][bin - 1].min, bins.bounds[axis][bin - 1].max);
+				leftCount += bins.counts[axis][bin - 1];
+				if (leftCount == 0 || rightCounts[bin] == 0)
+				{
+					continue;
+				}
+
+				float cost = left.GetHalfArea() * leftCount + rightAreas[bin] * rightCounts[bin];
+				if (!isFound || cost < *splitCost)
+				{
+					*splitAxis = axis;
+					*splitBin = bin;
+					*splitCost = cost;
+					isFound = true;
+				}
+			}
+		}
+
+		return isFound;
+	}
+
+	void BuildNode(BVHBuildContext* context, uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth)
+	{
+		BVHBuildPrimitive* primitives = context->mPrimitives;
+		BVHNode& node = context->mNodes[nodeIndex];
+		uint32_t count = end - begin;
+
+		BVHNodeBounds nodeBounds = ComputeNodeBounds(context, begin, end);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.min[axis] = nodeBounds.bounds.min[axis];
+			node.max[axis] = nodeBounds.bounds.max[axis];
+		}
+
+		uint32_t maxDepth = context->mDepth.load(std::memory_order_relaxed);
+		while (depth > maxDepth && !context->mDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed));
+
+		uint32_t middle = begin;
+		if (count > 1)
+		{
+			uint32_t axis, bin;
+			float cost;
+			float scales[3];
+
+			// Past half the depth limit split at the median instead, which bounds the remaining depth by log2 of the count.
+			bool isSAH = depth < RIG_BVH_MAX_DEPTH / 2 && FindSplit(context, begin, end, nodeBounds.centroids, &axis, &bin, &cost, scales);
+			if (isSAH)
+			{
+				float area = nodeBounds.bounds.GetHalfArea();
+				if (count > RIG_BVH_MAX_LEAF_SIZE || BVH_TRAVERSAL_COST * area + cost < count * area)
+				{
+					const BVHBounds& centroids = nodeBounds.centroids;
+					middle = static_cast<uint32_t>(std::partition(primitives + begin, primitives + end, [&](const BVHBuildPrimitive& primitive)
+					{
+						return GetBin(primitive, axis, centroids, scales[axis]) < bin;
+					}) - primitives);
+				}
+			}
+			else if (count > RIG_BVH_MAX_LEAF_SIZE)
+			{
+				axis = 0;
+				for (uint32_t i = 1; i < 3; i++)
+				{
+					float extent = nodeBounds.centroids.max[i] - nodeBounds.centroids.min[i];
+					axis = (extent > nodeBounds.centroids.max[axis] - nodeBounds.centroids.min[axis]) ? i : axis;
+				}
+
+				middle = begin + count / 2;
+				std::nth_element(primitives + begin, primitives + middle, primitives + end, [axis](const BVHBuildPrimitive& a, const BVHBuildPrimitive& b)
+				{
+					return a.centroid[axis] < b.centroid[axis];
+				});
+			}
+		}
+
+		if (middle == begin)
+		{
+			node.offset = begin;
+			node.count = count;
+			return;
+		}
+
+		// Children are allocated in pairs in whatever order threads reach them. BuildNodes reorders them afterwards.
+		uint32_t left = context->mNodeCount.fetch_add(2, std::memory_order_relaxed);
+		node.offset = left;
+		node.count = 0;
+
+		if (context->mDispatcher && middle - begin >= BVH_TASK_SIZE)
+		{
+			context->mDispatcher->AddTask([context, left, begin, middle, depth]()
+			{
+				BuildNode(context, left, begin, middle, depth + 1);
+			}, context->mRootID);
+		}
+		else
+		{
+			BuildNode(context, left, begin, middle, depth + 1);
+		}
+
+		BuildNode(context, left + 1, middle, end, depth + 1);
+	}
+
+	void FlattenNode(const std::vector<BVHNode>& source, uint32_t sourceIndex, std::vector<BVHNode>& nodes)
+	{
+		uint32_t index = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(source[sourceIndex]);
+
+		if (source[sourceIndex].count == 0)
+		{
+			FlattenNode(source, source[sourceIndex].offset, nodes);
+			nodes[index].offset = static_cast<uint32_t>(nodes.size());
+			FlattenNode(source, source[sourceIndex].offset + 1, nodes);
+		}
+	}
+
+	void SetupRay(const Ray<vec3f>& ray, BVHRay* bvhRay)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			bvhRay->origin[axis] = ray.origin[axis];
+			bvhRay->isParallel[axis] = fabsf(ray.normal[axis]) < FLT_EPSILON;
+			bvhRay->ood[axis] = bvhRay->isParallel[axis] ? 0.0f : 1.0f / ray.normal[axis];
+		}
+	}
+
+	// Slab test clipped to [0, tLimit], matching IntersectRayAABB.
+	inline bool IntersectNodeRay(const BVHNode& node, const BVHRay& ray, float tLimit, float* tEntry)
+	{
+		float tMin = 0.0f;
+		float tMax = tLimit;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (ray.isParallel[axis])
+			{
+				if (ray.origin[axis] < node.min[axis] || ray.origin[axis] > node.max[axis])
+				{
+					return false;
+				}
+			}
+			else
+			{
+				float t1 = (node.min[axis] - ray.origin[axis]) * ray.ood[axis];
+				float t2 = (node.max[axis] - ray.origin[axis]) * ray.ood[axis];
+				if (t1 > t2)
+				{
+					float temp = t2;
+					t2 = t1;
+					t1 = temp;
+				}
+
+				tMin = (t1 > tMin) ? t1 : tMin;
+				tMax = (t2 < tMax) ? t2 : tMax;
+				if (tMin > tMax)
+				{
+					return false;
+				}
+			}
+		}
+
+		*tEntry = tMin;
+		return true;
+	}
+
+	inline BoxCollider GetNodeBox(const BVHNode& node)
+	{
+		BoxCollider aabb;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			aabb.origin[axis] = (node.min[axis] + node.max[axis]) * 0.5f;
+			aabb.halfSize[axis] = (node.max[axis] - node.min[axis]) * 0.5f;
+		}
+
+		return aabb;
+	}
+
+	inline BoxCollider GetTriangleBox(const vec3f* corners)
+	{
+		float min[3];
+		float max[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			min[axis] = std::min(corners[0][axis], std::min(corners[1][axis], corners[2][axis]));
+			max[axis] = std::max(corners[0][axis], std::max(corners[1][axis], corners[2][axis]));
+		}
+
+		BoxCollider aabb;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			aabb.origin[axis] = (min[axis] + max[axis]) * 0.5f;
+			aabb.halfSize[axis] = (max[axis] - min[axis]) * 0.5f;
+		}
+
+		return aabb;
+	}
+
+	// Box against the frustum planes with the same expression Cull uses for spheres, the box's projected half extent standing in for the radius.
+	inline BVHOverlap IntersectBoxFrustum(const BoxCollider& aabb, const Plane<vec3f>* const* planes)
+	{
+		BVHOverlap overlap = BVH_OVERLAP_CONTAINED;
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			const vec3f& normal = planes[p]->normal;
+			float radius = fabsf(normal.x) * aabb.halfSize.x + fabsf(normal.y) * aabb.halfSize.y + fabsf(normal.z) * aabb.halfSize.z;
+			float distance = cliqCity::graphicsMath::dot(normal, aabb.origin);
+
+			if (distance - (planes[p]->distance - radius) < 0)
+			{
+				return BVH_OVERLAP_NONE;
+			}
+
+			if (distance - (planes[p]->distance + radius) < 0)
+			{
+				overlap = BVH_OVERLAP_PARTIAL;
+			}
+		}
+
+		return overlap;
+	}
+}
+
+BVH::BVH() :
+	mType(BVH_PRIMITIVE_AABB),
+	mDepth(0)
+{
+
+}
+
+BVH::~BVH()
+{
+
+}
+
+void BVH::Build(const BoxCollider* boxes, uint32_t count, TaskDispatcher* dispatcher)
+{
+	std::vector<BVHBuildPrimitive> primitives(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			primitives[i].min[axis] = boxes[i].origin[axis] - boxes[i].halfSize[axis];
+			primitives[i].max[axis] = boxes[i].origin[axis] + boxes[i].halfSize[axis];
+			primitives[i].centroid[axis] = boxes[i].origin[axis];
+		}
+
+		primitives[i].index = i;
+	}
+
+	BuildNodes(primitives, dispatcher);
+
+	mType = BVH_PRIMITIVE_AABB;
+	mBoxes.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		mBoxes[i] = boxes[mIndices[i]];
+	}
+}
+
+void BVH::Build(const SphereCollider* spheres, uint32_t count, TaskDispatcher* dispatcher)
+{
+	std::vector<BVHBuildPrimitive> primitives(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			primitives[i].min[axis] = spheres[i].origin[axis] - spheres[i].radius;
+			primitives[i].max[axis] = spheres[i].origin[axis] + spheres[i].radius;
+			primitives[i].centroid[axis] = spheres[i].origin[axis];
+		}
+
+		primitives[i].index = i;
+	}
+
+	BuildNodes(primitives, dispatcher);
+
+	mType = BVH_PRIMITIVE_SPHERE;
+	mSpheres.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		mSpheres[i] = spheres[mIndices[i]];
+	}
+}
+
+void BVH::Build(const vec3f* positions, const uint32_t* indices, uint32_t triangleCount, TaskDispatcher* dispatcher)
+{
+	std::vector<BVHBuildPrimitive> primitives(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		const vec3f corners[3] = { positions[indices[i * 3]], positions[indices[i * 3 + 1]], positions[indices[i * 3 + 2]] };
+		BoxCollider aabb = GetTriangleBox(corners);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			primitives[i].min[axis] = aabb.origin[axis] - aabb.halfSize[axis];
+			primitives[i].max[axis] = aabb.origin[axis] + aabb.halfSize[axis];
+			primitives[i].centroid[axis] = aabb.origin[axis];
+		}
+
+		primitives[i].index = i;
+	}
+
+	BuildNodes(primitives, dispatcher);
+
+	mType = BVH_PRIMITIVE_TRIANGLE;
+	mTriangles.resize(triangleCount * 3);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			mTriangles[i * 3 + corner] = positions[indices[mIndices[i] * 3 + corner]];
+		}
+	}
+}
+
+void BVH::BuildNodes(std::vector<BVHBuildPrimitive>& primitives, TaskDispatcher* dispatcher)
+{
+	Clear();
+
+	uint32_t count = static_cast<uint32_t>(primitives.size());
+	if (count == 0)
+	{
+		return;
+	}
+
+	std::vector<BVHNode> nodes(count * 2 - 1);
+
+	BVHBuildContext context;
+	context.mDispatcher = dispatcher;
+	context.mPrimitives = primitives.data();
+	context.mNodes = nodes.data();
+	context.mNodeCount = 1;
+	context.mDepth = 0;
+
+	if (dispatcher)
+	{
+		// Subtree tasks are children of the root so one wait covers the whole build.
+		context.mRootID = dispatcher->CreateTask(TaskData(), nullptr);
+		BuildNode(&context, 0, 0, count, 1);
+		dispatcher->RunTask(context.mRootID);
+		dispatcher->WaitForTask(context.mRootID);
+	}
+	else
+	{
+		BuildNode(&context, 0, 0, count, 1);
+	}
+
+	// Depth first order makes the layout independent of the order threads allocated nodes in.
+	mNodes.reserve(context.mNodeCount);
+	FlattenNode(nodes, 0, mNodes);
+	mDepth = context.mDepth;
+
+	mIndices.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		mIndices[i] = primitives[i].index;
+	}
+}
+
+void BVH::Clear()
+{
+	mNodes.clear();
+	mIndices.clear();
+	mBoxes.clear();
+	mSpheres.clear();
+	mTriangles.clear();
+	mDepth = 0;
+}
+
+bool BVH::IntersectRay(const Ray<vec3f>& ray, BVHHit* hit, float tMax) const
+{
+	BVHRay bvhRay;
+	SetupRay(ray, &bvhRay);
+
+	float tRoot;
+	if (mNodes.empty() || !IntersectNodeRay(mNodes[0], bvhRay, tMax, &tRoot))
+	{
+		return false;
+	}
+
+	BVHStackEntry stack[RIG_BVH_MAX_DEPTH + 1];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, tRoot };
+
+	bool isHit = false;
+	float tNearest = tMax;
+
+	while (stackSize > 0)
+	{
+		BVHStackEntry entry = stack[--stackSize];
+
+		// A nearer hit may have been found since the node was pushed.
+		if (entry.t > tNearest)
+		{
+			continue;
+		}
+
+		const BVHNode& node = mNodes[entry.nodeIndex];
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				float t;
+				if (IntersectPrimitiveRay(i, ray, t) && t <= tNearest)
+				{
+					tNearest = t;
+					hit->index = mIndices[i];
+					isHit = true;
+				}
+			}
+
+			continue;
+		}
+
+		uint32_t left = entry.nodeIndex + 1;
+		uint32_t right = node.offset;
+
+		float tLeft, tRight;
+		bool isLeftHit = IntersectNodeRay(mNodes[left], bvhRay, tNearest, &tLeft);
+		bool isRightHit = IntersectNodeRay(mNodes[right], bvhRay, tNearest, &tRight);
+
+		// Push the farther child first so the nearer one is visited next and can prune it.
+		if (isLeftHit && isRightHit)
+		{
+			if (tLeft <= tRight)
+			{
+				stack[stackSize++] = { right, tRight };
+				stack[stackSize++] = { left, tLeft };
+			}
+			else
+			{
+				stack[stackSize++] = { left, tLeft };
+				stack[stackSize++] = { right, tRight };
+			}
+		}
+		else if (isLeftHit)
+		{
+			stack[stackSize++] = { left, tLeft };
+		}
+		else if (isRightHit)
+		{
+			stack[stackSize++] = { right, tRight };
+		}
+	}
+
+	if (isHit)
+	{
+		hit->t = tNearest;
+	}
+
+	return isHit;
+}
+
+bool BVH::IntersectRayAny(const Ray<vec3f>& ray, float tMax) const
+{
+	if (mNodes.empty())
+	{
+		return false;
+	}
+
+	BVHRay bvhRay;
+	SetupRay(ray, &bvhRay);
+
+	uint32_t stack[RIG_BVH_MAX_DEPTH + 1];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		uint32_t nodeIndex = stack[--stackSize];
+		const BVHNode& node = mNodes[nodeIndex];
+
+		float tEntry;
+		if (!IntersectNodeRay(node, bvhRay, tMax, &tEntry))
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				float t;
+				if (IntersectPrimitiveRay(i, ray, t) && t <= tMax)
+				{
+					return true;
+				}
+			}
+
+			continue;
+		}
+
+		stack[stackSize++] = node.offset;
+		stack[stackSize++] = nodeIndex + 1;
+	}
+
+	return false;
+}
+
+template<class NodeTest, class PrimitiveTest>
+uint32_t BVH::Gather(const NodeTest& nodeTest, const PrimitiveTest& primitiveTest, std::vector<uint32_t>& indices, bool stopAtFirst) const
+{
+	if (mNodes.empty())
+	{
+		return 0;
+	}
+
+	uint32_t stack[RIG_BVH_MAX_DEPTH + 1];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	uint32_t count = 0;
+	while (stackSize > 0)
+	{
+		uint32_t nodeIndex = stack[--stackSize];
+		const BVHNode& node = mNodes[nodeIndex];
+
+		BVHOverlap overlap = nodeTest(node);
+		if (overlap == BVH_OVERLAP_NONE)
+		{
+			continue;
+		}
+
+		// Every primitive inside a contained node passes, so skip testing them.
+		if (overlap == BVH_OVERLAP_CONTAINED && !stopAtFirst)
+		{
+			count += GatherSubtree(nodeIndex, indices);
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				if (primitiveTest(i))
+				{
+					if (stopAtFirst)
+					{
+						return 1;
+					}
+
+					indices.push_back(mIndices[i]);
+					count++;
+				}
+			}
+
+			continue;
+		}
+
+		stack[stackSize++] = node.offset;
+		stack[stackSize++] = nodeIndex + 1;
+	}
+
+	return count;
+}
+
+bool BVH::IntersectAny(const SphereCollider& sphere) const
+{
+	std::vector<uint32_t> unused;
+	return Gather([&](const BVHNode& node)
+	{
+		vec3f cp;
+		return IntersectSphereAABB(sphere, GetNodeBox(node), cp) ? BVH_OVERLAP_PARTIAL : BVH_OVERLAP_NONE;
+	},
+	[&](uint32_t primitive)
+	{
+		return IntersectPrimitiveSphere(primitive, sphere);
+	}, unused, true) > 0;
+}
+
+bool BVH::IntersectAny(const BoxCollider& aabb) const
+{
+	std::vector<uint32_t> unused;
+	return Gather([&](const BVHNode& node)
+	{
+		return IntersectAABBAABB(aabb, GetNodeBox(node)) ? BVH_OVERLAP_PARTIAL : BVH_OVERLAP_NONE;
+	},
+	[&](uint32_t primitive)
+	{
+		return IntersectPrimitiveAABB(primitive, aabb);
+	}, unused, true) > 0;
+}
+
+uint32_t BVH::Query(const SphereCollider& sphere, std::vector<uint32_t>& indices) const
+{
+	return Gather([&](const BVHNode& node)
+	{
+		vec3f cp;
+		return IntersectSphereAABB(sphere, GetNodeBox(node), cp) ? BVH_OVERLAP_PARTIAL : BVH_OVERLAP_NONE;
+	},
+	[&](uint32_t primitive)
+	{
+		return IntersectPrimitiveSphere(primitive, sphere);
+	}, indices, false);
+}
+
+uint32_t BVH::Query(const BoxCollider& aabb, std::vector<uint32_t>& indices) const
+{
+	return Gather([&](const BVHNode& node)
+	{
+		return IntersectAABBAABB(aabb, GetNodeBox(node)) ? BVH_OVERLAP_PARTIAL : BVH_OVERLAP_NONE;
+	},
+	[&](uint32_t primitive)
+	{
+		return IntersectPrimitiveAABB(primitive, aabb);
+	}, indices, false);
+}
+
+uint32_t BVH::Query(const Frustum& frustum, std::vector<uint32_t>& indices) const
+{
+	const Plane<vec3f>* planes[6] =
+	{
+		&frustum.front,
+		&frustum.back,
+		&frustum.left,
+		&frustum.right,
+		&frustum.bottom,
+		&frustum.top,
+	};
+
+	return Gather([&](const BVHNode& node)
+	{
+		return IntersectBoxFrustum(GetNodeBox(node), planes);
+	},
+	[&](uint32_t primitive)
+	{
+		return IntersectPrimitiveFrustum(primitive, planes);
+	}, indices, false);
+}
+
+uint32_t BVH::GatherSubtree(uint32_t nodeIndex, std::vector<uint32_t>& indices) const
+{
+	// Subtrees are contiguous in depth first order, and so are the primitives of their leaves.
+	uint32_t first = nodeIndex;
+	while (mNodes[first].count == 0)
+	{
+		first++;
+	}
+
+	uint32_t last = nodeIndex;
+	while (mNodes[last].count == 0)
+	{
+		last = mNodes[last].offset;
+	}
+
+	uint32_t begin = mNodes[first].offset;
+	uint32_t end = mNodes[last].offset + mNodes[last].count;
+	indices.insert(indices.end(), mIndices.begin() + begin, mIndices.begin() + end);
+
+	return end - begin;
+}
+
+bool BVH::IntersectPrimitiveRay(uint32_t primitive, const Ray<vec3f>& ray, float& t) const
+{
+	vec3f poi;
+	switch (mType)
+	{
+	case BVH_PRIMITIVE_AABB:
+		return IntersectRayAABB(ray, mBoxes[primitive], poi, t) != 0;
+	case BVH_PRIMITIVE_SPHERE:
+		return IntersectRaySphere(ray, mSpheres[primitive], poi, t) != 0;
+	default:
+		return IntersectRayTriangle(ray, mTriangles[primitive * 3], mTriangles[primitive * 3 + 1], mTriangles[primitive * 3 + 2], poi, t) != 0;
+	}
+}
+
+bool BVH::IntersectPrimitiveSphere(uint32_t primitive, const SphereCollider& sphere) const
+{
+	vec3f cp;
+	switch (mType)
+	{
+	case BVH_PRIMITIVE_AABB:
+		return IntersectSphereAABB(sphere, mBoxes[primitive], cp) != 0;
+	case BVH_PRIMITIVE_SPHERE:
+		return IntersectSphereSphere(sphere, mSpheres[primitive]) != 0;
+	default:
+		return IntersectSphereAABB(sphere, GetTriangleBox(&mTriangles[primitive * 3]), cp) != 0;
+	}
+}
+
+bool BVH::IntersectPrimitiveAABB(uint32_t primitive, const BoxCollider& aabb) const
+{
+	vec3f cp;
+	switch (mType)
+	{
+	case BVH_PRIMITIVE_AABB:
+		return IntersectAABBAABB(aabb, mBoxes[primitive]) != 0;
+	case BVH_PRIMITIVE_SPHERE:
+		return IntersectSphereAABB(mSpheres[primitive], aabb, cp) != 0;
+	default:
+		return IntersectAABBAABB(aabb, GetTriangleBox(&mTriangles[primitive * 3])) != 0;
+	}
+}
+
+bool BVH::IntersectPrimitiveFrustum(uint32_t primitive, const Plane<vec3f>* const* planes) const
+{
+	switch (mType)
+	{
+	case BVH_PRIMITIVE_AABB:
+		return IntersectBoxFrustum(mBoxes[primitive], planes) != BVH_OVERLAP_NONE;
+	case BVH_PRIMITIVE_SPHERE:
+	{
+		const SphereCollider& sphere = mSpheres[primitive];
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			float distance = cliqCity::graphicsMath::dot(planes[p]->normal, sphere.origin) - (planes[p]->distance - sphere.radius);
+			if (distance < 0)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+	default:
+		return IntersectBoxFrustum(GetTriangleBox(&mTriangles[primitive * 3]), planes) != BVH_OVERLAP_NONE;
+	}
+}
+
+bool BVH::Save(const char* filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	BVHFileHeader header;
+	header.magic = BVH_FILE_MAGIC;
+	header.version = BVH_FILE_VERSION;
+	header.type = mType;
+	header.nodeCount = static_cast<uint32_t>(mNodes.size());
+	header.primitiveCount = static_cast<uint32_t>(mIndices.size());
+	header.depth = mDepth;
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(mNodes.data()), sizeof(BVHNode) * mNodes.size());
+	file.write(reinterpret_cast<const char*>(mIndices.data()), sizeof(uint32_t) * mIndices.size());
+	file.write(reinterpret_cast<const char*>(mBoxes.data()), sizeof(BoxCollider) * mBoxes.size());
+	file.write(reinterpret_cast<const char*>(mSpheres.data()), sizeof(SphereCollider) * mSpheres.size());
+	file.write(reinterpret_cast<const char*>(mTriangles.data()), sizeof(vec3f) * mTriangles.size());
+
+	return file.good();
+}
+
+bool BVH::Load(const char* filename)
+{
+	Clear();
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	BVHFileHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != BVH_FILE_MAGIC || header.version != BVH_FILE_VERSION || header.type > BVH_PRIMITIVE_TRIANGLE ||
+		header.nodeCount > 2 * static_cast<uint64_t>(header.primitiveCount) || (header.nodeCount == 0) != (header.primitiveCount == 0))
+	{
+		return false;
+	}
+
+	// The header's counts must account for exactly the rest of the file, so a corrupt count cannot make us allocate more than
+	// was written. Sizes are computed in 64 bits since the counts alone can overflow 32.
+	uint64_t primitiveSize;
+	switch (header.type)
+	{
+	case BVH_PRIMITIVE_AABB:
+		primitiveSize = sizeof(BoxCollider);
+		break;
+	case BVH_PRIMITIVE_SPHERE:
+		primitiveSize = sizeof(SphereCollider);
+		break;
+	default:
+		primitiveSize = 3 * sizeof(vec3f);
+		break;
+	}
+
+	uint64_t payloadSize = header.nodeCount * static_cast<uint64_t>(sizeof(BVHNode)) + header.primitiveCount * (sizeof(uint32_t) + primitiveSize);
+	std::streamoff payloadStart = file.tellg();
+	file.seekg(0, std::ios::end);
+	std::streamoff fileEnd = file.tellg();
+	if (payloadStart < 0 || fileEnd < payloadStart || static_cast<uint64_t>(fileEnd - payloadStart) != payloadSize)
+	{
+		return false;
+	}
+
+	file.seekg(payloadStart);
+
+	mType = static_cast<BVHPrimitiveType>(header.type);
+	mNodes.resize(header.nodeCount);
+	mIndices.resize(header.primitiveCount);
+	file.read(reinterpret_cast<char*>(mNodes.data()), sizeof(BVHNode) * mNodes.size());
+	file.read(reinterpret_cast<char*>(mIndices.data()), sizeof(uint32_t) * mIndices.size());
+
+	switch (mType)
+	{
+	case BVH_PRIMITIVE_AABB:
+		mBoxes.resize(header.primitiveCount);
+		file.read(reinterpret_cast<char*>(mBoxes.data()), sizeof(BoxCollider) * mBoxes.size());
+		break;
+	case BVH_PRIMITIVE_SPHERE:
+		mSpheres.resize(header.primitiveCount);
+		file.read(reinterpret_cast<char*>(mSpheres.data()), sizeof(SphereCollider) * mSpheres.size());
+		break;
+	default:
+		mTriangles.resize(static_cast<size_t>(header.primitiveCount) * 3);
+		file.read(reinterpret_cast<char*>(mTriangles.data()), sizeof(vec3f) * mTriangles.size());
+		break;
+	}
+
+	// Reject anything traversal could run off the end of. Children always follow their parent, so there are no cycles.
+	bool isValid = !file.fail();
+	std::vector<uint32_t> depths(mNodes.size(), 0);
+	if (isValid && !mNodes.empty())
+	{
+		depths[0] = 1;
+	}
+
+	for (uint32_t i = 0; isValid && i < mNodes.size(); i++)
+	{
+		const BVHNode& node = mNodes[i];
+		if (node.count > 0)
+		{
+			isValid = static_cast<uint64_t>(node.offset) + node.count <= header.primitiveCount;
+		}
+		else
+		{
+			isValid = node.offset > i + 1 && node.offset < mNodes.size() && depths[i] < RIG_BVH_MAX_DEPTH;
+			if (isValid)
+			{
+				// Keep the deepest path to a shared child so a corrupt file cannot overflow the traversal stack.
+				depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+				depths[node.offset] = std::max(depths[node.offset], depths[i] + 1);
+			}
+		}
+
+		mDepth = (depths[i] > mDepth) ? depths[i] : mDepth;
+	}
+
+	if (!isValid)
+	{
+		Clear();
+	}
+
+	return isValid;
+}
+
+BVHPrimitiveType BVH::GetPrimitiveType() const
+{
+	return mType;
+}
+
+const BVHNode* BVH::GetNodes() const
+{
+	return mNodes.data();
+}
+
+uint32_t BVH::GetNodeCount() const
+{
+	return static_cast<uint32_t>(mNodes.size());
+}
+
+uint32_t BVH::GetPrimitiveCount() const
+{
+	return static_cast<uint32_t>(mIndices.size());
+}
+
+uint32_t BVH::GetDepth() const
+{
+	return mDepth;
+}
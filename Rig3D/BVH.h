@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <float.h>
+#include <vector>
+#include "Parametric.h"
+#include "Visibility.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+#define RIG_BVH_BIN_COUNT		16
+#define RIG_BVH_MAX_LEAF_SIZE	8
+#define RIG_BVH_MAX_DEPTH		64
+
+namespace cliqCity
+{
+	namespace multicore
+	{
+		class TaskDispatcher;
+	}
+}
+
+namespace Rig3D
+{
+	struct BVHBuildPrimitive;
+
+	enum BVHPrimitiveType
+	{
+		BVH_PRIMITIVE_AABB,
+		BVH_PRIMITIVE_SPHERE,
+		BVH_PRIMITIVE_TRIANGLE
+	};
+
+	// 32 bytes, two to a cache line. Nodes are stored depth first so an interior node's left child directly follows it.
+	struct BVHNode
+	{
+		float		min[3];
+		uint32_t	offset;		// Interior: index of the right child. Leaf: first primitive.
+		float		max[3];
+		uint32_t	count;		// Primitives in a leaf, zero for interior nodes.
+	};
+
+	struct BVHHit
+	{
+		uint32_t	index;		// Primitive index in the array the hierarchy was built from.
+		float		t;
+	};
+
+	// Static bounding volume hierarchy built with a binned surface area heuristic. The build runs in parallel when given a dispatcher
+	// and produces the same nodes regardless of thread count. Primitives are copied in, so the source arrays may be freed after Build.
+	// Sphere, box and frustum queries against triangles test the triangle bounds. Ray queries against triangles are exact.
+	class RIG3D BVH
+	{
+	public:
+		BVH();
+		~BVH();
+
+		void Build(const BoxCollider* boxes, uint32_t count, cliqCity::multicore::TaskDispatcher* dispatcher = nullptr);
+		void Build(const SphereCollider* spheres, uint32_t count, cliqCity::multicore::TaskDispatcher* dispatcher = nullptr);
+		void Build(const vec3f* positions, const uint32_t* indices, uint32_t triangleCount, cliqCity::multicore::TaskDispatcher* dispatcher = nullptr);
+		void Clear();
+
+		// Nearest hit no farther than tMax. As with IntersectRaySphere, t is negative for rays starting inside a sphere.
+		bool IntersectRay(const Ray<vec3f>& ray, BVHHit* hit, float tMax = FLT_MAX) const;
+
+		// Stops at the first hit no farther than tMax, in no particular order. Suited to shadow and visibility rays.
+		bool IntersectRayAny(const Ray<vec3f>& ray, float tMax = FLT_MAX) const;
+
+		bool IntersectAny(const SphereCollider& sphere) const;
+		bool IntersectAny(const BoxCollider& aabb) const;
+
+		// Append the index of every primitive touching the volume to indices and return how many were added.
+		uint32_t Query(const SphereCollider& sphere, std::vector<uint32_t>& indices) const;
+		uint32_t Query(const BoxCollider& aabb, std::vector<uint32_t>& indices) const;
+
+		// Same convention as Cull: a primitive is kept unless it lies entirely behind one of the planes.
+		uint32_t Query(const Frustum& frustum, std::vector<uint32_t>& indices) const;
+
+		// Binary snapshot of the nodes and primitives. Load returns false and leaves the hierarchy empty if the file is missing or invalid.
+		bool Save(const char* filename) const;
+		bool Load(const char* filename);
+
+		BVHPrimitiveType	GetPrimitiveType() const;
+		const BVHNode*		GetNodes() const;
+		uint32_t			GetNodeCount() const;
+		uint32_t			GetPrimitiveCount() const;
+		uint32_t			GetDepth() const;
+
+	private:
+		std::vector<BVHNode>		mNodes;
+		std::vector<uint32_t>		mIndices;		// Caller's index of each primitive, in leaf order.
+		std::vector<BoxCollider>	mBoxes;			// Primitives in leaf order. Only the array of mType is used.
+		std::vector<SphereCollider>	mSpheres;
+		std::vector<vec3f>			mTriangles;		// Three corners per triangle.
+		BVHPrimitiveType			mType;
+		uint32_t					mDepth;
+
+		void		BuildNodes(std::vector<BVHBuildPrimitive>& primitives, cliqCity::multicore::TaskDispatcher* dispatcher);
+		uint32_t	GatherSubtree(uint32_t nodeIndex, std::vector<uint32_t>& indices) const;
+		bool		IntersectPrimitiveRay(uint32_t primitive, const Ray<vec3f>& ray, float& t) const;
+		bool		IntersectPrimitiveSphere(uint32_t primitive, const SphereCollider& sphere) const;
+		bool		IntersectPrimitiveAABB(uint32_t primitive, const BoxCollider& aabb) const;
+		bool		IntersectPrimitiveFrustum(uint32_t primitive, const Plane<vec3f>* const* planes) const;
+
+		template<class NodeTest, class PrimitiveTest>
+		uint32_t Gather(const NodeTest& nodeTest, const PrimitiveTest& primitiveTest, std::vector<uint32_t>& indices, bool stopAtFirst) const;
+
+		BVH(BVH const&) = delete;
+		void operator=(BVH const&) = delete;
+	};
+}
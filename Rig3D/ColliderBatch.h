@@ -0,0 +1,484 @@
+#pragma once
+#include "Parametric.h"
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define RIG_SIMD_WIDTH 16
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define RIG_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RIG_SIMD_WIDTH 4
+#else
+#define RIG_SIMD_WIDTH 1
+#endif
+
+// Batches are padded to this many colliders so every SIMD width runs whole groups. Padding is NaN and never hits.
+#define RIG_COLLIDER_BATCH_PADDING 16
+
+namespace Rig3D
+{
+
+#pragma region Float Lanes
+
+	// Each lane type implements the same operations with the same IEEE semantics (min/max return the second operand unless the
+	// first compares less/greater, no fused multiply add), so every batch kernel gives bit identical results at every width.
+	// This relies on the compiler not contracting the scalar path into FMAs (the MSVC /fp:precise default, -ffp-contract=off on GCC/Clang).
+
+	struct FloatLanes1
+	{
+		typedef float	Float;
+		typedef bool	Mask;
+		static const uint32_t width = 1;
+
+		static Float	Load(const float* p)				{ return *p; }
+		static void		Store(float* p, Float a)			{ *p = a; }
+		static Float	Set(float a)						{ return a; }
+		static Float	Add(Float a, Float b)				{ return a + b; }
+		static Float	Sub(Float a, Float b)				{ return a - b; }
+		static Float	Mul(Float a, Float b)				{ return a * b; }
+		static Float	Div(Float a, Float b)				{ return a / b; }
+		static Float	Min(Float a, Float b)				{ return (a < b) ? a : b; }
+		static Float	Max(Float a, Float b)				{ return (a > b) ? a : b; }
+		static Float	Sqrt(Float a)						{ return sqrtf(a); }
+		static Float	Negate(Float a)						{ return -a; }
+		static Float	Abs(Float a)						{ return fabsf(a); }
+		static Float	Select(Mask m, Float a, Float b)	{ return m ? a : b; }
+		static Mask		Less(Float a, Float b)				{ return a < b; }
+		static Mask		LessEqual(Float a, Float b)			{ return a <= b; }
+		static Mask		GreaterEqual(Float a, Float b)		{ return a >= b; }
+		static Mask		Greater(Float a, Float b)			{ return a > b; }
+		static Mask		And(Mask a, Mask b)					{ return a && b; }
+		static Mask		Or(Mask a, Mask b)					{ return a || b; }
+		static Mask		AndNot(Mask a, Mask b)				{ return !a && b; }
+		static uint32_t	Bits(Mask m)						{ return m ? 1 : 0; }
+	};
+
+#if RIG_SIMD_WIDTH >= 4
+	struct FloatLanes4
+	{
+		typedef __m128	Float;
+		typedef __m128	Mask;
+		static const uint32_t width = 4;
+
+		static Float	Load(const float* p)				{ return _mm_loadu_ps(p); }
+		static void		Store(float* p, Float a)			{ _mm_storeu_ps(p, a); }
+		static Float	Set(float a)						{ return _mm_set1_ps(a); }
+		static Float	Add(Float a, Float b)				{ return _mm_add_ps(a, b); }
+		static Float	Sub(Float a, Float b)				{ return _mm_sub_ps(a, b); }
+		static Float	Mul(Float a, Float b)				{ return _mm_mul_ps(a, b); }
+		static Float	Div(Float a, Float b)				{ return _mm_div_ps(a, b); }
+		static Float	Min(Float a, Float b)				{ return _mm_min_ps(a, b); }
+		static Float	Max(Float a, Float b)				{ return _mm_max_ps(a, b); }
+		static Float	Sqrt(Float a)						{ return _mm_sqrt_ps(a); }
+		static Float	Negate(Float a)						{ return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+		static Float	Abs(Float a)						{ return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		static Float	Select(Mask m, Float a, Float b)	{ return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+		static Mask		Less(Float a, Float b)				{ return _mm_cmplt_ps(a, b); }
+		static Mask		LessEqual(Float a, Float b)			{ return _mm_cmple_ps(a, b); }
+		static Mask		GreaterEqual(Float a, Float b)		{ return _mm_cmpge_ps(a, b); }
+		static Mask		Greater(Float a, Float b)			{ return _mm_cmpgt_ps(a, b); }
+		static Mask		And(Mask a, Mask b)					{ return _mm_and_ps(a, b); }
+		static Mask		Or(Mask a, Mask b)					{ return _mm_or_ps(a, b); }
+		static Mask		AndNot(Mask a, Mask b)				{ return _mm_andnot_ps(a, b); }
+		static uint32_t	Bits(Mask m)						{ return static_cast<uint32_t>(_mm_movemask_ps(m)); }
+	};
+#endif
+
+#if RIG_SIMD_WIDTH >= 8
+	struct FloatLanes8
+	{
+		typedef __m256	Float;
+		typedef __m256	Mask;
+		static const uint32_t width = 8;
+
+		static Float	Load(const float* p)				{ return _mm256_loadu_ps(p); }
+		static void		Store(float* p, Float a)			{ _mm256_storeu_ps(p, a); }
+		static Float	Set(float a)						{ return _mm256_set1_ps(a); }
+		static Float	Add(Float a, Float b)				{ return _mm256_add_ps(a, b); }
+		static Float	Sub(Float a, Float b)				{ return _mm256_sub_ps(a, b); }
+		static Float	Mul(Float a, Float b)				{ return _mm256_mul_ps(a, b); }
+		static Float	Div(Float a, Float b)				{ return _mm256_div_ps(a, b); }
+		static Float	Min(Float a, Float b)				{ return _mm256_min_ps(a, b); }
+		static Float	Max(Float a, Float b)				{ return _mm256_max_ps(a, b); }
+		static Float	Sqrt(Float a)						{ return _mm256_sqrt_ps(a); }
+		static Float	Negate(Float a)						{ return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+		static Float	Abs(Float a)						{ return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static Float	Select(Mask m, Float a, Float b)	{ return _mm256_blendv_ps(b, a, m); }
+		static Mask		Less(Float a, Float b)				{ return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static Mask		LessEqual(Float a, Float b)			{ return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static Mask		GreaterEqual(Float a, Float b)		{ return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static Mask		Greater(Float a, Float b)			{ return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		static Mask		And(Mask a, Mask b)					{ return _mm256_and_ps(a, b); }
+		static Mask		Or(Mask a, Mask b)					{ return _mm256_or_ps(a, b); }
+		static Mask		AndNot(Mask a, Mask b)				{ return _mm256_andnot_ps(a, b); }
+		static uint32_t	Bits(Mask m)						{ return static_cast<uint32_t>(_mm256_movemask_ps(m)); }
+	};
+#endif
+
+#if RIG_SIMD_WIDTH >= 16
+	struct FloatLanes16
+	{
+		typedef __m512		Float;
+		typedef __mmask16	Mask;
+		static const uint32_t width = 16;
+
+		static Float	Load(const float* p)				{ return _mm512_loadu_ps(p); }
+		static void		Store(float* p, Float a)			{ _mm512_storeu_ps(p, a); }
+		static Float	Set(float a)						{ return _mm512_set1_ps(a); }
+		static Float	Add(Float a, Float b)				{ return _mm512_add_ps(a, b); }
+		static Float	Sub(Float a, Float b)				{ return _mm512_sub_ps(a, b); }
+		static Float	Mul(Float a, Float b)				{ return _mm512_mul_ps(a, b); }
+		static Float	Div(Float a, Float b)				{ return _mm512_div_ps(a, b); }
+		static Float	Min(Float a, Float b)				{ return _mm512_min_ps(a, b); }
+		static Float	Max(Float a, Float b)				{ return _mm512_max_ps(a, b); }
+		static Float	Sqrt(Float a)						{ return _mm512_sqrt_ps(a); }
+		static Float	Negate(Float a)						{ return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000))); }
+		static Float	Abs(Float a)						{ return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff))); }
+		static Float	Select(Mask m, Float a, Float b)	{ return _mm512_mask_blend_ps(m, b, a); }
+		static Mask		Less(Float a, Float b)				{ return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+		static Mask		LessEqual(Float a, Float b)			{ return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+		static Mask		GreaterEqual(Float a, Float b)		{ return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+		static Mask		Greater(Float a, Float b)			{ return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+		static Mask		And(Mask a, Mask b)					{ return static_cast<Mask>(a & b); }
+		static Mask		Or(Mask a, Mask b)					{ return static_cast<Mask>(a | b); }
+		static Mask		AndNot(Mask a, Mask b)				{ return static_cast<Mask>(~a & b); }
+		static uint32_t	Bits(Mask m)						{ return static_cast<uint32_t>(m); }
+	};
+#endif
+
+#if RIG_SIMD_WIDTH == 16
+	typedef FloatLanes16	NativeFloatLanes;
+#elif RIG_SIMD_WIDTH == 8
+	typedef FloatLanes8		NativeFloatLanes;
+#elif RIG_SIMD_WIDTH == 4
+	typedef FloatLanes4		NativeFloatLanes;
+#else
+	typedef FloatLanes1		NativeFloatLanes;
+#endif
+
+#pragma endregion
+
+#pragma region Collider Batches
+
+	// Structure of arrays sphere colliders. Arrays are padded to RIG_COLLIDER_BATCH_PADDING.
+	struct SphereColliderBatch
+	{
+		std::vector<float> x, y, z, radius;
+		uint32_t count;
+
+		SphereColliderBatch() : count(0) {};
+
+		uint32_t Add(const SphereCollider& sphere)
+		{
+			if (count == x.size())
+			{
+				float padding = std::numeric_limits<float>::quiet_NaN();
+				size_t size = x.size() + RIG_COLLIDER_BATCH_PADDING;
+				x.resize(size, padding);
+				y.resize(size, padding);
+				z.resize(size, padding);
+				radius.resize(size, padding);
+			}
+
+			Set(count, sphere);
+			return count++;
+		}
+
+		void Set(uint32_t index, const SphereCollider& sphere)
+		{
+			x[index] = sphere.origin.x;
+			y[index] = sphere.origin.y;
+			z[index] = sphere.origin.z;
+			radius[index] = sphere.radius;
+		}
+
+		void Clear()
+		{
+			x.clear();
+			y.clear();
+			z.clear();
+			radius.clear();
+			count = 0;
+		}
+
+		uint32_t GetPaddedCount() const
+		{
+			return static_cast<uint32_t>(x.size());
+		}
+	};
+
+	// Structure of arrays box colliders stored as min and max corners. Arrays are padded to RIG_COLLIDER_BATCH_PADDING.
+	struct AABBColliderBatch
+	{
+		std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+		uint32_t count;
+
+		AABBColliderBatch() : count(0) {};
+
+		uint32_t Add(const BoxCollider& aabb)
+		{
+			if (count == minX.size())
+			{
+				float padding = std::numeric_limits<float>::quiet_NaN();
+				size_t size = minX.size() + RIG_COLLIDER_BATCH_PADDING;
+				minX.resize(size, padding);
+				minY.resize(size, padding);
+				minZ.resize(size, padding);
+				maxX.resize(size, padding);
+				maxY.resize(size, padding);
+				maxZ.resize(size, padding);
+			}
+
+			Set(count, aabb);
+			return count++;
+		}
+
+		void Set(uint32_t index, const BoxCollider& aabb)
+		{
+			minX[index] = aabb.origin.x - aabb.halfSize.x;
+			minY[index] = aabb.origin.y - aabb.halfSize.y;
+			minZ[index] = aabb.origin.z - aabb.halfSize.z;
+			maxX[index] = aabb.origin.x + aabb.halfSize.x;
+			maxY[index] = aabb.origin.y + aabb.halfSize.y;
+			maxZ[index] = aabb.origin.z + aabb.halfSize.z;
+		}
+
+		void Clear()
+		{
+			minX.clear();
+			minY.clear();
+			minZ.clear();
+			maxX.clear();
+			maxY.clear();
+			maxZ.clear();
+			count = 0;
+		}
+
+		uint32_t GetPaddedCount() const
+		{
+			return static_cast<uint32_t>(minX.size());
+		}
+	};
+
+#pragma endregion
+
+#pragma region Batch Tests
+
+	// Each test sets bit (i % 32) of hitMasks[i / 32] when the query hits collider i and returns the number of hits.
+	// hitMasks must hold (count + 31) / 32 words. Pass FloatLanes1 as Lanes for the scalar path.
+
+	inline uint32_t CountHitBits(uint32_t bits)
+	{
+		bits = bits - ((bits >> 1) & 0x55555555);
+		bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+		return (((bits + (bits >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+	}
+
+	inline uint32_t CountHits(const uint32_t* hitMasks, uint32_t count)
+	{
+		uint32_t hitCount = 0;
+		for (uint32_t i = 0; i < (count + 31) / 32; i++)
+		{
+			hitCount += CountHitBits(hitMasks[i]);
+		}
+
+		return hitCount;
+	}
+
+	template<class Lanes = NativeFloatLanes>
+	uint32_t IntersectSphereSphereBatch(const SphereCollider& sphere, const SphereColliderBatch& batch, uint32_t* hitMasks)
+	{
+		typedef typename Lanes::Float Float;
+
+		memset(hitMasks, 0, sizeof(uint32_t) * ((batch.count + 31) / 32));
+
+		Float x = Lanes::Set(sphere.origin.x);
+		Float y = Lanes::Set(sphere.origin.y);
+		Float z = Lanes::Set(sphere.origin.z);
+		Float r = Lanes::Set(sphere.radius);
+
+		for (uint32_t i = 0; i < batch.count; i += Lanes::width)
+		{
+			Float dx = Lanes::Sub(x, Lanes::Load(&batch.x[i]));
+			Float dy = Lanes::Sub(y, Lanes::Load(&batch.y[i]));
+			Float dz = Lanes::Sub(z, Lanes::Load(&batch.z[i]));
+			Float distanceSquared = Lanes::Add(Lanes::Add(Lanes::Mul(dx, dx), Lanes::Mul(dy, dy)), Lanes::Mul(dz, dz));
+			Float sumRadii = Lanes::Add(r, Lanes::Load(&batch.radius[i]));
+
+			hitMasks[i / 32] |= Lanes::Bits(Lanes::LessEqual(distanceSquared, Lanes::Mul(sumRadii, sumRadii))) << (i % 32);
+		}
+
+		return CountHits(hitMasks, batch.count);
+	}
+
+	template<class Lanes = NativeFloatLanes>
+	uint32_t IntersectAABBAABBBatch(const BoxCollider& aabb, const AABBColliderBatch& batch, uint32_t* hitMasks)
+	{
+		typedef typename Lanes::Float Float;
+		typedef typename Lanes::Mask Mask;
+
+		memset(hitMasks, 0, sizeof(uint32_t) * ((batch.count + 31) / 32));
+
+		Float minX = Lanes::Set(aabb.origin.x - aabb.halfSize.x);
+		Float minY = Lanes::Set(aabb.origin.y - aabb.halfSize.y);
+		Float minZ = Lanes::Set(aabb.origin.z - aabb.halfSize.z);
+		Float maxX = Lanes::Set(aabb.origin.x + aabb.halfSize.x);
+		Float maxY = Lanes::Set(aabb.origin.y + aabb.halfSize.y);
+		Float maxZ = Lanes::Set(aabb.origin.z + aabb.halfSize.z);
+
+		for (uint32_t i = 0; i < batch.count; i += Lanes::width)
+		{
+			// Written as overlap rather than separation so NaN padding misses.
+			Mask x = Lanes::And(Lanes::GreaterEqual(maxX, Lanes::Load(&batch.minX[i])), Lanes::LessEqual(minX, Lanes::Load(&batch.maxX[i])));
+			Mask y = Lanes::And(Lanes::GreaterEqual(maxY, Lanes::Load(&batch.minY[i])), Lanes::LessEqual(minY, Lanes::Load(&batch.maxY[i])));
+			Mask z = Lanes::And(Lanes::GreaterEqual(maxZ, Lanes::Load(&batch.minZ[i])), Lanes::LessEqual(minZ, Lanes::Load(&batch.maxZ[i])));
+
+			hitMasks[i / 32] |= Lanes::Bits(Lanes::And(Lanes::And(x, y), z)) << (i % 32);
+		}
+
+		return CountHits(hitMasks, batch.count);
+	}
+
+	template<class Lanes = NativeFloatLanes>
+	uint32_t IntersectSphereAABBBatch(const SphereCollider& sphere, const AABBColliderBatch& batch, uint32_t* hitMasks)
+	{
+		typedef typename Lanes::Float Float;
+
+		memset(hitMasks, 0, sizeof(uint32_t) * ((batch.count + 31) / 32));
+
+		Float x = Lanes::Set(sphere.origin.x);
+		Float y = Lanes::Set(sphere.origin.y);
+		Float z = Lanes::Set(sphere.origin.z);
+		Float radiusSquared = Lanes::Set(sphere.radius * sphere.radius);
+
+		for (uint32_t i = 0; i < batch.count; i += Lanes::width)
+		{
+			// Closest point on the box to the sphere center.
+			Float cx = Lanes::Min(Lanes::Max(x, Lanes::Load(&batch.minX[i])), Lanes::Load(&batch.maxX[i]));
+			Float cy = Lanes::Min(Lanes::Max(y, Lanes::Load(&batch.minY[i])), Lanes::Load(&batch.maxY[i]));
+			Float cz = Lanes::Min(Lanes::Max(z, Lanes::Load(&batch.minZ[i])), Lanes::Load(&batch.maxZ[i]));
+
+			Float dx = Lanes::Sub(cx, x);
+			Float dy = Lanes::Sub(cy, y);
+			Float dz = Lanes::Sub(cz, z);
+			Float distanceSquared = Lanes::Add(Lanes::Add(Lanes::Mul(dx, dx), Lanes::Mul(dy, dy)), Lanes::Mul(dz, dz));
+
+			hitMasks[i / 32] |= Lanes::Bits(Lanes::LessEqual(distanceSquared, radiusSquared)) << (i % 32);
+		}
+
+		return CountHits(hitMasks, batch.count);
+	}
+
+	// t receives the entry distance of every hit and must hold batch.GetPaddedCount() floats, or be null.
+	template<class Lanes = NativeFloatLanes>
+	uint32_t IntersectRayAABBBatch(const Ray<vec3f>& ray, const AABBColliderBatch& batch, uint32_t* hitMasks, float* t)
+	{
+		typedef typename Lanes::Float Float;
+		typedef typename Lanes::Mask Mask;
+
+		memset(hitMasks, 0, sizeof(uint32_t) * ((batch.count + 31) / 32));
+
+		// The ray is shared by every lane so the parallel slab cases are decided once.
+		bool isParallel[3];
+		Float origin[3];
+		Float ood[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			isParallel[axis] = fabsf(ray.normal[axis]) < FLT_EPSILON;
+			origin[axis] = Lanes::Set(ray.origin[axis]);
+			ood[axis] = Lanes::Set(isParallel[axis] ? 0.0f : 1.0f / ray.normal[axis]);
+		}
+
+		const std::vector<float>* mins[3] = { &batch.minX, &batch.minY, &batch.minZ };
+		const std::vector<float>* maxs[3] = { &batch.maxX, &batch.maxY, &batch.maxZ };
+
+		for (uint32_t i = 0; i < batch.count; i += Lanes::width)
+		{
+			Float tMin = Lanes::Set(0.0f);
+			Float tMax = Lanes::Set(FLT_MAX);
+			Mask hit = Lanes::LessEqual(tMin, tMax);
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				Float aabbMin = Lanes::Load(&(*mins[axis])[i]);
+				Float aabbMax = Lanes::Load(&(*maxs[axis])[i]);
+
+				if (isParallel[axis])
+				{
+					// Parallel to the slab. The origin must lie between its planes.
+					hit = Lanes::And(hit, Lanes::And(Lanes::GreaterEqual(origin[axis], aabbMin), Lanes::LessEqual(origin[axis], aabbMax)));
+				}
+				else
+				{
+					Float t1 = Lanes::Mul(Lanes::Sub(aabbMin, origin[axis]), ood[axis]);
+					Float t2 = Lanes::Mul(Lanes::Sub(aabbMax, origin[axis]), ood[axis]);
+					tMin = Lanes::Max(tMin, Lanes::Min(t1, t2));
+					tMax = Lanes::Min(tMax, Lanes::Max(t1, t2));
+				}
+			}
+
+			hit = Lanes::And(hit, Lanes::LessEqual(tMin, tMax));
+			hitMasks[i / 32] |= Lanes::Bits(hit) << (i % 32);
+
+			if (t)
+			{
+				Lanes::Store(&t[i], tMin);
+			}
+		}
+
+		return CountHits(hitMasks, batch.count);
+	}
+
+	// t receives the entry distance of every hit and must hold batch.GetPaddedCount() floats, or be null.
+	// As with IntersectRaySphere, t is negative for rays starting inside a sphere.
+	template<class Lanes = NativeFloatLanes>
+	uint32_t IntersectRaySphereBatch(const Ray<vec3f>& ray, const SphereColliderBatch& batch, uint32_t* hitMasks, float* t)
+	{
+		typedef typename Lanes::Float Float;
+		typedef typename Lanes::Mask Mask;
+
+		memset(hitMasks, 0, sizeof(uint32_t) * ((batch.count + 31) / 32));
+
+		Float ox = Lanes::Set(ray.origin.x);
+		Float oy = Lanes::Set(ray.origin.y);
+		Float oz = Lanes::Set(ray.origin.z);
+		Float nx = Lanes::Set(ray.normal.x);
+		Float ny = Lanes::Set(ray.normal.y);
+		Float nz = Lanes::Set(ray.normal.z);
+		Float zero = Lanes::Set(0.0f);
+
+		for (uint32_t i = 0; i < batch.count; i += Lanes::width)
+		{
+			Float mx = Lanes::Sub(ox, Lanes::Load(&batch.x[i]));
+			Float my = Lanes::Sub(oy, Lanes::Load(&batch.y[i]));
+			Float mz = Lanes::Sub(oz, Lanes::Load(&batch.z[i]));
+			Float r = Lanes::Load(&batch.radius[i]);
+
+			Float b = Lanes::Add(Lanes::Add(Lanes::Mul(mx, nx), Lanes::Mul(my, ny)), Lanes::Mul(mz, nz));
+			Float c = Lanes::Sub(Lanes::Add(Lanes::Add(Lanes::Mul(mx, mx), Lanes::Mul(my, my)), Lanes::Mul(mz, mz)), Lanes::Mul(r, r));
+			Float discriminant = Lanes::Sub(Lanes::Mul(b, b), c);
+
+			// Miss when the origin is outside and pointing away, or the discriminant is negative.
+			Mask away = Lanes::And(Lanes::Greater(c, zero), Lanes::Greater(b, zero));
+			Mask hit = Lanes::AndNot(away, Lanes::GreaterEqual(discriminant, zero));
+			hitMasks[i / 32] |= Lanes::Bits(hit) << (i % 32);
+
+			if (t)
+			{
+				Lanes::Store(&t[i], Lanes::Sub(Lanes::Negate(b), Lanes::Sqrt(Lanes::Max(discriminant, zero))));
+			}
+		}
+
+		return CountHits(hitMasks, batch.count);
+	}
+
+#pragma endregion
+}
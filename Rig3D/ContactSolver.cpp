@@ -0,0 +1,339 @@
+#include "ContactSolver.h"
+#include "RigidBodySystem.h"
+#include <math.h>
+#include <algorithm>
+
+#define RIG_CONTACT_STATIC_KEY_BIT	0x80000000u
+
+using namespace Rig3D;
+
+namespace
+{
+	inline vec3f MultiplyDiagonal(const vec3f& diagonal, const vec3f& v)
+	{
+		vec3f r = { diagonal.x * v.x, diagonal.y * v.y, diagonal.z * v.z };
+		return r;
+	}
+
+	// Tangents depend only on the normal, so a contact whose normal barely moves keeps its cached friction impulses meaningful.
+	inline void TangentBasis(const vec3f& normal, vec3f& tangent0, vec3f& tangent1)
+	{
+		if (fabsf(normal.x) >= 0.57735f)
+		{
+			vec3f t = { normal.y, -normal.x, 0.0f };
+			tangent0 = t / sqrtf(normal.x * normal.x + normal.y * normal.y);
+		}
+		else
+		{
+			vec3f t = { 0.0f, normal.z, -normal.y };
+			tangent0 = t / sqrtf(normal.y * normal.y + normal.z * normal.z);
+		}
+
+		tangent1 = cliqCity::graphicsMath::cross(normal, tangent0);
+	}
+}
+
+ContactSolver::ContactSolver(uint32_t iterations) :
+	mIterations(iterations),
+	mRestitutionThreshold(0.0f),
+	mContactCount(0),
+	mWarmStartedCount(0),
+	mIsWarmStarting(true)
+{
+
+}
+
+ContactSolver::~ContactSolver()
+{
+
+}
+
+void ContactSolver::AddContact(uint32_t bodyA, uint32_t bodyB, const vec3f& point, const vec3f& normal, float separation, float friction, float restitution)
+{
+	uint64_t key = (static_cast<uint64_t>(bodyA) << 32) | bodyB;
+	PushContact(key, bodyA, bodyB, point, normal, separation, friction, restitution);
+}
+
+void ContactSolver::AddStaticContact(uint32_t body, uint32_t staticID, const vec3f& point, const vec3f& normal, float separation, float friction, float restitution)
+{
+	uint64_t key = (static_cast<uint64_t>(body) << 32) | (staticID | RIG_CONTACT_STATIC_KEY_BIT);
+	PushContact(key, RIG_CONTACT_STATIC_BODY, body, point, normal, separation, friction, restitution);
+}
+
+void ContactSolver::PushContact(uint64_t key, uint32_t bodyA, uint32_t bodyB, const vec3f& point, const vec3f& normal, float separation, float friction, float restitution)
+{
+	Contact c;
+	c.key				= key;
+	c.bodyA				= bodyA;
+	c.bodyB				= bodyB;
+	c.point				= point;
+	c.normal			= normal;
+	c.separation		= separation;
+	c.friction			= friction;
+	c.restitution		= restitution;
+	c.normalImpulse		= 0.0f;
+	c.tangentImpulse0	= 0.0f;
+	c.tangentImpulse1	= 0.0f;
+	c.maxNormalImpulse	= 0.0f;
+	mContacts.push_back(c);
+}
+
+void ContactSolver::Solve(RigidBodySystem& bodies, float dt)
+{
+	mContactCount = static_cast<uint32_t>(mContacts.size());
+	mWarmStartedCount = 0;
+
+	if (mContacts.empty() || dt <= 0.0f)
+	{
+		mContacts.clear();
+		mCache.clear();
+		return;
+	}
+
+	uint32_t count = bodies.GetCount();
+	mVelocities.resize(count);
+	mAngularVelocities.resize(count);
+	mInverseInertias.resize(count);
+	mInverseMasses.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		mVelocities[i]			= bodies.GetVelocity(i);
+		mAngularVelocities[i]	= bodies.GetAngularVelocity(i);
+		mInverseInertias[i]		= bodies.GetInverseInertia(i);
+		mInverseMasses[i]		= bodies.GetInverseMass(i);
+	}
+
+	// Key order makes the solve independent of detection order and lets the cache be matched in one pass.
+	std::sort(mContacts.begin(), mContacts.end(), [](const Contact& lhs, const Contact& rhs)
+	{
+		return lhs.key < rhs.key;
+	});
+
+	Prepare(bodies, dt);
+
+	if (mIsWarmStarting)
+	{
+		WarmStart();
+	}
+
+	for (uint32_t i = 0; i < mIterations; i++)
+	{
+		SolveVelocities();
+	}
+
+	ApplyRestitution();
+	StoreImpulses();
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		bodies.SetVelocity(i, mVelocities[i]);
+		bodies.SetAngularVelocity(i, mAngularVelocities[i]);
+	}
+
+	mContacts.clear();
+}
+
+void ContactSolver::Prepare(const RigidBodySystem& bodies, float dt)
+{
+	float inverseDt = 1.0f / dt;
+	vec3f zero = { 0.0f, 0.0f, 0.0f };
+	auto cached = mCache.begin();
+
+	for (Contact& c : mContacts)
+	{
+		bool isStatic = (c.bodyA == RIG_CONTACT_STATIC_BODY);
+		float inverseMassA = isStatic ? 0.0f : mInverseMasses[c.bodyA];
+		float inverseMassB = mInverseMasses[c.bodyB];
+		vec3f inverseInertiaA = isStatic ? zero : mInverseInertias[c.bodyA];
+		vec3f inverseInertiaB = mInverseInertias[c.bodyB];
+
+		c.rA = isStatic ? zero : c.point - bodies.GetPosition(c.bodyA);
+		c.rB = c.point - bodies.GetPosition(c.bodyB);
+		TangentBasis(c.normal, c.tangent0, c.tangent1);
+
+		// Effective mass along a direction d is 1 / (1/mA + 1/mB + (rA x d) IA^-1 (rA x d) + (rB x d) IB^-1 (rB x d)).
+		vec3f directions[3] = { c.normal, c.tangent0, c.tangent1 };
+		float masses[3];
+		for (int d = 0; d < 3; d++)
+		{
+			vec3f rnA = cliqCity::graphicsMath::cross(c.rA, directions[d]);
+			vec3f rnB = cliqCity::graphicsMath::cross(c.rB, directions[d]);
+			float k = inverseMassA + inverseMassB + cliqCity::graphicsMath::dot(rnA, MultiplyDiagonal(inverseInertiaA, rnA)) + cliqCity::graphicsMath::dot(rnB, MultiplyDiagonal(inverseInertiaB, rnB));
+			masses[d] = (k > 0.0f) ? 1.0f / k : 0.0f;
+		}
+
+		c.normalMass	= masses[0];
+		c.tangentMass0	= masses[1];
+		c.tangentMass1	= masses[2];
+
+		// A gap lets the bodies close by that much this step. Penetration past the slop is pushed out over a few steps.
+		if (c.separation > 0.0f)
+		{
+			c.bias = c.separation * inverseDt;
+		}
+		else
+		{
+			c.bias = RIG_CONTACT_BAUMGARTE * inverseDt * std::min(c.separation + RIG_CONTACT_LINEAR_SLOP, 0.0f);
+		}
+
+		c.closingSpeed = cliqCity::graphicsMath::dot(GetRelativeVelocity(c), c.normal);
+
+		if (!mIsWarmStarting)
+		{
+			continue;
+		}
+
+		while (cached != mCache.end() && cached->key < c.key)
+		{
+			cached++;
+		}
+
+		if (cached != mCache.end() && cached->key == c.key)
+		{
+			c.normalImpulse		= cached->normalImpulse;
+			c.tangentImpulse0	= cached->tangentImpulse0;
+			c.tangentImpulse1	= cached->tangentImpulse1;
+			mWarmStartedCount++;
+		}
+	}
+}
+
+void ContactSolver::WarmStart()
+{
+	for (const Contact& c : mContacts)
+	{
+		ApplyImpulse(c, c.normal * c.normalImpulse + c.tangent0 * c.tangentImpulse0 + c.tangent1 * c.tangentImpulse1);
+	}
+}
+
+void ContactSolver::SolveVelocities()
+{
+	for (Contact& c : mContacts)
+	{
+		// Friction first, limited by the normal impulse of the last iteration.
+		vec3f relativeVelocity = GetRelativeVelocity(c);
+		float oldTangent0 = c.tangentImpulse0;
+		float oldTangent1 = c.tangentImpulse1;
+		float tangent0 = oldTangent0 - c.tangentMass0 * cliqCity::graphicsMath::dot(relativeVelocity, c.tangent0);
+		float tangent1 = oldTangent1 - c.tangentMass1 * cliqCity::graphicsMath::dot(relativeVelocity, c.tangent1);
+
+		float maxFriction = c.friction * c.normalImpulse;
+		float tangentSquared = tangent0 * tangent0 + tangent1 * tangent1;
+		if (tangentSquared > maxFriction * maxFriction)
+		{
+			float scale = maxFriction / sqrtf(tangentSquared);
+			tangent0 *= scale;
+			tangent1 *= scale;
+		}
+
+		c.tangentImpulse0 = tangent0;
+		c.tangentImpulse1 = tangent1;
+		ApplyImpulse(c, c.tangent0 * (tangent0 - oldTangent0) + c.tangent1 * (tangent1 - oldTangent1));
+
+		// Non penetration. The accumulated impulse may shrink but never pulls the bodies together.
+		float normalSpeed = cliqCity::graphicsMath::dot(GetRelativeVelocity(c), c.normal);
+		float oldNormal = c.normalImpulse;
+		c.normalImpulse = std::max(oldNormal - c.normalMass * (normalSpeed + c.bias), 0.0f);
+		c.maxNormalImpulse = std::max(c.maxNormalImpulse, c.normalImpulse);
+		ApplyImpulse(c, c.normal * (c.normalImpulse - oldNormal));
+	}
+}
+
+void ContactSolver::ApplyRestitution()
+{
+	// Only contacts that were closing fast enough and actually pushed bounce, so speculative contacts that never touched do not.
+	for (Contact& c : mContacts)
+	{
+		if (c.restitution == 0.0f || c.closingSpeed > -mRestitutionThreshold || c.maxNormalImpulse == 0.0f)
+		{
+			continue;
+		}
+
+		float normalSpeed = cliqCity::graphicsMath::dot(GetRelativeVelocity(c), c.normal);
+		float oldNormal = c.normalImpulse;
+		c.normalImpulse = std::max(oldNormal - c.normalMass * (normalSpeed + c.restitution * c.closingSpeed), 0.0f);
+		ApplyImpulse(c, c.normal * (c.normalImpulse - oldNormal));
+	}
+}
+
+void ContactSolver::StoreImpulses()
+{
+	// Contacts are sorted by key, so the new cache is too. Pairs that were not found this step are dropped.
+	mCache.resize(mContacts.size());
+	for (size_t i = 0; i < mContacts.size(); i++)
+	{
+		mCache[i].key				= mContacts[i].key;
+		mCache[i].normalImpulse		= mContacts[i].normalImpulse;
+		mCache[i].tangentImpulse0	= mContacts[i].tangentImpulse0;
+		mCache[i].tangentImpulse1	= mContacts[i].tangentImpulse1;
+	}
+}
+
+inline void ContactSolver::ApplyImpulse(const Contact& c, const vec3f& impulse)
+{
+	if (c.bodyA != RIG_CONTACT_STATIC_BODY)
+	{
+		mVelocities[c.bodyA]		-= impulse * mInverseMasses[c.bodyA];
+		mAngularVelocities[c.bodyA]	-= MultiplyDiagonal(mInverseInertias[c.bodyA], cliqCity::graphicsMath::cross(c.rA, impulse));
+	}
+
+	mVelocities[c.bodyB]		+= impulse * mInverseMasses[c.bodyB];
+	mAngularVelocities[c.bodyB]	+= MultiplyDiagonal(mInverseInertias[c.bodyB], cliqCity::graphicsMath::cross(c.rB, impulse));
+}
+
+inline vec3f ContactSolver::GetRelativeVelocity(const Contact& c) const
+{
+	vec3f velocity = mVelocities[c.bodyB] + cliqCity::graphicsMath::cross(mAngularVelocities[c.bodyB], c.rB);
+	if (c.bodyA != RIG_CONTACT_STATIC_BODY)
+	{
+		velocity -= mVelocities[c.bodyA] + cliqCity::graphicsMath::cross(mAngularVelocities[c.bodyA], c.rA);
+	}
+
+	return velocity;
+}
+
+void ContactSolver::SetIterations(uint32_t iterations)
+{
+	mIterations = iterations;
+}
+
+uint32_t ContactSolver::GetIterations() const
+{
+	return mIterations;
+}
+
+void ContactSolver::SetWarmStarting(bool isWarmStarting)
+{
+	mIsWarmStarting = isWarmStarting;
+}
+
+bool ContactSolver::IsWarmStarting() const
+{
+	return mIsWarmStarting;
+}
+
+void ContactSolver::SetRestitutionThreshold(float speed)
+{
+	mRestitutionThreshold = speed;
+}
+
+float ContactSolver::GetRestitutionThreshold() const
+{
+	return mRestitutionThreshold;
+}
+
+uint32_t ContactSolver::GetContactCount() const
+{
+	return mContactCount;
+}
+
+uint32_t ContactSolver::GetWarmStartedCount() const
+{
+	return mWarmStartedCount;
+}
+
+void ContactSolver::Clear()
+{
+	mContacts.clear();
+	mCache.clear();
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Parametric.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+#define RIG_CONTACT_SOLVER_ITERATIONS			8
+#define RIG_CONTACT_STATIC_BODY					0xffffffff
+#define RIG_CONTACT_BAUMGARTE					0.2f
+#define RIG_CONTACT_LINEAR_SLOP					0.0005f		// Penetration left alone so resting contacts do not jitter.
+
+namespace Rig3D
+{
+	class RigidBodySystem;
+
+	// Sequential impulse solver for point contacts between bodies of a RigidBodySystem. Each contact is a non penetration
+	// constraint with a friction constraint inside a cone of its normal impulse. Restitution is applied after the
+	// iterations from the closing speed at the start of the step. Accumulated impulses are cached by contact key and
+	// warm start the next step, so resting clusters settle over several steps instead of needing many iterations in one.
+	// Contacts closer than a body's travel in one step may be added with positive separation. They only stop the
+	// bodies from closing farther than the gap, which keeps fast bodies from tunneling without continuous collision.
+	class RIG3D ContactSolver
+	{
+	public:
+		ContactSolver(uint32_t iterations = RIG_CONTACT_SOLVER_ITERATIONS);
+		~ContactSolver();
+
+		// Normal points from bodyA to bodyB. Separation is negative when the bodies overlap. Keep the order of a pair the same
+		// between steps so its cached impulses are found.
+		void		AddContact(uint32_t bodyA, uint32_t bodyB, const vec3f& point, const vec3f& normal, float separation, float friction, float restitution);
+
+		// Contact with immovable geometry. Normal points from the geometry to the body. staticID tells apart contacts
+		// of the same body with different geometry in the cache.
+		void		AddStaticContact(uint32_t body, uint32_t staticID, const vec3f& point, const vec3f& normal, float separation, float friction, float restitution);
+
+		// Solves the contacts added since the last call and changes the bodies' velocities, not their positions. Call between
+		// RigidBodySystem::IntegrateVelocities and IntegratePositions with the same dt.
+		void		Solve(RigidBodySystem& bodies, float dt);
+
+		void		SetIterations(uint32_t iterations);
+		uint32_t	GetIterations() const;
+
+		void		SetWarmStarting(bool isWarmStarting);
+		bool		IsWarmStarting() const;
+
+		// Contacts closing slower than this do not bounce, so resting bodies do not jitter. In the bodies' velocity units.
+		void		SetRestitutionThreshold(float speed);
+		float		GetRestitutionThreshold() const;
+
+		// Contacts solved by the last call to Solve, and how many of them were found in the cache.
+		uint32_t	GetContactCount() const;
+		uint32_t	GetWarmStartedCount() const;
+
+		// Forgets the cached impulses, for example after bodies are teleported.
+		void		Clear();
+
+	private:
+		struct Contact
+		{
+			uint64_t	key;
+			uint32_t	bodyA;				// RIG_CONTACT_STATIC_BODY for static contacts.
+			uint32_t	bodyB;
+			vec3f		point;
+			vec3f		rA;					// Contact point relative to each body.
+			vec3f		rB;
+			vec3f		normal;
+			vec3f		tangent0;
+			vec3f		tangent1;
+			float		separation;
+			float		friction;
+			float		restitution;
+			float		normalMass;
+			float		tangentMass0;
+			float		tangentMass1;
+			float		bias;
+			float		closingSpeed;		// Relative normal speed before the iterations.
+			float		normalImpulse;		// Accumulated over the step.
+			float		tangentImpulse0;
+			float		tangentImpulse1;
+			float		maxNormalImpulse;	// Largest accumulated normal impulse during the iterations.
+		};
+
+		struct CachedImpulse
+		{
+			uint64_t	key;
+			float		normalImpulse;
+			float		tangentImpulse0;
+			float		tangentImpulse1;
+		};
+
+		std::vector<Contact>		mContacts;
+		std::vector<CachedImpulse>	mCache;				// Sorted by key.
+		std::vector<vec3f>			mVelocities;		// Body state gathered for the solve.
+		std::vector<vec3f>			mAngularVelocities;
+		std::vector<vec3f>			mInverseInertias;
+		std::vector<float>			mInverseMasses;
+		uint32_t					mIterations;
+		float						mRestitutionThreshold;
+		uint32_t					mContactCount;
+		uint32_t					mWarmStartedCount;
+		bool						mIsWarmStarting;
+
+		void		PushContact(uint64_t key, uint32_t bodyA, uint32_t bodyB, const vec3f& point, const vec3f& normal, float separation, float friction, float restitution);
+		void		Prepare(const RigidBodySystem& bodies, float dt);
+		void		WarmStart();
+		void		SolveVelocities();
+		void		ApplyRestitution();
+		void		StoreImpulses();
+
+		inline void ApplyImpulse(const Contact& c, const vec3f& impulse);
+		inline vec3f GetRelativeVelocity(const Contact& c) const;
+
+		ContactSolver(ContactSolver const&) = delete;
+		void operator=(ContactSolver const&) = delete;
+	};
+}
@@ -0,0 +1,600 @@
+#include "DynamicAABBTree.h"
+#include <algorithm>
+#include <float.h>
+
+using namespace Rig3D;
+
+namespace
+{
+	inline float GetHalfArea(const float* min, const float* max)
+	{
+		float x = max[0] - min[0];
+		float y = max[1] - min[1];
+		float z = max[2] - min[2];
+		return x * y + y * z + z * x;
+	}
+
+	// Half surface area of the box enclosing both.
+	inline float GetCombinedHalfArea(const float* minA, const float* maxA, const float* minB, const float* maxB)
+	{
+		float min[3];
+		float max[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			min[axis] = std::min(minA[axis], minB[axis]);
+			max[axis] = std::max(maxA[axis], maxB[axis]);
+		}
+
+		return GetHalfArea(min, max);
+	}
+
+	inline bool Overlaps(const float* minA, const float* maxA, const float* minB, const float* maxB)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (maxA[axis] < minB[axis] || minA[axis] > maxB[axis])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	inline void Push(uint32_t (*stack)[2], uint32_t& count, uint32_t indexA, uint32_t indexB)
+	{
+		stack[count][0] = indexA;
+		stack[count][1] = indexB;
+		count++;
+	}
+}
+
+DynamicAABBTree::DynamicAABBTree(float margin) :
+	mRoot(RIG_AABB_TREE_NULL_NODE),
+	mFreeList(RIG_AABB_TREE_NULL_NODE),
+	mProxyCount(0),
+	mMargin(margin)
+{
+
+}
+
+DynamicAABBTree::~DynamicAABBTree()
+{
+
+}
+
+uint32_t DynamicAABBTree::CreateProxy(const BoxCollider& aabb, void* userData)
+{
+	uint32_t leaf = AllocateNode();
+	Node& node = mNodes[leaf];
+	node.userData = userData;
+	node.height = 0;
+
+	vec3f displacement = { 0.0f, 0.0f, 0.0f };
+	SetFatAABB(leaf, aabb, displacement);
+	InsertLeaf(leaf);
+	MarkMoved(leaf);
+
+	mProxyCount++;
+	return leaf;
+}
+
+void DynamicAABBTree::DestroyProxy(uint32_t proxyID)
+{
+	// A pending move entry is left in place and skipped by FindNewPairs once the node is no longer a leaf.
+	RemoveLeaf(proxyID);
+	FreeNode(proxyID);
+	mProxyCount--;
+}
+
+bool DynamicAABBTree::MoveProxy(uint32_t proxyID, const BoxCollider& aabb, const vec3f& displacement)
+{
+	const Node& node = mNodes[proxyID];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (aabb.origin[axis] - aabb.halfSize[axis] < node.min[axis] || aabb.origin[axis] + aabb.halfSize[axis] > node.max[axis])
+		{
+			RemoveLeaf(proxyID);
+			SetFatAABB(proxyID, aabb, displacement);
+			InsertLeaf(proxyID);
+			MarkMoved(proxyID);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void* DynamicAABBTree::GetUserData(uint32_t proxyID) const
+{
+	return mNodes[proxyID].userData;
+}
+
+BoxCollider DynamicAABBTree::GetFatAABB(uint32_t proxyID) const
+{
+	const Node& node = mNodes[proxyID];
+
+	BoxCollider aabb;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		aabb.origin[axis] = (node.min[axis] + node.max[axis]) * 0.5f;
+		aabb.halfSize[axis] = (node.max[axis] - node.min[axis]) * 0.5f;
+	}
+
+	return aabb;
+}
+
+void DynamicAABBTree::Query(const BoxCollider& aabb, std::vector<uint32_t>& proxyIDs) const
+{
+	if (mRoot == RIG_AABB_TREE_NULL_NODE)
+	{
+		return;
+	}
+
+	float min[3];
+	float max[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		min[axis] = aabb.origin[axis] - aabb.halfSize[axis];
+		max[axis] = aabb.origin[axis] + aabb.halfSize[axis];
+	}
+
+	// Each level leaves at most one sibling behind, so the stack never holds more than height + 1 nodes.
+	uint32_t localStack[RIG_AABB_TREE_STACK_SIZE];
+	std::vector<uint32_t> heapStack;
+	uint32_t* stack = localStack;
+	uint32_t capacity = static_cast<uint32_t>(mNodes[mRoot].height) + 2;
+	if (capacity > RIG_AABB_TREE_STACK_SIZE)
+	{
+		heapStack.resize(capacity);
+		stack = heapStack.data();
+	}
+
+	uint32_t count = 0;
+	stack[count++] = mRoot;
+
+	while (count > 0)
+	{
+		uint32_t nodeIndex = stack[--count];
+		const Node& node = mNodes[nodeIndex];
+
+		if (!Overlaps(node.min, node.max, min, max))
+		{
+			continue;
+		}
+
+		if (node.height == 0)
+		{
+			proxyIDs.push_back(nodeIndex);
+		}
+		else
+		{
+			stack[count++] = node.child1;
+			stack[count++] = node.child2;
+		}
+	}
+}
+
+void DynamicAABBTree::FindPairs(std::vector<AABBTreePair>& pairs) const
+{
+	if (mRoot == RIG_AABB_TREE_NULL_NODE)
+	{
+		return;
+	}
+
+	// Pairs within a subtree come from pairs within each child plus pairs across the two children.
+	// Cross entries have a second node, self entries repeat the first. Every self level leaves two entries behind and every
+	// cross step one, and a cross descent takes at most two steps per level, so 3 * (height + 1) entries always suffice.
+	uint32_t localStack[RIG_AABB_TREE_STACK_SIZE][2];
+	std::vector<uint32_t> heapStack;
+	uint32_t (*stack)[2] = localStack;
+	uint32_t capacity = 3 * (static_cast<uint32_t>(mNodes[mRoot].height) + 1);
+	if (capacity > RIG_AABB_TREE_STACK_SIZE)
+	{
+		heapStack.resize(capacity * 2);
+		stack = reinterpret_cast<uint32_t(*)[2]>(heapStack.data());
+	}
+
+	uint32_t count = 0;
+	stack[count][0] = mRoot;
+	stack[count][1] = mRoot;
+	count++;
+
+	while (count > 0)
+	{
+		count--;
+		uint32_t indexA = stack[count][0];
+		uint32_t indexB = stack[count][1];
+
+		const Node& a = mNodes[indexA];
+		const Node& b = mNodes[indexB];
+
+		if (indexA == indexB)
+		{
+			if (a.height > 0)
+			{
+				Push(stack, count, a.child1, a.child1);
+				Push(stack, count, a.child2, a.child2);
+				Push(stack, count, a.child1, a.child2);
+			}
+
+			continue;
+		}
+
+		if (!Overlaps(a.min, a.max, b.min, b.max))
+		{
+			continue;
+		}
+
+		if (a.height == 0 && b.height == 0)
+		{
+			AABBTreePair pair = { std::min(indexA, indexB), std::max(indexA, indexB) };
+			pairs.push_back(pair);
+		}
+		else if (b.height == 0 || (a.height > 0 && GetHalfArea(a.min, a.max) > GetHalfArea(b.min, b.max)))
+		{
+			// Descend the larger box so both sides shrink at a similar rate.
+			Push(stack, count, a.child1, indexB);
+			Push(stack, count, a.child2, indexB);
+		}
+		else
+		{
+			Push(stack, count, indexA, b.child1);
+			Push(stack, count, indexA, b.child2);
+		}
+	}
+}
+
+void DynamicAABBTree::FindNewPairs(std::vector<AABBTreePair>& pairs)
+{
+	std::vector<uint32_t> proxyIDs;
+	for (uint32_t proxyID : mMoved)
+	{
+		// Entries of destroyed proxies are dropped here. A node reused as a leaf keeps its flag and so its single entry.
+		if (mNodes[proxyID].height != 0 || !mNodes[proxyID].isMoved)
+		{
+			continue;
+		}
+
+		proxyIDs.clear();
+		Query(GetFatAABB(proxyID), proxyIDs);
+
+		// A pair of two moved proxies is reported by the lower one only.
+		for (uint32_t otherID : proxyIDs)
+		{
+			if (otherID != proxyID && (!mNodes[otherID].isMoved || proxyID < otherID))
+			{
+				AABBTreePair pair = { std::min(proxyID, otherID), std::max(proxyID, otherID) };
+				pairs.push_back(pair);
+			}
+		}
+	}
+
+	for (uint32_t proxyID : mMoved)
+	{
+		mNodes[proxyID].isMoved = false;
+	}
+
+	mMoved.clear();
+}
+
+void DynamicAABBTree::Clear()
+{
+	mNodes.clear();
+	mMoved.clear();
+	mRoot = RIG_AABB_TREE_NULL_NODE;
+	mFreeList = RIG_AABB_TREE_NULL_NODE;
+	mProxyCount = 0;
+}
+
+uint32_t DynamicAABBTree::GetProxyCount() const
+{
+	return mProxyCount;
+}
+
+uint32_t DynamicAABBTree::GetHeight() const
+{
+	return (mRoot == RIG_AABB_TREE_NULL_NODE) ? 0 : static_cast<uint32_t>(mNodes[mRoot].height);
+}
+
+uint32_t DynamicAABBTree::AllocateNode()
+{
+	if (mFreeList == RIG_AABB_TREE_NULL_NODE)
+	{
+		// Grow the pool and thread the new nodes onto the free list.
+		uint32_t first = static_cast<uint32_t>(mNodes.size());
+		uint32_t count = (first > 16) ? first : 16;
+		mNodes.resize(first + count);
+
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			mNodes[i].parent = (i + 1 < first + count) ? i + 1 : RIG_AABB_TREE_NULL_NODE;
+			mNodes[i].height = -1;
+			mNodes[i].isMoved = false;
+		}
+
+		mFreeList = first;
+	}
+
+	uint32_t nodeIndex = mFreeList;
+	Node& node = mNodes[nodeIndex];
+	mFreeList = node.parent;
+
+	node.parent = RIG_AABB_TREE_NULL_NODE;
+	node.child1 = RIG_AABB_TREE_NULL_NODE;
+	node.child2 = RIG_AABB_TREE_NULL_NODE;
+	node.height = 0;
+	node.userData = nullptr;
+
+	return nodeIndex;
+}
+
+void DynamicAABBTree::FreeNode(uint32_t nodeIndex)
+{
+	mNodes[nodeIndex].parent = mFreeList;
+	mNodes[nodeIndex].height = -1;
+	mFreeList = nodeIndex;
+}
+
+void DynamicAABBTree::InsertLeaf(uint32_t leaf)
+{
+	if (mRoot == RIG_AABB_TREE_NULL_NODE)
+	{
+		mRoot = leaf;
+		mNodes[leaf].parent = RIG_AABB_TREE_NULL_NODE;
+		return;
+	}
+
+	// Descend towards the sibling that adds the least surface area to the tree. Pairing with a node costs the box enclosing
+	// both plus the growth of every ancestor. Growth only accumulates on the way down, so the walk stops once neither child's
+	// lower bound can beat the best node found so far.
+	const float* leafMin = mNodes[leaf].min;
+	const float* leafMax = mNodes[leaf].max;
+	float leafArea = GetHalfArea(leafMin, leafMax);
+
+	uint32_t index = mRoot;
+	uint32_t bestIndex = mRoot;
+	float directCost = GetCombinedHalfArea(mNodes[mRoot].min, mNodes[mRoot].max, leafMin, leafMax);
+	float bestCost = directCost;
+	float inheritedCost = 0.0f;
+
+	while (mNodes[index].height > 0)
+	{
+		const Node& node = mNodes[index];
+
+		float cost = directCost + inheritedCost;
+		if (cost < bestCost)
+		{
+			bestIndex = index;
+			bestCost = cost;
+		}
+
+		inheritedCost += directCost - GetHalfArea(node.min, node.max);
+
+		uint32_t children[2] = { node.child1, node.child2 };
+		float childDirectCosts[2];
+		float lowerBounds[2];
+		for (int i = 0; i < 2; i++)
+		{
+			const Node& child = mNodes[children[i]];
+			childDirectCosts[i] = GetCombinedHalfArea(child.min, child.max, leafMin, leafMax);
+			lowerBounds[i] = FLT_MAX;
+
+			if (child.height == 0)
+			{
+				if (childDirectCosts[i] + inheritedCost < bestCost)
+				{
+					bestIndex = children[i];
+					bestCost = childDirectCosts[i] + inheritedCost;
+				}
+			}
+			else
+			{
+				// Below the child the leaf can at best be paired with something inside it, adding no more than its own area.
+				float childArea = GetHalfArea(child.min, child.max);
+				lowerBounds[i] = inheritedCost + childDirectCosts[i] + std::min(leafArea - childArea, 0.0f);
+			}
+		}
+
+		if (bestCost <= lowerBounds[0] && bestCost <= lowerBounds[1])
+		{
+			break;
+		}
+
+		int next = (lowerBounds[1] < lowerBounds[0]) ? 1 : 0;
+		index = children[next];
+		directCost = childDirectCosts[next];
+	}
+
+	uint32_t sibling = bestIndex;
+	uint32_t oldParent = mNodes[sibling].parent;
+	uint32_t newParent = AllocateNode();
+
+	Node& parent = mNodes[newParent];
+	parent.parent = oldParent;
+	parent.child1 = sibling;
+	parent.child2 = leaf;
+
+	if (oldParent != RIG_AABB_TREE_NULL_NODE)
+	{
+		if (mNodes[oldParent].child1 == sibling)
+		{
+			mNodes[oldParent].child1 = newParent;
+		}
+		else
+		{
+			mNodes[oldParent].child2 = newParent;
+		}
+	}
+	else
+	{
+		mRoot = newParent;
+	}
+
+	mNodes[sibling].parent = newParent;
+	mNodes[leaf].parent = newParent;
+
+	for (index = mNodes[leaf].parent; index != RIG_AABB_TREE_NULL_NODE; index = mNodes[index].parent)
+	{
+		Refit(index);
+		Rotate(index);
+	}
+}
+
+void DynamicAABBTree::RemoveLeaf(uint32_t leaf)
+{
+	if (leaf == mRoot)
+	{
+		mRoot = RIG_AABB_TREE_NULL_NODE;
+		return;
+	}
+
+	uint32_t parent = mNodes[leaf].parent;
+	uint32_t grandParent = mNodes[parent].parent;
+	uint32_t sibling = (mNodes[parent].child1 == leaf) ? mNodes[parent].child2 : mNodes[parent].child1;
+
+	FreeNode(parent);
+
+	if (grandParent == RIG_AABB_TREE_NULL_NODE)
+	{
+		mRoot = sibling;
+		mNodes[sibling].parent = RIG_AABB_TREE_NULL_NODE;
+		return;
+	}
+
+	// The sibling takes the parent's place.
+	if (mNodes[grandParent].child1 == parent)
+	{
+		mNodes[grandParent].child1 = sibling;
+	}
+	else
+	{
+		mNodes[grandParent].child2 = sibling;
+	}
+
+	mNodes[sibling].parent = grandParent;
+
+	for (uint32_t index = grandParent; index != RIG_AABB_TREE_NULL_NODE; index = mNodes[index].parent)
+	{
+		Refit(index);
+		Rotate(index);
+	}
+}
+
+void DynamicAABBTree::Rotate(uint32_t indexA)
+{
+	// Try swapping one child of A with a grandchild under the other child. A's box is unchanged by any swap, so the
+	// best rotation is the one that shrinks the child left holding the grandchild the most.
+	const Node& a = mNodes[indexA];
+	if (a.height < 2)
+	{
+		return;
+	}
+
+	uint32_t children[2] = { a.child1, a.child2 };
+	uint32_t bestChild = RIG_AABB_TREE_NULL_NODE;
+	uint32_t bestGrandChild = RIG_AABB_TREE_NULL_NODE;
+	float bestDelta = 0.0f;
+
+	for (int i = 0; i < 2; i++)
+	{
+		const Node& child = mNodes[children[i]];
+		const Node& other = mNodes[children[1 - i]];
+		if (other.height == 0)
+		{
+			continue;
+		}
+
+		// After the swap, other encloses child and the grandchild that was not moved.
+		float otherArea = GetHalfArea(other.min, other.max);
+		uint32_t grandChildren[2] = { other.child1, other.child2 };
+		for (int j = 0; j < 2; j++)
+		{
+			const Node& remaining = mNodes[grandChildren[1 - j]];
+			float delta = GetCombinedHalfArea(child.min, child.max, remaining.min, remaining.max) - otherArea;
+			if (delta < bestDelta)
+			{
+				bestDelta = delta;
+				bestChild = children[i];
+				bestGrandChild = grandChildren[j];
+			}
+		}
+	}
+
+	if (bestChild == RIG_AABB_TREE_NULL_NODE)
+	{
+		return;
+	}
+
+	uint32_t other = mNodes[bestGrandChild].parent;
+	Node& otherNode = mNodes[other];
+	if (otherNode.child1 == bestGrandChild)
+	{
+		otherNode.child1 = bestChild;
+	}
+	else
+	{
+		otherNode.child2 = bestChild;
+	}
+
+	Node& parent = mNodes[indexA];
+	if (parent.child1 == bestChild)
+	{
+		parent.child1 = bestGrandChild;
+	}
+	else
+	{
+		parent.child2 = bestGrandChild;
+	}
+
+	mNodes[bestChild].parent = other;
+	mNodes[bestGrandChild].parent = indexA;
+
+	Refit(other);
+	Refit(indexA);
+}
+
+void DynamicAABBTree::Refit(uint32_t nodeIndex)
+{
+	Node& node = mNodes[nodeIndex];
+	const Node& child1 = mNodes[node.child1];
+	const Node& child2 = mNodes[node.child2];
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		node.min[axis] = std::min(child1.min[axis], child2.min[axis]);
+		node.max[axis] = std::max(child1.max[axis], child2.max[axis]);
+	}
+
+	node.height = 1 + std::max(child1.height, child2.height);
+}
+
+void DynamicAABBTree::SetFatAABB(uint32_t leaf, const BoxCollider& aabb, const vec3f& displacement)
+{
+	Node& node = mNodes[leaf];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		node.min[axis] = aabb.origin[axis] - aabb.halfSize[axis] - mMargin;
+		node.max[axis] = aabb.origin[axis] + aabb.halfSize[axis] + mMargin;
+
+		// Stretch towards where the box is heading so it stays inside for longer.
+		float d = RIG_AABB_TREE_DISPLACEMENT_MULTIPLIER * displacement[axis];
+		if (d < 0.0f)
+		{
+			node.min[axis] += d;
+		}
+		else
+		{
+			node.max[axis] += d;
+		}
+	}
+}
+
+void DynamicAABBTree::MarkMoved(uint32_t leaf)
+{
+	if (!mNodes[leaf].isMoved)
+	{
+		mNodes[leaf].isMoved = true;
+		mMoved.push_back(leaf);
+	}
+}
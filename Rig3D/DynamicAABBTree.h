@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Parametric.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+#define RIG_AABB_TREE_NULL_NODE					0xffffffff
+#define RIG_AABB_TREE_DISPLACEMENT_MULTIPLIER	2.0f
+#define RIG_AABB_TREE_STACK_SIZE				256
+
+namespace Rig3D
+{
+	struct AABBTreePair
+	{
+		uint32_t proxyA;
+		uint32_t proxyB;	// Always greater than proxyA.
+	};
+
+	// Incremental bounding volume hierarchy for moving bodies. Each proxy is stored as a fat box, grown by a margin and in the direction
+	// of motion, so most moves leave the tree untouched. Insertion picks the cheapest sibling by surface area and local rotations keep
+	// the tree tight as proxies move, so insert, remove and move only walk one root to leaf path. Proxy IDs are stable until destroyed.
+	class RIG3D DynamicAABBTree
+	{
+	public:
+		DynamicAABBTree(float margin = 0.1f);
+		~DynamicAABBTree();
+
+		uint32_t	CreateProxy(const BoxCollider& aabb, void* userData);
+		void		DestroyProxy(uint32_t proxyID);
+
+		// Returns true if aabb left the fat box and the proxy was reinserted. displacement is the motion expected before the next move.
+		bool		MoveProxy(uint32_t proxyID, const BoxCollider& aabb, const vec3f& displacement);
+
+		void*		GetUserData(uint32_t proxyID) const;
+		BoxCollider	GetFatAABB(uint32_t proxyID) const;
+
+		// Appends every proxy whose fat box overlaps aabb.
+		void		Query(const BoxCollider& aabb, std::vector<uint32_t>& proxyIDs) const;
+
+		// Appends every pair of proxies whose fat boxes overlap, each pair once.
+		void		FindPairs(std::vector<AABBTreePair>& pairs) const;
+
+		// As FindPairs, but only pairs with at least one proxy created or reinserted since the last call. Pairs of resting
+		// proxies are not reported again, so callers keep their own pair list and drop pairs whose fat boxes stop overlapping.
+		void		FindNewPairs(std::vector<AABBTreePair>& pairs);
+
+		void		Clear();
+
+		uint32_t	GetProxyCount() const;
+		uint32_t	GetHeight() const;
+
+	private:
+		struct Node
+		{
+			float		min[3];
+			float		max[3];
+			void*		userData;
+			uint32_t	parent;		// Next free node while on the free list.
+			uint32_t	child1;
+			uint32_t	child2;
+			int32_t		height;		// Zero for leaves, -1 for free nodes.
+			bool		isMoved;	// Kept across free and reuse while the node has an entry in mMoved.
+		};
+
+		std::vector<Node>		mNodes;
+		std::vector<uint32_t>	mMoved;
+		uint32_t				mRoot;
+		uint32_t				mFreeList;
+		uint32_t				mProxyCount;
+		float					mMargin;
+
+		uint32_t	AllocateNode();
+		void		FreeNode(uint32_t nodeIndex);
+		void		InsertLeaf(uint32_t leaf);
+		void		RemoveLeaf(uint32_t leaf);
+		void		Rotate(uint32_t nodeIndex);
+		void		Refit(uint32_t nodeIndex);
+		void		SetFatAABB(uint32_t leaf, const BoxCollider& aabb, const vec3f& displacement);
+		void		MarkMoved(uint32_t leaf);
+
+		DynamicAABBTree(DynamicAABBTree const&) = delete;
+		void operator=(DynamicAABBTree const&) = delete;
+	};
+}
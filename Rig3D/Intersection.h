@@ -8,23 +8,84 @@
 namespace Rig3D
 {
 
-#pragma region Closest Point Tests
+#pragma region Per Axis Helpers
 
+	// Number of float components, known at compile time.
 	template<class Vector>
-	void ClosestAABBPointToPoint(const AABB<Vector>& aabb, const Vector& point, Vector& cp)
+	struct VectorDimension
 	{
-		int numElements = sizeof(Vector) / sizeof(float);
+		static constexpr int value = sizeof(Vector) / sizeof(float);
+	};
 
-		for (int i = 0; i < numElements; i++)
+	// Calls function(axis) for each axis below Count, unrolled at compile time. Stops at the first axis that returns false.
+	template<int Count>
+	struct UnrolledAxes
+	{
+		template<class Function>
+		static inline bool ForEach(const Function& function)
 		{
-			float v = point[i];
-			Vector min = aabb.origin - aabb.halfSize;
-			Vector max = aabb.origin + aabb.halfSize;
-		
-			if (v < min[i]) v = min[i];
-			if (v > max[i]) v = max[i];
-			cp[i] = v;
+			return UnrolledAxes<Count - 1>::ForEach(function) && function(Count - 1);
 		}
+	};
+
+	template<>
+	struct UnrolledAxes<0>
+	{
+		template<class Function>
+		static inline bool ForEach(const Function&)
+		{
+			return true;
+		}
+	};
+
+	// Select forms compile to a single min/max instruction rather than a branch.
+	inline float MinScalar(float a, float b)
+	{
+		return (a < b) ? a : b;
+	}
+
+	inline float MaxScalar(float a, float b)
+	{
+		return (a > b) ? a : b;
+	}
+
+	inline float ClampScalar(float value, float min, float max)
+	{
+		return MinScalar(MaxScalar(value, min), max);
+	}
+
+	// Clips the interval [tMin, tMax] against the slab [slabMin, slabMax] along one axis of a ray starting at origin.
+	// Returns false once the interval is empty.
+	inline bool ClipSlab(float origin, float direction, float slabMin, float slabMax, float& tMin, float& tMax)
+	{
+		if (abs(direction) < FLT_EPSILON)
+		{
+			// Ray is parallel to slab. Check if origin is contained by plane
+			return origin >= slabMin && origin <= slabMax;
+		}
+
+		float ood = 1.0f / direction;
+		float t1 = (slabMin - origin) * ood;
+		float t2 = (slabMax - origin) * ood;
+
+		tMin = MaxScalar(tMin, MinScalar(t1, t2));
+		tMax = MinScalar(tMax, MaxScalar(t1, t2));
+
+		return tMin <= tMax;
+	}
+
+#pragma endregion
+
+#pragma region Closest Point Tests
+
+	template<class Vector>
+	void ClosestAABBPointToPoint(const AABB<Vector>& aabb, const Vector& point, Vector& cp)
+	{
+		UnrolledAxes<VectorDimension<Vector>::value>::ForEach([&](int i)
+		{
+			cp[i] = ClampScalar(point[i], aabb.origin[i] - aabb.halfSize[i], aabb.origin[i] + aabb.halfSize[i]);
+			return true;
+		});
 	}
 
 #pragma endregion 
@@ -87,47 +148,19 @@ namespace Rig3D
 	}
 
 	template<class Vector>
-	int IntersectRayAABB(Ray<Vector>& ray, AABB<Vector>& aabb, Vector& poi, float& t)
+	int IntersectRayAABB(const Ray<Vector>& ray, const AABB<Vector>& aabb, Vector& poi, float& t)
 	{
-		int numElements = sizeof(Vector) / sizeof(float);
-
 		float tMin = 0.0f;
 		float tMax = FLT_MAX;
 
-		for (int i = 0; i < numElements; i++)
+		bool isHit = UnrolledAxes<VectorDimension<Vector>::value>::ForEach([&](int i)
 		{
-			float aabbMin = aabb.origin[i] - aabb.halfSize[i];
-			float aabbMax = aabb.origin[i] + aabb.halfSize[i];
+			return ClipSlab(ray.origin[i], ray.normal[i], aabb.origin[i] - aabb.halfSize[i], aabb.origin[i] + aabb.halfSize[i], tMin, tMax);
+		});
 
-			if (abs(ray.normal[i]) < FLT_EPSILON)
-			{
-				// Ray is parallel to slab. Check if origin is contained by plane
-				if (ray.origin[i] < aabbMin || ray.origin[i] > aabbMax)
-				{
-					return 0;
-				}
-			}
-			else
-			{
-				float ood = 1.0f / ray.normal[i];
-				float t1 = (aabbMin - ray.origin[i]) * ood;
-				float t2 = (aabbMax - ray.origin[i]) * ood;
-
-				if (t1 > t2)
-				{
-					float temp = t2;
-					t2 = t1;
-					t1 = temp;
-				}
-
-				tMin = max(tMin, t1);
-				tMax = min(tMax, t2);
-
-				if (tMin > tMax)
-				{
-					return 0;
-				}
-			}
+		if (!isHit)
+		{
+			return 0;
 		}
 
 		poi = ray.origin + ray.normal * tMin;
@@ -136,48 +169,69 @@ namespace Rig3D
 	}
 
 	template<class Vector>
-	int IntersectLineAABB(Line<Vector>& line, AABB<Vector>& aabb, Vector& poi, float& t)
+	int IntersectRayTriangle(const Ray<Vector>& ray, const Vector& a, const Vector& b, const Vector& c, Vector& poi, float& t)
+	{
+		// Moller-Trumbore. Solve R(t) = a + u(b - a) + v(c - a) for t, u and v with Cramer's rule
+		Vector e0 = b - a;
+		Vector e1 = c - a;
+		Vector p = cliqCity::graphicsMath::cross(ray.normal, e1);
+
+		// Two sided: the determinant is negative for back faces, and both signs are accepted.
+		float determinant = cliqCity::graphicsMath::dot(e0, p);
+
+		// Ray is parallel to the triangle's plane, so there is no hit. The determinant scales with |e0||e1| for a unit ray,
+		// so the tolerance does too, or small triangles would always be missed.
+		float edgeScale = sqrt(cliqCity::graphicsMath::dot(e0, e0) * cliqCity::graphicsMath::dot(e1, e1));
+		if (abs(determinant) <= FLT_EPSILON * edgeScale)
+		{
+			return 0;
+		}
+
+		float ood = 1.0f / determinant;
+		Vector s = ray.origin - a;
+
+		float u = cliqCity::graphicsMath::dot(s, p) * ood;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return 0;
+		}
+
+		Vector q = cliqCity::graphicsMath::cross(s, e0);
+
+		float v = cliqCity::graphicsMath::dot(ray.normal, q) * ood;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return 0;
+		}
+
+		float tHit = cliqCity::graphicsMath::dot(e1, q) * ood;
+		if (tHit < 0.0f)
+		{
+			return 0;
+		}
+
+		t = tHit;
+		poi = ray.origin + ray.normal * t;
+
+		return 1;
+	}
+
+	template<class Vector>
+	int IntersectLineAABB(const Line<Vector>& line, const AABB<Vector>& aabb, Vector& poi, float& t)
 	{
-		int numElements = sizeof(Vector) / sizeof(float);
+		Vector normal = line.end - line.origin;
 
 		float tMin = 0.0f;
 		float tMax = 1.0f;
 
-		for (int i = 0; i < numElements; i++)
+		bool isHit = UnrolledAxes<VectorDimension<Vector>::value>::ForEach([&](int i)
 		{
-			Vector normal = line.end - line.origin;
-			float aabbMin = aabb.origin[i] - aabb.halfSize[i];
-			float aabbMax = aabb.origin[i] + aabb.halfSize[i];
+			return ClipSlab(line.origin[i], normal[i], aabb.origin[i] - aabb.halfSize[i], aabb.origin[i] + aabb.halfSize[i], tMin, tMax);
+		});
 
-			if (abs(normal[i]) < FLT_EPSILON)
-			{
-				// Ray is parallel to slab. Check if origin is contained by plane
-				if (line.origin[i] < aabbMin || line.origin[i] > aabbMax)
-				{
-					return 0;
-				}
-			}
-			else
-			{
-				float ood = 1.0f / normal[i];
-				float t1 = (aabbMin - line.origin[i]) * ood;
-				float t2 = (aabbMax - line.origin[i]) * ood;
-
-				if (t1 > t2)
-				{
-					float temp = t2;
-					t2 = t1;
-					t1 = temp;
-				}
-
-				tMin = max(tMin, t1);
-				tMax = min(tMax, t2);
-
-				if (tMin > tMax)
-				{
-					return 0;
-				}
-			}
+		if (!isHit)
+		{
+			return 0;
 		}
 
 		poi = (1 - tMin) * line.origin + tMin * line.end;
@@ -256,25 +310,22 @@ namespace Rig3D
 			return 1;
 		}
 
-		float a = cliqCity::graphicsMath::dot(relativeVelocity, relativeVelocity);
-		if (a < FLT_EPSILON)
-		{
-			return 0;
-		}
-
+		// b < 0 also rules out a == 0, so slow bodies are not rejected by an absolute epsilon on the speed
 		float b = cliqCity::graphicsMath::dot(relativeVelocity, distance);
 		if (b >= 0.0f)
 		{
 			return 0;
 		}
 
+		float a = cliqCity::graphicsMath::dot(relativeVelocity, relativeVelocity);
 		float d = b * b - a * c;
 		if (d < 0.0f)
 		{
 			return 0;
 		}
 
-		t = (-b - sqrt(d)) / a;
+		// Same root as (-b - sqrt(d)) / a without the cancellation when a is small
+		t = c / (-b + sqrt(d));
 		poi = s0.origin + t * v0; // Probably wrong
 		return 1;
 	}
@@ -294,24 +345,22 @@ namespace Rig3D
 #pragma region AABB - Primitive Tests
 
 	template<class Vector>
-	int IntersectAABBAABB(AABB<Vector> aabb0, AABB<Vector> aabb1)
+	int IntersectAABBAABB(const AABB<Vector>& aabb0, const AABB<Vector>& aabb1)
 	{
-		int numElements = sizeof(Vector) / sizeof(float);
-
-		Vector min0 = aabb0.origin - aabb0.halfSize;
-		Vector max0 = aabb0.origin + aabb0.halfSize;
-		Vector min1 = aabb1.origin - aabb1.halfSize;
-		Vector max1 = aabb1.origin + aabb1.halfSize;
-
-		for (int i = 0; i < numElements; i++)
+		// Separated along an axis if either box ends before the other begins. Every axis is tested and the results combined
+		// without branching, which beats exiting early when overlaps are hard to predict.
+		int separated = 0;
+		UnrolledAxes<VectorDimension<Vector>::value>::ForEach([&](int i)
 		{
-			if (max0[i] < min1[i] || min0[i] > max1[i])
-			{
-				return 0;
-			}
-		}
-
-		return 1;
+			float min0 = aabb0.origin[i] - aabb0.halfSize[i];
+			float max0 = aabb0.origin[i] + aabb0.halfSize[i];
+			float min1 = aabb1.origin[i] - aabb1.halfSize[i];
+			float max1 = aabb1.origin[i] + aabb1.halfSize[i];
+			separated |= (max0 < min1) | (min0 > max1);
+			return true;
+		});
+
+		return separated == 0;
 	}
 
 #pragma endregion 
@@ -0,0 +1,426 @@
+#pragma once
+#include "ColliderBatch.h"
+#include <algorithm>
+#include <utility>
+
+namespace Rig3D
+{
+
+#pragma region Ray Packets
+
+#if RIG_SIMD_WIDTH >= 8
+	typedef FloatLanes8		RayPacketLanes;
+#elif RIG_SIMD_WIDTH >= 4
+	typedef FloatLanes4		RayPacketLanes;
+#else
+	typedef FloatLanes1		RayPacketLanes;
+#endif
+
+	// Structure of arrays bundle of up to Lanes::width rays tested together. Unused lanes are NaN and never hit.
+	template<class Lanes>
+	struct RayPacket
+	{
+		float origin[3][Lanes::width];
+		float normal[3][Lanes::width];
+		float ood[3][Lanes::width];				// 1 / normal, or 0 where the ray is parallel to the slab.
+		uint32_t indices[Lanes::width];			// Position of each ray in the array the packet was built from.
+		uint32_t activeMask;					// Bit i is set when lane i holds a ray.
+
+		void Set(const Ray<vec3f>* rays, const uint32_t* rayIndices, uint32_t count)
+		{
+			float padding = std::numeric_limits<float>::quiet_NaN();
+			activeMask = 0;
+
+			for (uint32_t lane = 0; lane < Lanes::width; lane++)
+			{
+				if (lane < count)
+				{
+					const Ray<vec3f>& ray = rays[rayIndices[lane]];
+					for (int axis = 0; axis < 3; axis++)
+					{
+						origin[axis][lane] = ray.origin[axis];
+						normal[axis][lane] = ray.normal[axis];
+						ood[axis][lane] = (fabsf(ray.normal[axis]) < FLT_EPSILON) ? 0.0f : 1.0f / ray.normal[axis];
+					}
+
+					indices[lane] = rayIndices[lane];
+					activeMask |= 1u << lane;
+				}
+				else
+				{
+					for (int axis = 0; axis < 3; axis++)
+					{
+						origin[axis][lane] = padding;
+						normal[axis][lane] = padding;
+						ood[axis][lane] = padding;
+					}
+
+					indices[lane] = 0;
+				}
+			}
+		}
+	};
+
+#if RIG_SIMD_WIDTH >= 4
+	typedef RayPacket<FloatLanes4>	RayPacket4;
+#endif
+
+#if RIG_SIMD_WIDTH >= 8
+	typedef RayPacket<FloatLanes8>	RayPacket8;
+#endif
+
+	// Slab test of every lane against one box, clipped to tLimit. Returns with whatever lanes are left as soon as none can hit.
+	template<class Lanes>
+	typename Lanes::Mask IntersectRayPacketSlabs(const RayPacket<Lanes>& packet, const typename Lanes::Float* aabbMin, const typename Lanes::Float* aabbMax,
+		typename Lanes::Float tLimit, typename Lanes::Float& tMin)
+	{
+		typedef typename Lanes::Float Float;
+		typedef typename Lanes::Mask Mask;
+
+		Float epsilon = Lanes::Set(FLT_EPSILON);
+		Float tMax = tLimit;
+		tMin = Lanes::Set(0.0f);
+
+		Mask hit = Lanes::LessEqual(tMin, tMax);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Float origin = Lanes::Load(packet.origin[axis]);
+			Float ood = Lanes::Load(packet.ood[axis]);
+			Mask isParallel = Lanes::Less(Lanes::Abs(Lanes::Load(packet.normal[axis])), epsilon);
+
+			// Lanes parallel to the slab keep their interval and only need the origin between its planes.
+			Mask isInside = Lanes::And(Lanes::GreaterEqual(origin, aabbMin[axis]), Lanes::LessEqual(origin, aabbMax[axis]));
+			hit = Lanes::AndNot(Lanes::AndNot(isInside, isParallel), hit);
+
+			Float t1 = Lanes::Mul(Lanes::Sub(aabbMin[axis], origin), ood);
+			Float t2 = Lanes::Mul(Lanes::Sub(aabbMax[axis], origin), ood);
+			tMin = Lanes::Select(isParallel, tMin, Lanes::Max(tMin, Lanes::Min(t1, t2)));
+			tMax = Lanes::Select(isParallel, tMax, Lanes::Min(tMax, Lanes::Max(t1, t2)));
+
+			hit = Lanes::And(hit, Lanes::LessEqual(tMin, tMax));
+			if (Lanes::Bits(hit) == 0)
+			{
+				break;
+			}
+		}
+
+		return hit;
+	}
+
+	template<class Lanes>
+	typename Lanes::Mask IntersectRayPacketSpheres(const RayPacket<Lanes>& packet, typename Lanes::Float x, typename Lanes::Float y, typename Lanes::Float z,
+		typename Lanes::Float radius, typename Lanes::Float& t)
+	{
+		typedef typename Lanes::Float Float;
+		typedef typename Lanes::Mask Mask;
+
+		Float zero = Lanes::Set(0.0f);
+		Float nx = Lanes::Load(packet.normal[0]);
+		Float ny = Lanes::Load(packet.normal[1]);
+		Float nz = Lanes::Load(packet.normal[2]);
+		Float mx = Lanes::Sub(Lanes::Load(packet.origin[0]), x);
+		Float my = Lanes::Sub(Lanes::Load(packet.origin[1]), y);
+		Float mz = Lanes::Sub(Lanes::Load(packet.origin[2]), z);
+
+		Float b = Lanes::Add(Lanes::Add(Lanes::Mul(mx, nx), Lanes::Mul(my, ny)), Lanes::Mul(mz, nz));
+		Float c = Lanes::Sub(Lanes::Add(Lanes::Add(Lanes::Mul(mx, mx), Lanes::Mul(my, my)), Lanes::Mul(mz, mz)), Lanes::Mul(radius, radius));
+		Float discriminant = Lanes::Sub(Lanes::Mul(b, b), c);
+
+		Mask away = Lanes::And(Lanes::Greater(c, zero), Lanes::Greater(b, zero));
+		Mask hit = Lanes::AndNot(away, Lanes::GreaterEqual(discriminant, zero));
+
+		t = Lanes::Sub(Lanes::Negate(b), Lanes::Sqrt(Lanes::Max(discriminant, zero)));
+		return hit;
+	}
+
+	// Returns bit i set when lane i hits. t receives the entry distance of every lane and must hold Lanes::width floats, or be null.
+	template<class Lanes>
+	uint32_t IntersectRayPacketAABB(const RayPacket<Lanes>& packet, const BoxCollider& aabb, float* t)
+	{
+		typedef typename Lanes::Float Float;
+
+		Float aabbMin[3];
+		Float aabbMax[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			aabbMin[axis] = Lanes::Set(aabb.origin[axis] - aabb.halfSize[axis]);
+			aabbMax[axis] = Lanes::Set(aabb.origin[axis] + aabb.halfSize[axis]);
+		}
+
+		Float tMin;
+		uint32_t hits = Lanes::Bits(IntersectRayPacketSlabs<Lanes>(packet, aabbMin, aabbMax, Lanes::Set(FLT_MAX), tMin)) & packet.activeMask;
+
+		if (t)
+		{
+			Lanes::Store(t, tMin);
+		}
+
+		return hits;
+	}
+
+	// As with IntersectRaySphere, t is negative for rays starting inside the sphere.
+	template<class Lanes>
+	uint32_t IntersectRayPacketSphere(const RayPacket<Lanes>& packet, const SphereCollider& sphere, float* t)
+	{
+		typedef typename Lanes::Float Float;
+
+		Float tHit;
+		uint32_t hits = Lanes::Bits(IntersectRayPacketSpheres<Lanes>(packet, Lanes::Set(sphere.origin.x), Lanes::Set(sphere.origin.y), Lanes::Set(sphere.origin.z),
+			Lanes::Set(sphere.radius), tHit)) & packet.activeMask;
+
+		if (t)
+		{
+			Lanes::Store(t, tHit);
+		}
+
+		return hits;
+	}
+
+#pragma endregion
+
+#pragma region Ray Packet Batches
+
+	// Spreads the low 10 bits of value so there are two zero bits between each.
+	inline uint32_t ExpandMortonBits(uint32_t value)
+	{
+		value &= 0x000003ff;
+		value = (value | (value << 16)) & 0xff0000ff;
+		value = (value | (value << 8)) & 0x0300f00f;
+		value = (value | (value << 4)) & 0x030c30c3;
+		value = (value | (value << 2)) & 0x09249249;
+		return value;
+	}
+
+	inline uint32_t QuantizeMortonAxis(float value, float minValue, float scale)
+	{
+		float q = (value - minValue) * scale;
+		return (q > 0.0f) ? ((q < 1023.0f) ? static_cast<uint32_t>(q) : 1023) : 0;
+	}
+
+	// Sorts arbitrary rays into coherent packets: first by direction octant, so every lane of a packet
+	// steps through the slabs in the same order, then along Morton curves of direction and origin.
+	template<class Lanes = RayPacketLanes>
+	struct RayPacketBatch
+	{
+		std::vector<RayPacket<Lanes>> packets;
+		uint32_t count;
+
+		RayPacketBatch() : count(0) {};
+
+		void Build(const Ray<vec3f>* rays, uint32_t rayCount)
+		{
+			count = rayCount;
+			packets.resize((rayCount + Lanes::width - 1) / Lanes::width);
+			if (rayCount == 0)
+			{
+				return;
+			}
+
+			float originMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+			float originMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (uint32_t i = 0; i < rayCount; i++)
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					originMin[axis] = (rays[i].origin[axis] < originMin[axis]) ? rays[i].origin[axis] : originMin[axis];
+					originMax[axis] = (rays[i].origin[axis] > originMax[axis]) ? rays[i].origin[axis] : originMax[axis];
+				}
+			}
+
+			float originScale[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float extent = originMax[axis] - originMin[axis];
+				originScale[axis] = (extent > 0.0f) ? 1023.0f / extent : 0.0f;
+			}
+
+			// Key layout from high to low: 3 octant bits, 30 direction Morton bits, 30 origin Morton bits.
+			std::vector<std::pair<uint64_t, uint32_t>> keys(rayCount);
+			for (uint32_t i = 0; i < rayCount; i++)
+			{
+				const Ray<vec3f>& ray = rays[i];
+
+				uint64_t octant = 0;
+				uint64_t direction = 0;
+				uint64_t origin = 0;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					octant |= static_cast<uint64_t>(ray.normal[axis] < 0.0f) << axis;
+					direction |= static_cast<uint64_t>(ExpandMortonBits(QuantizeMortonAxis(fabsf(ray.normal[axis]), 0.0f, 1023.0f))) << axis;
+					origin |= static_cast<uint64_t>(ExpandMortonBits(QuantizeMortonAxis(ray.origin[axis], originMin[axis], originScale[axis]))) << axis;
+				}
+
+				keys[i].first = (octant << 60) | (direction << 30) | origin;
+				keys[i].second = i;
+			}
+
+			std::sort(keys.begin(), keys.end());
+
+			uint32_t indices[Lanes::width];
+			for (uint32_t p = 0; p < packets.size(); p++)
+			{
+				uint32_t first = p * Lanes::width;
+				uint32_t laneCount = (rayCount - first < Lanes::width) ? rayCount - first : Lanes::width;
+				for (uint32_t lane = 0; lane < laneCount; lane++)
+				{
+					indices[lane] = keys[first + lane].second;
+				}
+
+				packets[p].Set(rays, indices, laneCount);
+			}
+		}
+	};
+
+	// Results are written in the order the rays were passed to Build. Ray i sets bit (i % 32) of hitMasks[i / 32] when it hits,
+	// hitMasks must hold (batch.count + 31) / 32 words. t receives the entry distance of every ray and must hold batch.count floats, or be null.
+	template<class Lanes>
+	uint32_t IntersectRayPacketBatchAABB(const RayPacketBatch<Lanes>& batch, const BoxCollider& aabb, uint32_t* hitMasks, float* t)
+	{
+		memset(hitMasks, 0, sizeof(uint32_t) * ((batch.count + 31) / 32));
+
+		float tLanes[Lanes::width];
+		for (const RayPacket<Lanes>& packet : batch.packets)
+		{
+			uint32_t hits = IntersectRayPacketAABB<Lanes>(packet, aabb, tLanes);
+			for (uint32_t lane = 0; lane < Lanes::width; lane++)
+			{
+				if (packet.activeMask & (1u << lane))
+				{
+					uint32_t index = packet.indices[lane];
+					hitMasks[index / 32] |= ((hits >> lane) & 1) << (index % 32);
+					if (t)
+					{
+						t[index] = tLanes[lane];
+					}
+				}
+			}
+		}
+
+		return CountHits(hitMasks, batch.count);
+	}
+
+	template<class Lanes>
+	uint32_t IntersectRayPacketBatchSphere(const RayPacketBatch<Lanes>& batch, const SphereCollider& sphere, uint32_t* hitMasks, float* t)
+	{
+		memset(hitMasks, 0, sizeof(uint32_t) * ((batch.count + 31) / 32));
+
+		float tLanes[Lanes::width];
+		for (const RayPacket<Lanes>& packet : batch.packets)
+		{
+			uint32_t hits = IntersectRayPacketSphere<Lanes>(packet, sphere, tLanes);
+			for (uint32_t lane = 0; lane < Lanes::width; lane++)
+			{
+				if (packet.activeMask & (1u << lane))
+				{
+					uint32_t index = packet.indices[lane];
+					hitMasks[index / 32] |= ((hits >> lane) & 1) << (index % 32);
+					if (t)
+					{
+						t[index] = tLanes[lane];
+					}
+				}
+			}
+		}
+
+		return CountHits(hitMasks, batch.count);
+	}
+
+	// Collider indices ride along in float lanes, which is exact below 2^24 colliders.
+	template<class Lanes>
+	uint32_t WriteRayPacketNearest(const RayPacket<Lanes>& packet, typename Lanes::Float nearest, typename Lanes::Float nearestIndex, int32_t* hitIndices, float* t)
+	{
+		float tLanes[Lanes::width];
+		float indexLanes[Lanes::width];
+		Lanes::Store(tLanes, nearest);
+		Lanes::Store(indexLanes, nearestIndex);
+
+		uint32_t hitCount = 0;
+		for (uint32_t lane = 0; lane < Lanes::width; lane++)
+		{
+			if (packet.activeMask & (1u << lane))
+			{
+				uint32_t index = packet.indices[lane];
+				hitIndices[index] = static_cast<int32_t>(indexLanes[lane]);
+				hitCount += (indexLanes[lane] >= 0.0f) ? 1 : 0;
+				if (t)
+				{
+					t[index] = tLanes[lane];
+				}
+			}
+		}
+
+		return hitCount;
+	}
+
+	// Nearest collider along each ray, for picking and visibility. hitIndices[i] is -1 when ray i misses everything.
+	// Each packet carries its closest distances so far as the slab limit, so farther boxes drop out after their first slab.
+	template<class Lanes>
+	uint32_t IntersectRayPacketBatchNearest(const RayPacketBatch<Lanes>& batch, const AABBColliderBatch& colliders, int32_t* hitIndices, float* t)
+	{
+		typedef typename Lanes::Float Float;
+		typedef typename Lanes::Mask Mask;
+
+		uint32_t hitCount = 0;
+		for (const RayPacket<Lanes>& packet : batch.packets)
+		{
+			Float nearest = Lanes::Set(FLT_MAX);
+			Float nearestIndex = Lanes::Set(-1.0f);
+
+			for (uint32_t i = 0; i < colliders.count; i++)
+			{
+				Float aabbMin[3] = { Lanes::Set(colliders.minX[i]), Lanes::Set(colliders.minY[i]), Lanes::Set(colliders.minZ[i]) };
+				Float aabbMax[3] = { Lanes::Set(colliders.maxX[i]), Lanes::Set(colliders.maxY[i]), Lanes::Set(colliders.maxZ[i]) };
+
+				Float tMin;
+				Mask hit = IntersectRayPacketSlabs<Lanes>(packet, aabbMin, aabbMax, nearest, tMin);
+				hit = Lanes::And(hit, Lanes::Less(tMin, nearest));
+				if (Lanes::Bits(hit) == 0)
+				{
+					continue;
+				}
+
+				nearest = Lanes::Select(hit, tMin, nearest);
+				nearestIndex = Lanes::Select(hit, Lanes::Set(static_cast<float>(i)), nearestIndex);
+			}
+
+			hitCount += WriteRayPacketNearest<Lanes>(packet, nearest, nearestIndex, hitIndices, t);
+		}
+
+		return hitCount;
+	}
+
+	template<class Lanes>
+	uint32_t IntersectRayPacketBatchNearest(const RayPacketBatch<Lanes>& batch, const SphereColliderBatch& colliders, int32_t* hitIndices, float* t)
+	{
+		typedef typename Lanes::Float Float;
+		typedef typename Lanes::Mask Mask;
+
+		uint32_t hitCount = 0;
+		for (const RayPacket<Lanes>& packet : batch.packets)
+		{
+			Float nearest = Lanes::Set(FLT_MAX);
+			Float nearestIndex = Lanes::Set(-1.0f);
+
+			for (uint32_t i = 0; i < colliders.count; i++)
+			{
+				Float tHit;
+				Mask hit = IntersectRayPacketSpheres<Lanes>(packet, Lanes::Set(colliders.x[i]), Lanes::Set(colliders.y[i]), Lanes::Set(colliders.z[i]),
+					Lanes::Set(colliders.radius[i]), tHit);
+				hit = Lanes::And(hit, Lanes::Less(tHit, nearest));
+				if (Lanes::Bits(hit) == 0)
+				{
+					continue;
+				}
+
+				nearest = Lanes::Select(hit, tHit, nearest);
+				nearestIndex = Lanes::Select(hit, Lanes::Set(static_cast<float>(i)), nearestIndex);
+			}
+
+			hitCount += WriteRayPacketNearest<Lanes>(packet, nearest, nearestIndex, hitIndices, t);
+		}
+
+		return hitCount;
+	}
+
+#pragma endregion
+}
@@ -0,0 +1,381 @@
+#include "RigidBodySystem.h"
+#include "ColliderBatch.h"
+#include "TaskDispatch/TaskDispatcher.h"
+#include <algorithm>
+
+using namespace Rig3D;
+using namespace cliqCity::multicore;
+
+namespace
+{
+	typedef NativeFloatLanes	Lanes;
+	typedef Lanes::Float		Float;
+
+	struct QuaternionLanes
+	{
+		Float w, x, y, z;
+	};
+
+	// Rate of change of q under angular velocity w, q' = 0.5 * q * (0, w).
+	inline QuaternionLanes Spin(const QuaternionLanes& q, Float wx, Float wy, Float wz)
+	{
+		Float half = Lanes::Set(0.5f);
+
+		QuaternionLanes d;
+		d.w = Lanes::Mul(Lanes::Negate(Lanes::Add(Lanes::Add(Lanes::Mul(q.x, wx), Lanes::Mul(q.y, wy)), Lanes::Mul(q.z, wz))), half);
+		d.x = Lanes::Mul(Lanes::Sub(Lanes::Add(Lanes::Mul(q.w, wx), Lanes::Mul(q.y, wz)), Lanes::Mul(q.z, wy)), half);
+		d.y = Lanes::Mul(Lanes::Sub(Lanes::Add(Lanes::Mul(q.w, wy), Lanes::Mul(q.z, wx)), Lanes::Mul(q.x, wz)), half);
+		d.z = Lanes::Mul(Lanes::Sub(Lanes::Add(Lanes::Mul(q.w, wz), Lanes::Mul(q.x, wy)), Lanes::Mul(q.y, wx)), half);
+		return d;
+	}
+
+	// q + d * h
+	inline QuaternionLanes Step(const QuaternionLanes& q, const QuaternionLanes& d, Float h)
+	{
+		QuaternionLanes r;
+		r.w = Lanes::Add(q.w, Lanes::Mul(d.w, h));
+		r.x = Lanes::Add(q.x, Lanes::Mul(d.x, h));
+		r.y = Lanes::Add(q.y, Lanes::Mul(d.y, h));
+		r.z = Lanes::Add(q.z, Lanes::Mul(d.z, h));
+		return r;
+	}
+
+	inline QuaternionLanes LoadOrientation(float* const* streams, uint32_t i)
+	{
+		QuaternionLanes q;
+		q.w = Lanes::Load(streams[RIGID_BODY_ORIENTATION_W] + i);
+		q.x = Lanes::Load(streams[RIGID_BODY_ORIENTATION_X] + i);
+		q.y = Lanes::Load(streams[RIGID_BODY_ORIENTATION_Y] + i);
+		q.z = Lanes::Load(streams[RIGID_BODY_ORIENTATION_Z] + i);
+		return q;
+	}
+
+	inline void StoreNormalizedOrientation(float* const* streams, uint32_t i, const QuaternionLanes& q)
+	{
+		Float lengthSquared = Lanes::Add(Lanes::Add(Lanes::Mul(q.w, q.w), Lanes::Mul(q.x, q.x)), Lanes::Add(Lanes::Mul(q.y, q.y), Lanes::Mul(q.z, q.z)));
+		Float inverseLength = Lanes::Div(Lanes::Set(1.0f), Lanes::Sqrt(lengthSquared));
+
+		Lanes::Store(streams[RIGID_BODY_ORIENTATION_W] + i, Lanes::Mul(q.w, inverseLength));
+		Lanes::Store(streams[RIGID_BODY_ORIENTATION_X] + i, Lanes::Mul(q.x, inverseLength));
+		Lanes::Store(streams[RIGID_BODY_ORIENTATION_Y] + i, Lanes::Mul(q.y, inverseLength));
+		Lanes::Store(streams[RIGID_BODY_ORIENTATION_Z] + i, Lanes::Mul(q.z, inverseLength));
+	}
+
+	inline void IntegrateVelocityGroup(float* const* streams, uint32_t i, Float h)
+	{
+		Float inverseMass = Lanes::Load(streams[RIGID_BODY_INVERSE_MASS] + i);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Float a = Lanes::Mul(Lanes::Load(streams[RIGID_BODY_FORCE_X + axis] + i), inverseMass);
+			Float v = Lanes::Add(Lanes::Load(streams[RIGID_BODY_VELOCITY_X + axis] + i), Lanes::Mul(a, h));
+			Lanes::Store(streams[RIGID_BODY_VELOCITY_X + axis] + i, v);
+
+			Float alpha = Lanes::Mul(Lanes::Load(streams[RIGID_BODY_TORQUE_X + axis] + i), Lanes::Load(streams[RIGID_BODY_INVERSE_INERTIA_X + axis] + i));
+			Float w = Lanes::Add(Lanes::Load(streams[RIGID_BODY_ANGULAR_VELOCITY_X + axis] + i), Lanes::Mul(alpha, h));
+			Lanes::Store(streams[RIGID_BODY_ANGULAR_VELOCITY_X + axis] + i, w);
+		}
+	}
+
+	inline void IntegratePositionGroup(float* const* streams, uint32_t i, Float h)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Float p = Lanes::Add(Lanes::Load(streams[RIGID_BODY_POSITION_X + axis] + i), Lanes::Mul(Lanes::Load(streams[RIGID_BODY_VELOCITY_X + axis] + i), h));
+			Lanes::Store(streams[RIGID_BODY_POSITION_X + axis] + i, p);
+		}
+
+		Float wx = Lanes::Load(streams[RIGID_BODY_ANGULAR_VELOCITY_X] + i);
+		Float wy = Lanes::Load(streams[RIGID_BODY_ANGULAR_VELOCITY_Y] + i);
+		Float wz = Lanes::Load(streams[RIGID_BODY_ANGULAR_VELOCITY_Z] + i);
+
+		QuaternionLanes q = LoadOrientation(streams, i);
+		StoreNormalizedOrientation(streams, i, Step(q, Spin(q, wx, wy, wz), h));
+	}
+
+	inline void IntegrateRK4Group(float* const* streams, uint32_t i, Float h)
+	{
+		Float halfH = Lanes::Mul(h, Lanes::Set(0.5f));
+		Float inverseMass = Lanes::Load(streams[RIGID_BODY_INVERSE_MASS] + i);
+
+		// Constant acceleration, so the weighted stages reduce to the exact p + (v + a * h / 2) * h.
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Float a = Lanes::Mul(Lanes::Load(streams[RIGID_BODY_FORCE_X + axis] + i), inverseMass);
+			Float v = Lanes::Load(streams[RIGID_BODY_VELOCITY_X + axis] + i);
+			Float p = Lanes::Add(Lanes::Load(streams[RIGID_BODY_POSITION_X + axis] + i), Lanes::Mul(Lanes::Add(v, Lanes::Mul(a, halfH)), h));
+
+			Lanes::Store(streams[RIGID_BODY_POSITION_X + axis] + i, p);
+			Lanes::Store(streams[RIGID_BODY_VELOCITY_X + axis] + i, Lanes::Add(v, Lanes::Mul(a, h)));
+		}
+
+		// Angular velocity at the start, middle and end of the step.
+		Float w0[3], wh[3], w1[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Float alpha = Lanes::Mul(Lanes::Load(streams[RIGID_BODY_TORQUE_X + axis] + i), Lanes::Load(streams[RIGID_BODY_INVERSE_INERTIA_X + axis] + i));
+			w0[axis] = Lanes::Load(streams[RIGID_BODY_ANGULAR_VELOCITY_X + axis] + i);
+			wh[axis] = Lanes::Add(w0[axis], Lanes::Mul(alpha, halfH));
+			w1[axis] = Lanes::Add(w0[axis], Lanes::Mul(alpha, h));
+			Lanes::Store(streams[RIGID_BODY_ANGULAR_VELOCITY_X + axis] + i, w1[axis]);
+		}
+
+		QuaternionLanes q = LoadOrientation(streams, i);
+		QuaternionLanes k1 = Spin(q, w0[0], w0[1], w0[2]);
+		QuaternionLanes k2 = Spin(Step(q, k1, halfH), wh[0], wh[1], wh[2]);
+		QuaternionLanes k3 = Spin(Step(q, k2, halfH), wh[0], wh[1], wh[2]);
+		QuaternionLanes k4 = Spin(Step(q, k3, h), w1[0], w1[1], w1[2]);
+
+		Float two = Lanes::Set(2.0f);
+		QuaternionLanes sum;
+		sum.w = Lanes::Add(Lanes::Add(k1.w, Lanes::Mul(two, Lanes::Add(k2.w, k3.w))), k4.w);
+		sum.x = Lanes::Add(Lanes::Add(k1.x, Lanes::Mul(two, Lanes::Add(k2.x, k3.x))), k4.x);
+		sum.y = Lanes::Add(Lanes::Add(k1.y, Lanes::Mul(two, Lanes::Add(k2.y, k3.y))), k4.y);
+		sum.z = Lanes::Add(Lanes::Add(k1.z, Lanes::Mul(two, Lanes::Add(k2.z, k3.z))), k4.z);
+
+		StoreNormalizedOrientation(streams, i, Step(q, sum, Lanes::Div(h, Lanes::Set(6.0f))));
+	}
+}
+
+RigidBodySystem::RigidBodySystem() : mCount(0)
+{
+
+}
+
+RigidBodySystem::~RigidBodySystem()
+{
+
+}
+
+uint32_t RigidBodySystem::AddBody(const vec3f& position, float inverseMass, const vec3f& inverseInertia)
+{
+	if (mCount == mStreams[0].size())
+	{
+		size_t size = mStreams[0].size() + RIG_COLLIDER_BATCH_PADDING;
+		for (int s = 0; s < RIGID_BODY_STREAM_COUNT; s++)
+		{
+			// Padding bodies keep a unit orientation so normalizing them stays finite.
+			mStreams[s].resize(size, (s == RIGID_BODY_ORIENTATION_W) ? 1.0f : 0.0f);
+		}
+	}
+
+	uint32_t index = mCount++;
+	SetPosition(index, position);
+	SetInverseMass(index, inverseMass);
+	SetInverseInertia(index, inverseInertia);
+	return index;
+}
+
+void RigidBodySystem::Clear()
+{
+	for (int s = 0; s < RIGID_BODY_STREAM_COUNT; s++)
+	{
+		mStreams[s].clear();
+	}
+
+	mCount = 0;
+}
+
+uint32_t RigidBodySystem::GetCount() const
+{
+	return mCount;
+}
+
+#pragma region Accessors
+
+vec3f RigidBodySystem::GetPosition(uint32_t index) const
+{
+	vec3f position = { mStreams[RIGID_BODY_POSITION_X][index], mStreams[RIGID_BODY_POSITION_Y][index], mStreams[RIGID_BODY_POSITION_Z][index] };
+	return position;
+}
+
+void RigidBodySystem::SetPosition(uint32_t index, const vec3f& position)
+{
+	mStreams[RIGID_BODY_POSITION_X][index] = position.x;
+	mStreams[RIGID_BODY_POSITION_Y][index] = position.y;
+	mStreams[RIGID_BODY_POSITION_Z][index] = position.z;
+}
+
+vec3f RigidBodySystem::GetVelocity(uint32_t index) const
+{
+	vec3f velocity = { mStreams[RIGID_BODY_VELOCITY_X][index], mStreams[RIGID_BODY_VELOCITY_Y][index], mStreams[RIGID_BODY_VELOCITY_Z][index] };
+	return velocity;
+}
+
+void RigidBodySystem::SetVelocity(uint32_t index, const vec3f& velocity)
+{
+	mStreams[RIGID_BODY_VELOCITY_X][index] = velocity.x;
+	mStreams[RIGID_BODY_VELOCITY_Y][index] = velocity.y;
+	mStreams[RIGID_BODY_VELOCITY_Z][index] = velocity.z;
+}
+
+quatf RigidBodySystem::GetOrientation(uint32_t index) const
+{
+	quatf orientation = { mStreams[RIGID_BODY_ORIENTATION_W][index], mStreams[RIGID_BODY_ORIENTATION_X][index], mStreams[RIGID_BODY_ORIENTATION_Y][index], mStreams[RIGID_BODY_ORIENTATION_Z][index] };
+	return orientation;
+}
+
+void RigidBodySystem::SetOrientation(uint32_t index, const quatf& orientation)
+{
+	mStreams[RIGID_BODY_ORIENTATION_W][index] = orientation.w;
+	mStreams[RIGID_BODY_ORIENTATION_X][index] = orientation.v.x;
+	mStreams[RIGID_BODY_ORIENTATION_Y][index] = orientation.v.y;
+	mStreams[RIGID_BODY_ORIENTATION_Z][index] = orientation.v.z;
+}
+
+vec3f RigidBodySystem::GetAngularVelocity(uint32_t index) const
+{
+	vec3f angularVelocity = { mStreams[RIGID_BODY_ANGULAR_VELOCITY_X][index], mStreams[RIGID_BODY_ANGULAR_VELOCITY_Y][index], mStreams[RIGID_BODY_ANGULAR_VELOCITY_Z][index] };
+	return angularVelocity;
+}
+
+void RigidBodySystem::SetAngularVelocity(uint32_t index, const vec3f& angularVelocity)
+{
+	mStreams[RIGID_BODY_ANGULAR_VELOCITY_X][index] = angularVelocity.x;
+	mStreams[RIGID_BODY_ANGULAR_VELOCITY_Y][index] = angularVelocity.y;
+	mStreams[RIGID_BODY_ANGULAR_VELOCITY_Z][index] = angularVelocity.z;
+}
+
+float RigidBodySystem::GetInverseMass(uint32_t index) const
+{
+	return mStreams[RIGID_BODY_INVERSE_MASS][index];
+}
+
+void RigidBodySystem::SetInverseMass(uint32_t index, float inverseMass)
+{
+	mStreams[RIGID_BODY_INVERSE_MASS][index] = inverseMass;
+}
+
+vec3f RigidBodySystem::GetInverseInertia(uint32_t index) const
+{
+	vec3f inverseInertia = { mStreams[RIGID_BODY_INVERSE_INERTIA_X][index], mStreams[RIGID_BODY_INVERSE_INERTIA_Y][index], mStreams[RIGID_BODY_INVERSE_INERTIA_Z][index] };
+	return inverseInertia;
+}
+
+void RigidBodySystem::SetInverseInertia(uint32_t index, const vec3f& inverseInertia)
+{
+	mStreams[RIGID_BODY_INVERSE_INERTIA_X][index] = inverseInertia.x;
+	mStreams[RIGID_BODY_INVERSE_INERTIA_Y][index] = inverseInertia.y;
+	mStreams[RIGID_BODY_INVERSE_INERTIA_Z][index] = inverseInertia.z;
+}
+
+vec3f RigidBodySystem::GetForce(uint32_t index) const
+{
+	vec3f force = { mStreams[RIGID_BODY_FORCE_X][index], mStreams[RIGID_BODY_FORCE_Y][index], mStreams[RIGID_BODY_FORCE_Z][index] };
+	return force;
+}
+
+vec3f RigidBodySystem::GetTorque(uint32_t index) const
+{
+	vec3f torque = { mStreams[RIGID_BODY_TORQUE_X][index], mStreams[RIGID_BODY_TORQUE_Y][index], mStreams[RIGID_BODY_TORQUE_Z][index] };
+	return torque;
+}
+
+void RigidBodySystem::AddForce(uint32_t index, const vec3f& force)
+{
+	mStreams[RIGID_BODY_FORCE_X][index] += force.x;
+	mStreams[RIGID_BODY_FORCE_Y][index] += force.y;
+	mStreams[RIGID_BODY_FORCE_Z][index] += force.z;
+}
+
+void RigidBodySystem::AddTorque(uint32_t index, const vec3f& torque)
+{
+	mStreams[RIGID_BODY_TORQUE_X][index] += torque.x;
+	mStreams[RIGID_BODY_TORQUE_Y][index] += torque.y;
+	mStreams[RIGID_BODY_TORQUE_Z][index] += torque.z;
+}
+
+void RigidBodySystem::ClearForces()
+{
+	for (int s = RIGID_BODY_FORCE_X; s <= RIGID_BODY_FORCE_Z; s++)
+	{
+		std::fill(mStreams[s].begin(), mStreams[s].end(), 0.0f);
+	}
+
+	for (int s = RIGID_BODY_TORQUE_X; s <= RIGID_BODY_TORQUE_Z; s++)
+	{
+		std::fill(mStreams[s].begin(), mStreams[s].end(), 0.0f);
+	}
+}
+
+float* RigidBodySystem::GetStream(RigidBodyStream stream)
+{
+	return mStreams[stream].data();
+}
+
+const float* RigidBodySystem::GetStream(RigidBodyStream stream) const
+{
+	return mStreams[stream].data();
+}
+
+#pragma endregion
+
+#pragma region Integration
+
+template<class Kernel>
+void RigidBodySystem::Integrate(const Kernel& kernel, TaskDispatcher* dispatcher)
+{
+	float* streams[RIGID_BODY_STREAM_COUNT];
+	for (int s = 0; s < RIGID_BODY_STREAM_COUNT; s++)
+	{
+		streams[s] = mStreams[s].data();
+	}
+
+	// Ranges are whole padding groups, so every SIMD width runs full lanes.
+	uint32_t groupCount = (mCount + RIG_COLLIDER_BATCH_PADDING - 1) / RIG_COLLIDER_BATCH_PADDING;
+	auto range = [&streams, &kernel](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin * RIG_COLLIDER_BATCH_PADDING; i < end * RIG_COLLIDER_BATCH_PADDING; i += Lanes::width)
+		{
+			kernel(streams, i);
+		}
+	};
+
+	if (dispatcher)
+	{
+		dispatcher->ParallelFor(0, groupCount, RIG_RIGID_BODY_GRAIN_SIZE / RIG_COLLIDER_BATCH_PADDING, range);
+	}
+	else
+	{
+		range(0, groupCount);
+	}
+}
+
+void RigidBodySystem::IntegrateEuler(float dt, TaskDispatcher* dispatcher)
+{
+	Float h = Lanes::Set(dt);
+	Integrate([h](float* const* streams, uint32_t i)
+	{
+		IntegrateVelocityGroup(streams, i, h);
+		IntegratePositionGroup(streams, i, h);
+	}, dispatcher);
+}
+
+void RigidBodySystem::IntegrateRK4(float dt, TaskDispatcher* dispatcher)
+{
+	Float h = Lanes::Set(dt);
+	Integrate([h](float* const* streams, uint32_t i)
+	{
+		IntegrateRK4Group(streams, i, h);
+	}, dispatcher);
+}
+
+void RigidBodySystem::IntegrateVelocities(float dt, TaskDispatcher* dispatcher)
+{
+	Float h = Lanes::Set(dt);
+	Integrate([h](float* const* streams, uint32_t i)
+	{
+		IntegrateVelocityGroup(streams, i, h);
+	}, dispatcher);
+}
+
+void RigidBodySystem::IntegratePositions(float dt, TaskDispatcher* dispatcher)
+{
+	Float h = Lanes::Set(dt);
+	Integrate([h](float* const* streams, uint32_t i)
+	{
+		IntegratePositionGroup(streams, i, h);
+	}, dispatcher);
+}
+
+#pragma endregion
@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Parametric.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+// Bodies are integrated in ranges of this many per task when a dispatcher is given.
+#define RIG_RIGID_BODY_GRAIN_SIZE	2048
+
+namespace cliqCity
+{
+	namespace multicore
+	{
+		class TaskDispatcher;
+	}
+}
+
+namespace Rig3D
+{
+	enum RigidBodyStream
+	{
+		RIGID_BODY_POSITION_X,
+		RIGID_BODY_POSITION_Y,
+		RIGID_BODY_POSITION_Z,
+		RIGID_BODY_VELOCITY_X,
+		RIGID_BODY_VELOCITY_Y,
+		RIGID_BODY_VELOCITY_Z,
+		RIGID_BODY_FORCE_X,
+		RIGID_BODY_FORCE_Y,
+		RIGID_BODY_FORCE_Z,
+		RIGID_BODY_ORIENTATION_W,
+		RIGID_BODY_ORIENTATION_X,
+		RIGID_BODY_ORIENTATION_Y,
+		RIGID_BODY_ORIENTATION_Z,
+		RIGID_BODY_ANGULAR_VELOCITY_X,
+		RIGID_BODY_ANGULAR_VELOCITY_Y,
+		RIGID_BODY_ANGULAR_VELOCITY_Z,
+		RIGID_BODY_TORQUE_X,
+		RIGID_BODY_TORQUE_Y,
+		RIGID_BODY_TORQUE_Z,
+		RIGID_BODY_INVERSE_MASS,
+		RIGID_BODY_INVERSE_INERTIA_X,
+		RIGID_BODY_INVERSE_INERTIA_Y,
+		RIGID_BODY_INVERSE_INERTIA_Z,
+		RIGID_BODY_STREAM_COUNT
+	};
+
+	// Rigid body state stored as one float stream per component, padded to RIG_COLLIDER_BATCH_PADDING so the integrators run whole
+	// SIMD groups. Padding bodies have no inverse mass and never move. Inverse inertia is a diagonal in world axes, which is exact for spheres
+	// and other bodies whose inertia is the same about every axis. Forces and torques accumulate until ClearForces, so a frame's forces
+	// can be applied over several fixed substeps. Integration runs across the dispatcher's workers when one is given.
+	class RIG3D RigidBodySystem
+	{
+	public:
+		RigidBodySystem();
+		~RigidBodySystem();
+
+		// New bodies are at rest with the identity orientation. Returns the body's index.
+		uint32_t	AddBody(const vec3f& position, float inverseMass, const vec3f& inverseInertia);
+		void		Clear();
+		uint32_t	GetCount() const;
+
+		vec3f		GetPosition(uint32_t index) const;
+		void		SetPosition(uint32_t index, const vec3f& position);
+		vec3f		GetVelocity(uint32_t index) const;
+		void		SetVelocity(uint32_t index, const vec3f& velocity);
+		quatf		GetOrientation(uint32_t index) const;
+		void		SetOrientation(uint32_t index, const quatf& orientation);
+		vec3f		GetAngularVelocity(uint32_t index) const;
+		void		SetAngularVelocity(uint32_t index, const vec3f& angularVelocity);
+		float		GetInverseMass(uint32_t index) const;
+		void		SetInverseMass(uint32_t index, float inverseMass);
+		vec3f		GetInverseInertia(uint32_t index) const;
+		void		SetInverseInertia(uint32_t index, const vec3f& inverseInertia);
+
+		vec3f		GetForce(uint32_t index) const;
+		vec3f		GetTorque(uint32_t index) const;
+		void		AddForce(uint32_t index, const vec3f& force);
+		void		AddTorque(uint32_t index, const vec3f& torque);
+		void		ClearForces();
+
+		// Holds GetCount() values followed by padding.
+		float*			GetStream(RigidBodyStream stream);
+		const float*	GetStream(RigidBodyStream stream) const;
+
+		// Semi-implicit Euler: velocities take the accumulated forces first and positions and orientations move with the new velocities.
+		void		IntegrateEuler(float dt, cliqCity::multicore::TaskDispatcher* dispatcher = nullptr);
+
+		// Classic fourth order Runge-Kutta with forces held constant over the step, so positions and velocities are exact and
+		// orientations follow the angular velocity as it changes during the step.
+		void		IntegrateRK4(float dt, cliqCity::multicore::TaskDispatcher* dispatcher = nullptr);
+
+		// The two halves of IntegrateEuler, for callers that move bodies between velocity changes, such as an event driven simulation.
+		void		IntegrateVelocities(float dt, cliqCity::multicore::TaskDispatcher* dispatcher = nullptr);
+		void		IntegratePositions(float dt, cliqCity::multicore::TaskDispatcher* dispatcher = nullptr);
+
+	private:
+		std::vector<float>	mStreams[RIGID_BODY_STREAM_COUNT];
+		uint32_t			mCount;
+
+		template<class Kernel>
+		void		Integrate(const Kernel& kernel, cliqCity::multicore::TaskDispatcher* dispatcher);
+
+		RigidBodySystem(RigidBodySystem const&) = delete;
+		void operator=(RigidBodySystem const&) = delete;
+	};
+}
@@ -0,0 +1,334 @@
+#include "SweepAndPrune.h"
+#include <algorithm>
+
+using namespace Rig3D;
+
+SweepAndPrune::SweepAndPrune(SweepAndPruneAxis axis) :
+	mAxis(axis),
+	mSortAxis((axis == SAP_AXIS_AUTO) ? 0 : static_cast<uint32_t>(axis)),
+	mSortedCount(0),
+	mFreeList(RIG_SAP_NULL_PROXY),
+	mProxyCount(0),
+	mMaxExtent(0.0f),
+	mIsDirty(false),
+	mIsAxisChanged(false)
+{
+
+}
+
+SweepAndPrune::~SweepAndPrune()
+{
+
+}
+
+uint32_t SweepAndPrune::CreateProxy(const BoxCollider& aabb, void* userData)
+{
+	uint32_t proxyID = mFreeList;
+	if (proxyID == RIG_SAP_NULL_PROXY)
+	{
+		proxyID = static_cast<uint32_t>(mProxies.size());
+		mProxies.push_back(Proxy());
+	}
+	else
+	{
+		mFreeList = mProxies[proxyID].nextFree;
+	}
+
+	Proxy& proxy = mProxies[proxyID];
+	proxy.userData = userData;
+	proxy.nextFree = RIG_SAP_NULL_PROXY;
+	proxy.isAlive = true;
+
+	Entry entry;
+	entry.proxyID = proxyID;
+	mEntries.push_back(entry);
+
+	MoveProxy(proxyID, aabb);
+
+	mProxyCount++;
+	return proxyID;
+}
+
+void SweepAndPrune::DestroyProxy(uint32_t proxyID)
+{
+	// The entry is dropped on the next update. Until then the ID is held back so no new proxy can share it.
+	mProxies[proxyID].isAlive = false;
+	mDestroyed.push_back(proxyID);
+	mProxyCount--;
+	mIsDirty = true;
+}
+
+void SweepAndPrune::MoveProxy(uint32_t proxyID, const BoxCollider& aabb)
+{
+	Proxy& proxy = mProxies[proxyID];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		proxy.min[axis] = aabb.origin[axis] - aabb.halfSize[axis];
+		proxy.max[axis] = aabb.origin[axis] + aabb.halfSize[axis];
+	}
+
+	mIsDirty = true;
+}
+
+void* SweepAndPrune::GetUserData(uint32_t proxyID) const
+{
+	return mProxies[proxyID].userData;
+}
+
+BoxCollider SweepAndPrune::GetAABB(uint32_t proxyID) const
+{
+	const Proxy& proxy = mProxies[proxyID];
+
+	BoxCollider aabb;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		aabb.origin[axis] = (proxy.min[axis] + proxy.max[axis]) * 0.5f;
+		aabb.halfSize[axis] = (proxy.max[axis] - proxy.min[axis]) * 0.5f;
+	}
+
+	return aabb;
+}
+
+void SweepAndPrune::Query(const BoxCollider& aabb, std::vector<uint32_t>& proxyIDs)
+{
+	Update();
+
+	// Same axis order as the entries.
+	float min[3];
+	float max[3];
+	for (uint32_t slot = 0; slot < 3; slot++)
+	{
+		uint32_t axis = (mSortAxis + slot) % 3;
+		min[slot] = aabb.origin[axis] - aabb.halfSize[axis];
+		max[slot] = aabb.origin[axis] + aabb.halfSize[axis];
+	}
+
+	// No box starting before this can reach the query.
+	std::vector<Entry>::const_iterator it = std::lower_bound(mEntries.begin(), mEntries.end(), min[0] - mMaxExtent,
+		[](const Entry& entry, float value) { return entry.min[0] < value; });
+
+	for (; it != mEntries.end() && it->min[0] <= max[0]; ++it)
+	{
+		if (it->max[1] >= min[1] && it->min[1] <= max[1] &&
+			it->max[2] >= min[2] && it->min[2] <= max[2] &&
+			it->max[0] >= min[0])
+		{
+			proxyIDs.push_back(it->proxyID);
+		}
+	}
+}
+
+void SweepAndPrune::FindPairs(std::vector<SweepAndPrunePair>& pairs)
+{
+	Update();
+
+	const Entry* entries = mEntries.data();
+	uint32_t count = static_cast<uint32_t>(mEntries.size());
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const Entry& a = entries[i];
+
+		// Every box that starts before a ends overlaps it on the sort axis.
+		for (uint32_t j = i + 1; j < count && entries[j].min[0] <= a.max[0]; j++)
+		{
+			// Most candidates miss, so test every side at once rather than branch on each.
+			const Entry& b = entries[j];
+			bool isOverlapping = (b.max[1] >= a.min[1]) & (b.min[1] <= a.max[1]) & (b.max[2] >= a.min[2]) & (b.min[2] <= a.max[2]);
+
+			if (!isOverlapping)
+			{
+				continue;
+			}
+
+			SweepAndPrunePair pair = { std::min(a.proxyID, b.proxyID), std::max(a.proxyID, b.proxyID) };
+			pairs.push_back(pair);
+		}
+	}
+}
+
+void SweepAndPrune::SetAxis(SweepAndPruneAxis axis)
+{
+	mAxis = axis;
+
+	if (axis != SAP_AXIS_AUTO && static_cast<uint32_t>(axis) != mSortAxis)
+	{
+		mSortAxis = static_cast<uint32_t>(axis);
+		mIsAxisChanged = true;
+		mIsDirty = true;
+	}
+}
+
+SweepAndPruneAxis SweepAndPrune::GetAxis() const
+{
+	return mAxis;
+}
+
+uint32_t SweepAndPrune::GetSortAxis() const
+{
+	return mSortAxis;
+}
+
+void SweepAndPrune::Clear()
+{
+	mProxies.clear();
+	mEntries.clear();
+	mDestroyed.clear();
+	mSortedCount = 0;
+	mFreeList = RIG_SAP_NULL_PROXY;
+	mProxyCount = 0;
+	mMaxExtent = 0.0f;
+	mIsDirty = false;
+	mIsAxisChanged = false;
+}
+
+uint32_t SweepAndPrune::GetProxyCount() const
+{
+	return mProxyCount;
+}
+
+void SweepAndPrune::Update()
+{
+	if (!mIsDirty)
+	{
+		return;
+	}
+
+	if (mAxis == SAP_AXIS_AUTO)
+	{
+		uint32_t axis = ChooseAxis();
+		if (axis != mSortAxis)
+		{
+			mSortAxis = axis;
+			mIsAxisChanged = true;
+		}
+	}
+
+	// Drop the entries of destroyed proxies and copy in the latest boxes, keeping the order from the last update.
+	uint32_t count = 0;
+	uint32_t sortedCount = 0;
+	for (uint32_t i = 0; i < mEntries.size(); i++)
+	{
+		const Proxy& proxy = mProxies[mEntries[i].proxyID];
+		if (!proxy.isAlive)
+		{
+			continue;
+		}
+
+		Entry& entry = mEntries[count];
+		entry.proxyID = mEntries[i].proxyID;
+		for (uint32_t slot = 0; slot < 3; slot++)
+		{
+			uint32_t axis = (mSortAxis + slot) % 3;
+			entry.min[slot] = proxy.min[axis];
+			entry.max[slot] = proxy.max[axis];
+		}
+
+		sortedCount += (i < mSortedCount) ? 1 : 0;
+		count++;
+	}
+
+	mEntries.resize(count);
+
+	for (uint32_t proxyID : mDestroyed)
+	{
+		mProxies[proxyID].nextFree = mFreeList;
+		mFreeList = proxyID;
+	}
+
+	mDestroyed.clear();
+
+	auto isLess = [](const Entry& a, const Entry& b) { return a.min[0] < b.min[0]; };
+
+	if (mIsAxisChanged)
+	{
+		std::sort(mEntries.begin(), mEntries.end(), isLess);
+		mIsAxisChanged = false;
+	}
+	else
+	{
+		// Boxes move little between frames, so each entry only shifts a few places.
+		Entry* entries = mEntries.data();
+		for (uint32_t i = 1; i < sortedCount; i++)
+		{
+			float key = entries[i].min[0];
+			if (entries[i - 1].min[0] <= key)
+			{
+				continue;
+			}
+
+			Entry entry = entries[i];
+			uint32_t j = i;
+			for (; j > 0 && entries[j - 1].min[0] > key; j--)
+			{
+				entries[j] = entries[j - 1];
+			}
+
+			entries[j] = entry;
+		}
+
+		// New boxes can land anywhere, so they are sorted on their own and merged in.
+		std::sort(mEntries.begin() + sortedCount, mEntries.end(), isLess);
+		std::inplace_merge(mEntries.begin(), mEntries.begin() + sortedCount, mEntries.end(), isLess);
+	}
+
+	mMaxExtent = 0.0f;
+	for (const Entry& entry : mEntries)
+	{
+		mMaxExtent = std::max(mMaxExtent, entry.max[0] - entry.min[0]);
+	}
+
+	mSortedCount = count;
+	mIsDirty = false;
+}
+
+uint32_t SweepAndPrune::ChooseAxis() const
+{
+	if (mProxyCount == 0)
+	{
+		return mSortAxis;
+	}
+
+	// Variance of the box centers along each axis.
+	float sum[3] = { 0.0f, 0.0f, 0.0f };
+	float sumSquared[3] = { 0.0f, 0.0f, 0.0f };
+	for (const Proxy& proxy : mProxies)
+	{
+		if (!proxy.isAlive)
+		{
+			continue;
+		}
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float center = (proxy.min[axis] + proxy.max[axis]) * 0.5f;
+			sum[axis] += center;
+			sumSquared[axis] += center * center;
+		}
+	}
+
+	float variance[3];
+	float ood = 1.0f / static_cast<float>(mProxyCount);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float mean = sum[axis] * ood;
+		variance[axis] = sumSquared[axis] * ood - mean * mean;
+	}
+
+	uint32_t best = mSortAxis;
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		if (variance[axis] > variance[best])
+		{
+			best = axis;
+		}
+	}
+
+	// With nothing sorted yet any axis is free. Otherwise only switch for a clear gain, the full sort is not free.
+	if (mSortedCount == 0 || variance[best] > RIG_SAP_AXIS_SWITCH_RATIO * variance[mSortAxis])
+	{
+		return best;
+	}
+
+	return mSortAxis;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Parametric.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+#define RIG_SAP_NULL_PROXY			0xffffffff
+#define RIG_SAP_AXIS_SWITCH_RATIO	1.5f
+
+namespace Rig3D
+{
+	enum SweepAndPruneAxis
+	{
+		SAP_AXIS_X,
+		SAP_AXIS_Y,
+		SAP_AXIS_Z,
+		SAP_AXIS_AUTO		// Axis along which box centers are most spread out.
+	};
+
+	struct SweepAndPrunePair
+	{
+		uint32_t proxyA;
+		uint32_t proxyB;	// Always greater than proxyA.
+	};
+
+	// Sort and sweep broadphase. Boxes are kept sorted by their lower bound on one axis with an insertion sort, which is close to
+	// linear when bodies move a little each frame. The sweep only compares boxes whose intervals overlap on that axis, so in flat
+	// scenes such as a billiards table the sort axis should lie in the plane. Moves are cheap and sorting is deferred to the next
+	// query. Proxy IDs are stable until destroyed and are not reused before the next query.
+	class RIG3D SweepAndPrune
+	{
+	public:
+		SweepAndPrune(SweepAndPruneAxis axis = SAP_AXIS_AUTO);
+		~SweepAndPrune();
+
+		uint32_t	CreateProxy(const BoxCollider& aabb, void* userData);
+		void		DestroyProxy(uint32_t proxyID);
+		void		MoveProxy(uint32_t proxyID, const BoxCollider& aabb);
+
+		void*		GetUserData(uint32_t proxyID) const;
+		BoxCollider	GetAABB(uint32_t proxyID) const;
+
+		// Appends every proxy whose box overlaps aabb.
+		void		Query(const BoxCollider& aabb, std::vector<uint32_t>& proxyIDs);
+
+		// Appends every pair of proxies whose boxes overlap, each pair once, ordered by the lower bound of proxyA's box.
+		void		FindPairs(std::vector<SweepAndPrunePair>& pairs);
+
+		// Changing the axis re-sorts every box on the next query. SAP_AXIS_AUTO only switches when another axis is
+		// RIG_SAP_AXIS_SWITCH_RATIO times as spread out, so it does not flip between similar axes every frame.
+		void				SetAxis(SweepAndPruneAxis axis);
+		SweepAndPruneAxis	GetAxis() const;
+		uint32_t			GetSortAxis() const;
+
+		void		Clear();
+		uint32_t	GetProxyCount() const;
+
+	private:
+		struct Proxy
+		{
+			float		min[3];
+			float		max[3];
+			void*		userData;
+			uint32_t	nextFree;
+			bool		isAlive;
+		};
+
+		// Copy of a proxy's box so the sweep reads memory in order. Axes are rotated so the sort axis comes first.
+		struct Entry
+		{
+			float		min[3];
+			float		max[3];
+			uint32_t	proxyID;
+		};
+
+		std::vector<Proxy>		mProxies;
+		std::vector<Entry>		mEntries;
+		std::vector<uint32_t>	mDestroyed;
+		SweepAndPruneAxis		mAxis;
+		uint32_t				mSortAxis;
+		uint32_t				mSortedCount;		// Entries before this index were sorted at the last update.
+		uint32_t				mFreeList;
+		uint32_t				mProxyCount;
+		float					mMaxExtent;			// Widest box along the sort axis, bounds how far back Query looks.
+		bool					mIsDirty;
+		bool					mIsAxisChanged;
+
+		void		Update();
+		uint32_t	ChooseAxis() const;
+
+		SweepAndPrune(SweepAndPrune const&) = delete;
+		void operator=(SweepAndPrune const&) = delete;
+	};
+}
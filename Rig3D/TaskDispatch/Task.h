@@ -2,6 +2,7 @@
 
 #pragma once
 #include <stdint.h>
+#include <atomic>
 
 #ifdef _WINDLL
 #define RIG3D __declspec(dllexport)
@@ -9,6 +10,10 @@
 #define RIG3D __declspec(dllimport)
 #endif
 
+#define TASK_CACHE_LINE_SIZE	64
+#define TASK_CLOSURE_SIZE		80			// Fills a 64 bit Task out to two cache lines.
+#define TASK_ID_INLINE_OFFSET	0xffffffff	// Work that ran on the submitting thread because no task slot was free. Always finished.
+
 namespace cliqCity
 {
 	namespace multicore
@@ -39,17 +44,40 @@ namespace cliqCity
 		};
 		
 		typedef void(*TaskKernel)(const TaskData&);
+
+		enum TaskPriority
+		{
+			TASK_PRIORITY_CRITICAL,			// Frame critical work. Always taken first.
+			TASK_PRIORITY_NORMAL,
+			TASK_PRIORITY_BACKGROUND,		// Streaming and asset loads. Only run by background workers.
+			TASK_PRIORITY_COUNT
+		};
 		
-		class RIG3D Task
+		// Two cache lines per slot. Scheduling state comes first so queueing and finishing a task mostly touch the first line.
+		// Profiler timings are kept by the TaskProfiler, not here.
+		class RIG3D alignas(TASK_CACHE_LINE_SIZE) Task
 		{
 		public:
-			char		mAlias[sizeof(void*)];
-			uint32_t	mGeneration;
-			TaskData	mData;
-			TaskKernel	mKernel;
+			std::atomic<uint32_t>	mNextFree;			// Next free slot index while the task is in the TaskPool.
+			std::atomic<uint32_t>	mGeneration;		// Odd while allocated. Released on free so waiters observe the task's results.
+			TaskKernel				mKernel;
+			Task*					mParent;
+			Task*					mNextContinuation;	// Next sibling in the ancestor's continuation list.
+			std::atomic<Task*>		mContinuations;		// Points at the task itself once it has finished.
+			std::atomic<uint32_t>	mOpenWorkCount;		// This task plus any unfinished children.
+			TaskPriority			mPriority;
+			union
+			{
+				TaskData			mData;
+				uint64_t			mClosure[TASK_CLOSURE_SIZE / sizeof(uint64_t)];	// Inline storage for callables queued with AddTask(Callable&&).
+			};
 
-			Task() : mGeneration(0), mKernel(nullptr) {};
+			Task() : mNextFree(0), mGeneration(0), mKernel(nullptr), mParent(nullptr), mNextContinuation(nullptr), mContinuations(nullptr), mOpenWorkCount(0), mPriority(TASK_PRIORITY_NORMAL), mData() {};
 			~Task() {};
 		};
+
+		static_assert(sizeof(TaskData) <= TASK_CLOSURE_SIZE, "Task data must fit in the closure storage.");
+		static_assert(sizeof(Task) <= 2 * TASK_CACHE_LINE_SIZE, "Task slots must fit in two cache lines.");
+		static_assert(sizeof(Task) % TASK_CACHE_LINE_SIZE == 0, "Task slots must be a whole number of cache lines.");
 	}
 }
\ No newline at end of file
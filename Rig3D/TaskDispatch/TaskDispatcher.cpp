@@ -1,17 +1,62 @@
 #include "TaskDispatcher.h"
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#include <emmintrin.h>
+#define TASK_DISPATCHER_PAUSE() _mm_pause()
+#else
+#define TASK_DISPATCHER_PAUSE() std::this_thread::yield()
+#endif
+
+#define TASK_DISPATCHER_MAX_BACKOFF		64
+#define TASK_DISPATCHER_MAX_HELP_DEPTH	4	// Queued tasks a thread may nest inside each other while waiting for a free slot.
+
 using namespace cliqCity::multicore;
 
+// Identifies the dispatcher and deque owned by the calling thread. Threads not started by a dispatcher share its submission queue.
+static thread_local TaskDispatcher*	tDispatcher = nullptr;
+static thread_local uint32_t		tQueueIndex = 0;
+static thread_local TaskScratchArena*	tScratchArena = nullptr;
+static thread_local uint32_t		tHelpDepth = 0;
+
 TaskDispatcher::TaskDispatcher(Thread* threads, uint8_t threadCount, void* memory, size_t size) :
-	mTaskGeneration(0),
-	mAllocator(memory, reinterpret_cast<char*>(memory) + size, sizeof(Task)),
-	mMemory(memory),
+	mSleepingThreadCount(0),
+	mTaskQueues(nullptr),
+	mTaskPool(memory, size),
 	mThreads(threads),
+	mProfiler(nullptr),
+	mSpinCount((std::thread::hardware_concurrency() > 1) ? 4096 : 0),
+	mYieldCount(16),
 	mThreadCount(threadCount),
 	mActiveThreadCount(0),
+	mBackgroundThreadCount((threadCount + 3) / 4),
+	mOwnsThreads(false),
+	mScratchArenas(nullptr),
+	mIsScratchClaimed(false),
 	mIsPaused(true)
 {
+	CreateTaskThreadLayout(GetTaskTopology(), threadCount, false, &mLayout);
+
+	for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+	{
+		mPendingTaskCounts[i] = 0;
+		mUnfinishedTaskCounts[i] = 0;
+	}
+
+	// Every queued task occupies a pool slot so no queue can hold more than the pool capacity.
+	uint32_t queueCount = (mThreadCount + 1) * TASK_PRIORITY_COUNT;
+	mTaskQueues = new TaskQueue[queueCount];
+	for (uint32_t i = 0; i < queueCount; i++)
+	{
+		mTaskQueues[i].Initialize(mTaskPool.GetCapacity());
+	}
+}
+
+TaskDispatcher::TaskDispatcher(void* memory, size_t size, bool pinThreads) : TaskDispatcher(nullptr, GetDefaultTaskThreadCount(GetTaskTopology()), memory, size)
+{
+	mThreads = new Thread[mThreadCount];
+	mOwnsThreads = true;
 
+	CreateTaskThreadLayout(GetTaskTopology(), mThreadCount, pinThreads, &mLayout);
 }
 
 TaskDispatcher::TaskDispatcher() : TaskDispatcher(nullptr, 0, nullptr, 0)
@@ -22,7 +67,7 @@ TaskDispatcher::TaskDispatcher() : TaskDispatcher(nullptr, 0, nullptr, 0)
 TaskDispatcher::~TaskDispatcher()
 {
 	// Wait for all currently executing tasks. Threads should be in waiting state.
-	while (!mTaskQueue.empty())
+	while (HasAvailableTasks(TASK_PRIORITY_BACKGROUND) && !mIsPaused)
 	{
 		std::this_thread::yield();
 	}
@@ -30,6 +75,14 @@ TaskDispatcher::~TaskDispatcher()
 	// Pause queue so threads will exit upon completion.
 	Pause();
 
+	delete[] mTaskQueues;
+	delete[] mScratchArenas;
+
+	if (mOwnsThreads)
+	{
+		delete[] mThreads;
+	}
+
 	mThreads = nullptr;
 }
 
@@ -43,7 +96,7 @@ void TaskDispatcher::Start()
 	mIsPaused = false;
 	for (int i = 0; i < mThreadCount; i++)
 	{
-		mThreads[i] = std::thread(&TaskDispatcher::ProcessTasks, this);
+		mThreads[i] = std::thread(&TaskDispatcher::ProcessTasks, this, i);
 		mActiveThreadCount++;
 	}
 }
@@ -56,6 +109,9 @@ void TaskDispatcher::Pause()
 	while (mActiveThreadCount != 0)
 	{
 		// Prompt any waiting threads to exit.
+		{
+			ScopedLock signalLock(mSignalLock);
+		}
 		mTaskSignal.notify_all();
 
 		// Wait until receiving exit signals from all threads
@@ -71,11 +127,90 @@ bool TaskDispatcher::IsPaused()
 	return mIsPaused;
 }
 
-TaskID TaskDispatcher::AddTask(const TaskData& data, TaskKernel kernel)
+void TaskDispatcher::SetBackgroundThreadCount(uint8_t count)
 {
-	Task* task = AllocateTask();
-	task->mData = data;
-	task->mKernel = kernel;
+	mBackgroundThreadCount = (count < mThreadCount) ? count : mThreadCount;
+}
+
+uint8_t TaskDispatcher::GetBackgroundThreadCount() const
+{
+	return mBackgroundThreadCount;
+}
+
+void TaskDispatcher::SetSpinPolicy(uint32_t spinCount, uint32_t yieldCount)
+{
+	mSpinCount = spinCount;
+	mYieldCount = yieldCount;
+}
+
+void TaskDispatcher::SetScratchMemory(void* memory, size_t size)
+{
+	delete[] mScratchArenas;
+	mScratchArenas = nullptr;
+
+	if (!memory)
+	{
+		return;
+	}
+
+	uint32_t arenaCount = mThreadCount + 1;
+	size_t arenaSize = size / arenaCount;
+
+	mScratchArenas = new TaskScratchArena[arenaCount];
+	for (uint32_t i = 0; i < arenaCount; i++)
+	{
+		mScratchArenas[i].Initialize(reinterpret_cast<uint8_t*>(memory) + i * arenaSize, arenaSize);
+	}
+}
+
+TaskScratchArena* TaskDispatcher::GetScratchArena()
+{
+	return tScratchArena;
+}
+
+void TaskDispatcher::SetProfiler(TaskProfiler* profiler)
+{
+	mProfiler = profiler;
+	if (mProfiler)
+	{
+		mProfiler->SetTaskCapacity(mTaskPool.GetCapacity());
+	}
+}
+
+TaskProfiler* TaskDispatcher::GetProfiler() const
+{
+	return mProfiler;
+}
+
+TaskID TaskDispatcher::CreateTask(const TaskData& data, TaskKernel kernel, TaskPriority priority)
+{
+	Task* task = InitializeTask(data, kernel, priority, nullptr);
+	return GetTaskID(task);
+}
+
+TaskID TaskDispatcher::CreateTask(const TaskData& data, TaskKernel kernel, const TaskID& parentID)
+{
+	Task* parent = GetTask(parentID);
+	Task* task = InitializeTask(data, kernel, parent ? parent->mPriority : TASK_PRIORITY_NORMAL, parent);
+	return GetTaskID(task);
+}
+
+void TaskDispatcher::RunTask(const TaskID& taskID)
+{
+	Task* task = GetTask(taskID);
+	if (task)
+	{
+		QueueTask(task);
+	}
+}
+
+TaskID TaskDispatcher::AddTask(const TaskData& data, TaskKernel kernel, TaskPriority priority)
+{
+	Task* task = TryInitializeTask(data, kernel, priority, nullptr);
+	if (!task)
+	{
+		return ExecuteInline(data, kernel, priority);
+	}
 
 	TaskID taskID = GetTaskID(task);
 
@@ -84,126 +219,675 @@ TaskID TaskDispatcher::AddTask(const TaskData& data, TaskKernel kernel)
 	return taskID;
 }
 
-void TaskDispatcher::Synchronize()
+TaskID TaskDispatcher::AddTask(const TaskData& data, TaskKernel kernel, const TaskID& parentID)
 {
-	if (mIsPaused)
+	// Children of finished or inline work have nothing to report to, so they get no parent.
+	Task* parent = GetTask(parentID);
+	TaskPriority priority = parent ? parent->mPriority : TASK_PRIORITY_NORMAL;
+	Task* task = TryInitializeTask(data, kernel, priority, parent);
+	if (!task)
 	{
-		return;
+		return ExecuteInline(data, kernel, priority);
 	}
 
-	while (!mTaskQueue.empty())
+	TaskID taskID = GetTaskID(task);
+
+	QueueTask(task);
+
+	return taskID;
+}
+
+bool TaskDispatcher::TryCreateTask(const TaskData& data, TaskKernel kernel, TaskID* taskID)
+{
+	Task* task = TryInitializeTask(data, kernel, TASK_PRIORITY_NORMAL, nullptr);
+	if (!task)
 	{
-		std::this_thread::yield();
+		return false;
 	}
 
-	// Use pause to kill any threads still executing a task
-	Pause();
+	*taskID = GetTaskID(task);
+	return true;
+}
+
+bool TaskDispatcher::TryAddTask(const TaskData& data, TaskKernel kernel, const TaskID& parentID)
+{
+	Task* parent = GetTask(parentID);
+	Task* task = TryInitializeTask(data, kernel, parent ? parent->mPriority : TASK_PRIORITY_NORMAL, parent);
+	if (!task)
+	{
+		return false;
+	}
 
-	// Restart threads
-	Start();
+	QueueTask(task);
+	return true;
 }
 
-void TaskDispatcher::WaitForTask(const TaskID& taskID) const
+TaskID TaskDispatcher::AddContinuation(const TaskID& ancestorID, const TaskData& data, TaskKernel kernel)
 {
+	Task* ancestor = GetTask(ancestorID);
+	if (!ancestor)
+	{
+		return AddTask(data, kernel);
+	}
+
+	Task* task = InitializeTask(data, kernel, ancestor->mPriority, nullptr);
+
+	TaskID taskID = GetTaskID(task);
+
+	Task* continuations = ancestor->mContinuations.load(std::memory_order_acquire);
+	do
+	{
+		if (continuations == ancestor)
+		{
+			// Ancestor finished while we were linking. Nothing left to wait for.
+			QueueTask(task);
+			return taskID;
+		}
+
+		task->mNextContinuation = continuations;
+	} while (!ancestor->mContinuations.compare_exchange_weak(continuations, task, std::memory_order_acq_rel, std::memory_order_acquire));
+
+	return taskID;
+}
+
+void TaskDispatcher::AddTasks(const TaskData* data, TaskKernel kernel, uint32_t count, TaskID* outIDs, TaskPriority priority)
+{
+	// Chain the batch through mNextContinuation, which is unused until a task becomes a continuation.
+	Task* first = nullptr;
+	Task* last = nullptr;
+	uint32_t batchCount = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (batchCount > 0 && mTaskPool.IsEmpty())
+		{
+			// Queue what we have so the pool can drain before AllocateTask starts helping.
+			QueueTasks(first, batchCount, priority);
+			first = last = nullptr;
+			batchCount = 0;
+		}
+
+		Task* task = TryInitializeTask(data[i], kernel, priority, nullptr);
+		if (!task)
+		{
+			TaskID taskID = ExecuteInline(data[i], kernel, priority);
+			if (outIDs)
+			{
+				outIDs[i] = taskID;
+			}
+
+			continue;
+		}
+
+		if (outIDs)
+		{
+			outIDs[i] = GetTaskID(task);
+		}
+
+		if (last)
+		{
+			last->mNextContinuation = task;
+		}
+		else
+		{
+			first = task;
+		}
+
+		last = task;
+		batchCount++;
+	}
+
+	if (batchCount > 0)
+	{
+		QueueTasks(first, batchCount, priority);
+	}
+}
+
+void TaskDispatcher::Synchronize(TaskPriority lowestPriority)
+{
+	// Help with everything being waited on, even background work this thread would normally leave to the background workers.
+	uint32_t queueIndex = GetQueueIndex();
+	TaskPriority helpPriority = GetLowestPriority(queueIndex);
+	helpPriority = (lowestPriority > helpPriority) ? lowestPriority : helpPriority;
+
+	for (int priority = TASK_PRIORITY_CRITICAL; priority <= lowestPriority; priority++)
+	{
+		while (mUnfinishedTaskCounts[priority].load(std::memory_order_acquire) != 0)
+		{
+			if (!TryExecuteTask(queueIndex, helpPriority))
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+}
+
+void TaskDispatcher::WaitForTask(const TaskID& taskID)
+{
+	// Help with queued work instead of idling. This also lets a paused dispatcher drain its queues on the calling thread.
+	uint32_t queueIndex = GetQueueIndex();
+	TaskPriority lowestPriority = GetLowestPriority(queueIndex);
 	while (!IsTaskFinished(taskID))
 	{
-		// Could help with tasks if possible...
-		std::this_thread::yield();
+		if (!TryExecuteTask(queueIndex, lowestPriority))
+		{
+			std::this_thread::yield();
+		}
 	}
 }
 
 bool TaskDispatcher::IsTaskFinished(const TaskID& taskID) const
 {
-	Task* task = GetTask(taskID);
-	if (task->mGeneration != taskID.mGeneration)
+	// Tasks are only freed once their open work count reaches zero, which includes every child.
+	return GetTask(taskID) == nullptr;
+}
+
+bool TaskDispatcher::PinMainThread()
+{
+	return PinCurrentThread(mLayout.mReservedProcessor);
+}
+
+uint8_t TaskDispatcher::GetThreadCount() const
+{
+	return mThreadCount;
+}
+
+const TaskThreadLayout& TaskDispatcher::GetThreadLayout() const
+{
+	return mLayout;
+}
+
+inline TaskID TaskDispatcher::GetTaskID(Task* task) const
+{
+	return TaskID(mTaskPool.GetOffset(task), task->mGeneration.load(std::memory_order_relaxed));
+}
+
+inline Task* TaskDispatcher::GetTask(const TaskID& taskID) const
+{
+	// Finished tasks resolve to null, including slots that have since been handed to an unrelated task.
+	if (taskID.mOffset == TASK_ID_INLINE_OFFSET)
 	{
-		return true;
+		return nullptr;
 	}
-	else
+
+	Task* task = mTaskPool.GetTask(taskID.mOffset);
+	return (task->mGeneration.load(std::memory_order_acquire) == taskID.mGeneration) ? task : nullptr;
+}
+
+inline uint32_t TaskDispatcher::GetQueueIndex() const
+{
+	return (tDispatcher == this) ? tQueueIndex : mThreadCount;
+}
+
+inline TaskPriority TaskDispatcher::GetLowestPriority(uint32_t queueIndex) const
+{
+	if (queueIndex < mThreadCount)
 	{
-		// TO DO: Check dependent tasks.
+		return (queueIndex >= static_cast<uint32_t>(mThreadCount - mBackgroundThreadCount)) ? TASK_PRIORITY_BACKGROUND : TASK_PRIORITY_NORMAL;
+	}
+
+	// Other threads leave background work to the background workers unless there are none to run it.
+	return (mBackgroundThreadCount == 0 || mIsPaused) ? TASK_PRIORITY_BACKGROUND : TASK_PRIORITY_NORMAL;
+}
+
+inline bool TaskDispatcher::HasAvailableTasks(TaskPriority lowestPriority) const
+{
+	for (int priority = TASK_PRIORITY_CRITICAL; priority <= lowestPriority; priority++)
+	{
+		if (mPendingTaskCounts[priority] != 0)
+		{
+			return true;
+		}
 	}
 
 	return false;
 }
 
-inline TaskID TaskDispatcher::GetTaskID(Task* task) const
+inline Task* TaskDispatcher::GetAvailableTask(uint32_t queueIndex, TaskPriority lowestPriority)
 {
-	return TaskID(task - reinterpret_cast<Task*>(mMemory), task->mGeneration);
+	// Exhaust every queue of a priority before looking at the next one down.
+	uint32_t queueCount = mThreadCount + 1;
+	for (int priority = TASK_PRIORITY_CRITICAL; priority <= lowestPriority; priority++)
+	{
+		if (mPendingTaskCounts[priority] == 0)
+		{
+			continue;
+		}
+
+		TaskQueue* queues = mTaskQueues + priority * queueCount;
+		Task* task = nullptr;
+
+		// Owners take the most recently queued (and likely cache warm) task first.
+		if (queueIndex == mThreadCount)
+		{
+			AcquireLock(mSubmitLock);
+			ScopedLock lock(mSubmitLock, std::adopt_lock);
+			task = queues[queueIndex].Pop();
+		}
+		else
+		{
+			task = queues[queueIndex].Pop();
+		}
+
+		if (!task)
+		{
+			task = StealTask(queues, queueIndex);
+		}
+
+		if (task)
+		{
+			mPendingTaskCounts[priority]--;
+			return task;
+		}
+	}
+
+	return nullptr;
 }
 
-inline Task* TaskDispatcher::GetTask(const TaskID& taskID) const
+inline Task* TaskDispatcher::StealTask(TaskQueue* queues, uint32_t queueIndex)
 {
-	return reinterpret_cast<Task*>(mMemory) + taskID.mOffset;
+	// Visit every other queue once, starting with the neighbor so thieves spread out.
+	uint32_t queueCount = mThreadCount + 1;
+	for (uint32_t i = 1; i < queueCount; i++)
+	{
+		Task* task = queues[(queueIndex + i) % queueCount].Steal();
+		if (task)
+		{
+			return task;
+		}
+	}
+
+	return nullptr;
 }
 
-inline Task* TaskDispatcher::WaitForAvailableTasks()
+inline void TaskDispatcher::WaitForAvailableTasks(TaskPriority lowestPriority)
 {
-	UniqueLock pendingLock(mTaskQueueLock);
-	while (mTaskQueue.empty())
+	// Spin first, doubling the pauses between checks so a waiting core leaves the memory bus and its sibling alone.
+	uint32_t backoff = 1;
+	for (uint32_t i = 0; i < mSpinCount; i += backoff)
+	{
+		if (HasAvailableTasks(lowestPriority) || mIsPaused)
+		{
+			return;
+		}
+
+		for (uint32_t j = 0; j < backoff; j++)
+		{
+			TASK_DISPATCHER_PAUSE();
+		}
+
+		backoff = (backoff < TASK_DISPATCHER_MAX_BACKOFF) ? backoff * 2 : backoff;
+	}
+
+	for (uint32_t i = 0; i < mYieldCount; i++)
+	{
+		if (HasAvailableTasks(lowestPriority) || mIsPaused)
+		{
+			return;
+		}
+
+		std::this_thread::yield();
+	}
+
+	AcquireLock(mSignalLock);
+	UniqueLock lock(mSignalLock, std::adopt_lock);
+
+	// Announce the sleep before the final check. Producers increment the pending count before reading the sleeping count,
+	// so either they see this worker and notify or this check sees their task.
+	mSleepingThreadCount++;
+	if (HasAvailableTasks(lowestPriority) || mIsPaused)
+	{
+		mSleepingThreadCount--;
+		return;
+	}
+
+	TaskProfiler* profiler = mProfiler;
+	uint64_t idleTime = profiler ? profiler->GetTime() : 0;
+
+	do
+	{
+		mTaskSignal.wait(lock);
+	} while (!HasAvailableTasks(lowestPriority) && !mIsPaused);
+
+	mSleepingThreadCount--;
+	lock.unlock();
+
+	if (profiler)
+	{
+		TaskEvent event = {};
+		event.mStartTime = idleTime;
+		event.mEndTime = profiler->GetTime();
+		event.mThreadIndex = static_cast<uint16_t>(GetQueueIndex());
+		event.mPriority = static_cast<uint8_t>(lowestPriority);
+		event.mType = TASK_EVENT_IDLE;
+		profiler->RecordEvent(event.mThreadIndex, event);
+	}
+}
+
+inline Task* TaskDispatcher::AllocateTask(bool isBlocking)
+{
+	Task* task = mTaskPool.Allocate();
+	if (task)
+	{
+		return task;
+	}
+
+	// Pool exhausted. Queued work frees slots when it runs, but a task run here may itself end up waiting here, so only
+	// nest a few deep. When every slot belongs to such a waiting task there is nothing queued and nothing will be freed.
+	uint32_t queueIndex = GetQueueIndex();
+	TaskPriority lowestPriority = GetLowestPriority(queueIndex);
+	while (!(task = mTaskPool.Allocate()))
 	{
-		if (mIsPaused)
+		bool isHelping = false;
+		if (tHelpDepth < TASK_DISPATCHER_MAX_HELP_DEPTH)
 		{
-			return nullptr;
+			tHelpDepth++;
+			isHelping = TryExecuteTask(queueIndex, lowestPriority);
+			tHelpDepth--;
 		}
 
-		mTaskSignal.wait(pendingLock);
+		if (!isHelping)
+		{
+			if (!isBlocking)
+			{
+				return nullptr;
+			}
+
+			std::this_thread::yield();
+		}
 	}
 
-	Task* task = mTaskQueue.front();
-	mTaskQueue.pop();
+	return task;
+}
 
+inline Task* TaskDispatcher::InitializeTask(const TaskData& data, TaskKernel kernel, TaskPriority priority, Task* parent)
+{
+	Task* task = InitializeTask(kernel, priority, parent, true);
+	task->mData = data;
 	return task;
 }
 
-inline Task* TaskDispatcher::AllocateTask()
+inline Task* TaskDispatcher::TryInitializeTask(const TaskData& data, TaskKernel kernel, TaskPriority priority, Task* parent)
 {
-	Task* task = nullptr;
+	Task* task = InitializeTask(kernel, priority, parent, false);
+	if (task)
 	{
-		ScopedLock lock(mMemoryLock);
-		task = reinterpret_cast<Task*>(mAllocator.Allocate());
+		task->mData = data;
 	}
 
-	task->mGeneration = ++mTaskGeneration;
 	return task;
 }
 
-inline void TaskDispatcher::FreeTask(Task* task)
+inline Task* TaskDispatcher::InitializeTask(TaskKernel kernel, TaskPriority priority, Task* parent, bool isBlocking)
 {
-	task->mGeneration = ++mTaskGeneration;
+	Task* task = AllocateTask(isBlocking);
+	if (!task)
 	{
-		ScopedLock lock(mMemoryLock);
-		mAllocator.Free(task);
+		return nullptr;
 	}
+
+	task->mKernel = kernel;
+	task->mPriority = priority;
+	task->mParent = parent;
+	task->mNextContinuation = nullptr;
+	task->mContinuations.store(nullptr, std::memory_order_relaxed);
+	task->mOpenWorkCount.store(1, std::memory_order_relaxed);
+
+	mUnfinishedTaskCounts[priority].fetch_add(1, std::memory_order_relaxed);
+
+	if (parent)
+	{
+		parent->mOpenWorkCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return task;
+}
+
+inline void TaskDispatcher::FreeTask(Task* task)
+{
+	mTaskPool.Free(task);
 }
 
 inline void TaskDispatcher::QueueTask(Task* task)
 {
+	// The task may run and be recycled as soon as it is pushed, so read everything needed up front.
+	uint32_t queueIndex = GetQueueIndex();
+	TaskPriority priority = task->mPriority;
+	TaskQueue* queues = mTaskQueues + priority * (mThreadCount + 1);
+
+	if (mProfiler)
+	{
+		mProfiler->RecordEnqueue(mTaskPool.GetOffset(task), mProfiler->GetTime(), mPendingTaskCounts[priority]);
+	}
+
+	// Count the task before it becomes visible so a thief can never decrement past zero.
+	mPendingTaskCounts[priority]++;
+
+	if (queueIndex == mThreadCount)
+	{
+		AcquireLock(mSubmitLock);
+		ScopedLock lock(mSubmitLock, std::adopt_lock);
+		queues[queueIndex].Push(task);
+	}
+	else
+	{
+		queues[queueIndex].Push(task);
+	}
+
+	SignalWorkers(1, priority);
+}
+
+inline void TaskDispatcher::QueueTasks(Task* first, uint32_t count, TaskPriority priority)
+{
+	uint32_t queueIndex = GetQueueIndex();
+	TaskQueue* queues = mTaskQueues + priority * (mThreadCount + 1);
+
+	if (mProfiler)
+	{
+		uint64_t enqueueTime = mProfiler->GetTime();
+		uint32_t queueDepth = mPendingTaskCounts[priority];
+		Task* task = first;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			mProfiler->RecordEnqueue(mTaskPool.GetOffset(task), enqueueTime, queueDepth + i);
+			task = task->mNextContinuation;
+		}
+	}
+
+	mPendingTaskCounts[priority] += count;
+
+	if (queueIndex == mThreadCount)
+	{
+		AcquireLock(mSubmitLock);
+		ScopedLock lock(mSubmitLock, std::adopt_lock);
+		Task* task = first;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			Task* next = task->mNextContinuation;
+			task->mNextContinuation = nullptr;
+			queues[queueIndex].Push(task);
+			task = next;
+		}
+	}
+	else
+	{
+		Task* task = first;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			Task* next = task->mNextContinuation;
+			task->mNextContinuation = nullptr;
+			queues[queueIndex].Push(task);
+			task = next;
+		}
+	}
+
+	SignalWorkers(count, priority);
+}
+
+inline void TaskDispatcher::SignalWorkers(uint32_t count, TaskPriority priority)
+{
+	// Spinning workers will find the task on their own.
+	if (mSleepingThreadCount == 0)
 	{
-		UniqueLock lock(mTaskQueueLock);
-		mTaskQueue.push(task);
+		return;
 	}
 
-	mTaskSignal.notify_one();	
+	// Sleeping workers check the pending count under the signal lock. Acquiring it here guarantees the wake up is not lost.
+	AcquireLock(mSignalLock);
+	mSignalLock.unlock();
+
+	// Only some workers may take background tasks, so make sure one of them hears about it.
+	if (count > 1 || priority == TASK_PRIORITY_BACKGROUND)
+	{
+		mTaskSignal.notify_all();
+	}
+	else
+	{
+		mTaskSignal.notify_one();
+	}
 }
 
 inline void TaskDispatcher::ExecuteTask(Task* task)
-{	
-	(task->mKernel)(task->mData);
+{
+	TaskProfiler* profiler = mProfiler;
+	TaskEvent event;
+
+	if (profiler)
+	{
+		// The task is recycled by FinishTask, so copy what the event needs first.
+		event.mKernel = task->mKernel;
+		event.mThreadIndex = static_cast<uint16_t>(GetQueueIndex());
+		event.mPriority = static_cast<uint8_t>(task->mPriority);
+		event.mType = TASK_EVENT_EXECUTE;
+		event.mStartTime = profiler->GetTime();
+		profiler->GetEnqueue(mTaskPool.GetOffset(task), &event);
+	}
+
+	RunKernel(task->mKernel, task->mData);
+
+	if (profiler)
+	{
+		event.mEndTime = profiler->GetTime();
+		profiler->RecordEvent(event.mThreadIndex, event);
+	}
+
+	FinishTask(task);
+}
+
+inline void TaskDispatcher::RunKernel(TaskKernel kernel, const TaskData& data)
+{
+	// Non worker threads take turns with the shared arena. Nested tasks keep whichever arena the outer task is using.
+	TaskScratchArena* arena = tScratchArena;
+	bool isScratchClaimed = false;
+	if (!arena && mScratchArenas && !mIsScratchClaimed.exchange(true, std::memory_order_acquire))
+	{
+		arena = tScratchArena = &mScratchArenas[mThreadCount];
+		isScratchClaimed = true;
+	}
+
+	size_t scratchMarker = arena ? arena->GetMarker() : 0;
+
+	if (kernel)
+	{
+		kernel(data);
+	}
+
+	if (arena)
+	{
+		arena->Rewind(scratchMarker);
+	}
+
+	if (isScratchClaimed)
+	{
+		tScratchArena = nullptr;
+		mIsScratchClaimed.store(false, std::memory_order_release);
+	}
+}
+
+TaskID TaskDispatcher::ExecuteInline(const TaskData& data, TaskKernel kernel, TaskPriority priority)
+{
+	// Recorded separately from queued tasks since running inline is what the dispatcher does when it is overloaded.
+	TaskProfiler* profiler = mProfiler;
+	TaskEvent event;
+
+	if (profiler)
+	{
+		event.mKernel = kernel;
+		event.mQueueDepth = 0;
+		event.mThreadIndex = static_cast<uint16_t>(GetQueueIndex());
+		event.mPriority = static_cast<uint8_t>(priority);
+		event.mType = TASK_EVENT_INLINE;
+		event.mStartTime = profiler->GetTime();
+		event.mEnqueueTime = event.mStartTime;
+	}
+
+	RunKernel(kernel, data);
+
+	if (profiler)
+	{
+		event.mEndTime = profiler->GetTime();
+		profiler->RecordEvent(event.mThreadIndex, event);
+	}
+
+	return TaskID(TASK_ID_INLINE_OFFSET, 0);
+}
+
+inline void TaskDispatcher::FinishTask(Task* task)
+{
+	while (task && task->mOpenWorkCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		// Close the continuation list so late additions are queued directly, then release everything that was waiting on us.
+		Task* continuation = task->mContinuations.exchange(task, std::memory_order_acq_rel);
+		while (continuation)
+		{
+			Task* next = continuation->mNextContinuation;
+			QueueTask(continuation);
+			continuation = next;
+		}
+
+		Task* parent = task->mParent;
+		TaskPriority priority = task->mPriority;
+		FreeTask(task);
+		mUnfinishedTaskCounts[priority].fetch_sub(1, std::memory_order_release);
+		task = parent;
+	}
+}
+
+inline bool TaskDispatcher::TryExecuteTask(uint32_t queueIndex, TaskPriority lowestPriority)
+{
+	Task* task = GetAvailableTask(queueIndex, lowestPriority);
+	if (task)
+	{
+		ExecuteTask(task);
+		return true;
+	}
+
+	return false;
 }
 
-inline void TaskDispatcher::ProcessTasks()
+inline void TaskDispatcher::ProcessTasks(uint32_t queueIndex)
 {
+	tDispatcher = this;
+	tQueueIndex = queueIndex;
+	tScratchArena = mScratchArenas ? &mScratchArenas[queueIndex] : nullptr;
+
+	if (mLayout.mIsPinned)
+	{
+		PinCurrentThread(mLayout.mWorkerProcessors[queueIndex]);
+	}
+
+	TaskPriority lowestPriority = GetLowestPriority(queueIndex);
 	while (!mIsPaused)
 	{
-		Task* task = WaitForAvailableTasks();
-		if (task)
+		if (!TryExecuteTask(queueIndex, lowestPriority))
 		{
-			ExecuteTask(task);
-			FreeTask(task);
+			WaitForAvailableTasks(lowestPriority);
 		}
 	}
 
+	tDispatcher = nullptr;
+	tScratchArena = nullptr;
+
 	UniqueLock lock(mThreadLock);
 	mActiveThreadCount--;
 	std::notify_all_at_thread_exit(mThreadSignal, std::move(lock));
@@ -218,4 +902,32 @@ inline void TaskDispatcher::JoinThreads()
 			mThreads[i].join();
 		}
 	}
-}
\ No newline at end of file
+}
+
+inline void TaskDispatcher::AcquireLock(Mutex& mutex)
+{
+	if (!mProfiler)
+	{
+		mutex.lock();
+		return;
+	}
+
+	if (!mutex.try_lock())
+	{
+		mProfiler->RecordContention(GetQueueIndex());
+		mutex.lock();
+	}
+}
+
+void* TaskDispatcher::CreateClosureTask(TaskKernel kernel, TaskPriority priority, const TaskID* parentID, TaskID* taskID)
+{
+	Task* parent = parentID ? GetTask(*parentID) : nullptr;
+	Task* task = InitializeTask(kernel, parent ? parent->mPriority : priority, parent, false);
+	if (!task)
+	{
+		return nullptr;
+	}
+
+	*taskID = GetTaskID(task);
+	return task->mClosure;
+}
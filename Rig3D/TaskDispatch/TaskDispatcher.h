@@ -2,10 +2,17 @@
 #include <thread>
 #include <condition_variable>
 #include <mutex>
-#include <queue>
 #include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "Task.h"
-#include "Memory\Memory\PoolAllocator.h"
+#include "WorkStealingQueue.h"
+#include "TaskPool.h"
+#include "TaskProfiler.h"
+#include "TaskTopology.h"
+#include "TaskScratchArena.h"
 
 #ifdef _WINDLL
 #define RIG3D __declspec(dllexport)
@@ -17,19 +24,29 @@ namespace cliqCity
 {
 	namespace multicore
 	{
-		typedef cliqCity::memory::PoolAllocator TaskPool;
 		typedef std::atomic<uint32_t>			AtomicCounter;
+		typedef std::atomic<bool>				AtomicFlag;
 		typedef std::condition_variable			Signal;
 		typedef std::mutex						Mutex;
 		typedef std::unique_lock<Mutex>			UniqueLock;
 		typedef std::lock_guard<Mutex>			ScopedLock;
 		typedef std::thread						Thread;
-		typedef std::queue<Task*>				TaskQueue;
+		typedef WorkStealingQueue				TaskQueue;
+
+#define TASK_DISPATCHER_DEFAULT_CHUNK_SIZE	1024
+
+		template<class Result>
+		class TaskFuture;
 
 		class RIG3D TaskDispatcher
 		{
 		public:
 			TaskDispatcher(Thread* threads, uint8_t threadCount, void* memory, size_t size);
+
+			// Owns its threads and sizes itself from the CPU topology, leaving out the core the calling thread is running on.
+			// Pinned workers are bound to one logical processor each, spread over physical cores first. The calling thread is not
+			// pinned, so it may move onto a worker's core unless it calls PinMainThread.
+			TaskDispatcher(void* memory, size_t size, bool pinThreads = false);
 			TaskDispatcher();
 			~TaskDispatcher();
 
@@ -37,37 +54,440 @@ namespace cliqCity
 			void Pause();
 			bool IsPaused();
 
-			TaskID  AddTask(const TaskData& data, TaskKernel kernel);
+			// The last count workers also run background tasks. Must be called while paused. Defaults to a quarter of the workers.
+			void	SetBackgroundThreadCount(uint8_t count);
+			uint8_t	GetBackgroundThreadCount() const;
+
+			// Idle workers pause spinCount times with exponential backoff, then yield yieldCount times, before sleeping on the task signal.
+			// Spinning cuts the wake up latency of bursty work at the cost of CPU time. Zero for both sleeps immediately. Must be called while paused.
+			// Single core machines default to no spinning since a spinning worker would only delay the thread it is waiting on.
+			void	SetSpinPolicy(uint32_t spinCount, uint32_t yieldCount);
+
+			// Splits memory into a scratch arena for each worker plus one shared by threads the dispatcher does not own. Must be called while paused.
+			void	SetScratchMemory(void* memory, size_t size);
+
+			// Scratch arena of the calling thread, for temporary allocations inside a kernel. Everything allocated is released when the task returns.
+			// Null when no scratch memory was set, or on a non worker thread while another non worker thread is running a task.
+			static TaskScratchArena* GetScratchArena();
+
+			// Records task timings, idle time and lock contention while attached. Pass null to detach. Must be called while paused.
+			// The profiler should be created with the dispatcher's thread count.
+			void			SetProfiler(TaskProfiler* profiler);
+			TaskProfiler*	GetProfiler() const;
+
+			// Created tasks are not queued until RunTask is called. Creating a task or a continuation waits for a free slot when the pool is empty. A task is not finished until its kernel and all of its children have finished,
+			// at which point its continuations are queued. Parents and ancestors must not have finished when children or continuations are added.
+			// Children and continuations inherit the priority of their parent or ancestor.
+			TaskID	CreateTask(const TaskData& data, TaskKernel kernel, TaskPriority priority = TASK_PRIORITY_NORMAL);
+			TaskID	CreateTask(const TaskData& data, TaskKernel kernel, const TaskID& parentID);
+			void	RunTask(const TaskID& taskID);
+
+			// When the pool is empty and there is no queued work to help with, added tasks run on the calling thread before AddTask returns.
+			// Waiting would never end if every slot belonged to a task that is itself adding work.
+			TaskID  AddTask(const TaskData& data, TaskKernel kernel, TaskPriority priority = TASK_PRIORITY_NORMAL);
+			TaskID  AddTask(const TaskData& data, TaskKernel kernel, const TaskID& parentID);
+			TaskID	AddContinuation(const TaskID& ancestorID, const TaskData& data, TaskKernel kernel);
+
+			// Queues a callable taking no arguments. It is stored inline in the task slot without allocating, so it must fit in
+			// TASK_CLOSURE_SIZE bytes and be no more aligned than a pointer. The callable is destroyed after it runs.
+			template<class Callable>
+			TaskID	AddTask(Callable&& callable, TaskPriority priority = TASK_PRIORITY_NORMAL);
+			template<class Callable>
+			TaskID	AddTask(Callable&& callable, const TaskID& parentID);
+
+			// As above but returns false instead of running the callable inline when no task slot is free. The callable is not
+			// consumed on failure, so the caller can defer it, for example to keep inline work from recursing.
+			template<class Callable>
+			bool	TryAddTask(Callable&& callable, const TaskID& parentID);
 
-			void Synchronize();
-			void WaitForTask(const TaskID& taskID) const;
+			// As above but the callable's return value is written to future, which must outlive the task.
+			template<class Callable, class Result>
+			TaskID	AddTask(Callable&& callable, TaskFuture<Result>* future, TaskPriority priority = TASK_PRIORITY_NORMAL);
+
+			// Queues count tasks sharing a kernel, taking the submission lock and waking workers once per batch. outIDs may be null.
+			void	AddTasks(const TaskData* data, TaskKernel kernel, uint32_t count, TaskID* outIDs, TaskPriority priority = TASK_PRIORITY_NORMAL);
+
+			// Calls function(rangeBegin, rangeEnd) over [begin, end) split into tasks of at most grainSize indices and waits for completion.
+			// A grainSize of zero picks one from the range size and thread count. Ranges that cannot get a task slot are run unsplit
+			// on the thread that was splitting them, so ranges may be larger than grainSize when the pool runs low.
+			template<class Function>
+			void ParallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const Function& function);
+
+			// Splits [begin, end) into chunks of chunkSize indices, computes reduce(chunkBegin, chunkEnd) for each chunk in parallel and
+			// folds the partial results left to right with combine. Chunks depend only on the range and chunkSize, never on the thread
+			// count, so the result is bit-identical on every machine. A chunkSize of zero uses TASK_DISPATCHER_DEFAULT_CHUNK_SIZE.
+			// Returns identity for an empty range.
+			template<class T, class Reduce, class Combine>
+			T ParallelReduce(uint32_t begin, uint32_t end, uint32_t chunkSize, const T& identity, const Reduce& reduce, const Combine& combine);
+
+			// Writes output[i] = identity combined with input[0..i) and returns the combination of every input. Chunked the same way
+			// as ParallelReduce so results do not depend on the thread count. output may alias input.
+			template<class T, class Combine>
+			T ParallelExclusiveScan(const T* input, T* output, uint32_t count, uint32_t chunkSize, const T& identity, const Combine& combine);
+
+			// Frame fence. Returns once every task created so far at lowestPriority or above (including queued continuations and children)
+			// has finished. By default background loads keep running across the fence. Pass TASK_PRIORITY_BACKGROUND to drain everything,
+			// for example before shutdown. The calling thread helps execute tasks and worker threads stay alive.
+			void Synchronize(TaskPriority lowestPriority = TASK_PRIORITY_NORMAL);
+			void WaitForTask(const TaskID& taskID);
 			bool IsTaskFinished(const TaskID& taskID) const;
 
+			// Pins the calling thread to the processor reserved when the dispatcher was created. Call it from the thread that created it.
+			bool PinMainThread();
+
+			uint8_t GetThreadCount() const;
+			const TaskThreadLayout& GetThreadLayout() const;
+
 		private:
-			AtomicCounter	mTaskGeneration;
+			AtomicCounter	mPendingTaskCounts[TASK_PRIORITY_COUNT];	// Queued but not yet taken by a thread.
+			AtomicCounter	mUnfinishedTaskCounts[TASK_PRIORITY_COUNT];	// Allocated but not yet freed.
+			AtomicCounter	mSleepingThreadCount;	// Workers waiting on mTaskSignal. Producers skip the notify when zero.
 			Signal			mTaskSignal;
 			Signal			mThreadSignal;
-			Mutex			mMemoryLock;
-			Mutex			mTaskQueueLock;
+			Mutex			mSignalLock;
+			Mutex			mSubmitLock;
 			Mutex			mThreadLock;
-			TaskQueue		mTaskQueue;
-			TaskPool		mAllocator;
-			void*			mMemory;
+			TaskQueue*		mTaskQueues;		// Per priority: one per worker plus a shared queue for non worker threads at mThreadCount.
+			TaskPool		mTaskPool;
 			Thread*			mThreads;
+			TaskProfiler*	mProfiler;
+			uint32_t		mSpinCount;
+			uint32_t		mYieldCount;
 			uint8_t			mThreadCount;
 			uint8_t			mActiveThreadCount;
-			bool			mIsPaused;
+			uint8_t			mBackgroundThreadCount;
+			bool			mOwnsThreads;
+			TaskThreadLayout	mLayout;
+			TaskScratchArena*	mScratchArenas;		// One per worker plus a shared one at mThreadCount.
+			AtomicFlag		mIsScratchClaimed;	// Held by the non worker thread using the shared arena.
+			AtomicFlag		mIsPaused;
 
 			TaskID	GetTaskID(Task* task) const;
-			Task*	GetTask(const TaskID& taskID) const;
+			Task*	GetTask(const TaskID& taskID) const;		// Null once the task has finished.
 
-			Task*	WaitForAvailableTasks();
-			Task*	AllocateTask();
+			uint32_t		GetQueueIndex() const;
+			TaskPriority	GetLowestPriority(uint32_t queueIndex) const;
+			bool	HasAvailableTasks(TaskPriority lowestPriority) const;
+			Task*	GetAvailableTask(uint32_t queueIndex, TaskPriority lowestPriority);
+			Task*	StealTask(TaskQueue* queues, uint32_t queueIndex);
+			void	WaitForAvailableTasks(TaskPriority lowestPriority);
+			Task*	AllocateTask(bool isBlocking);
+			Task*	InitializeTask(const TaskData& data, TaskKernel kernel, TaskPriority priority, Task* parent);
+			Task*	TryInitializeTask(const TaskData& data, TaskKernel kernel, TaskPriority priority, Task* parent);
+			bool	TryCreateTask(const TaskData& data, TaskKernel kernel, TaskID* taskID);
+			bool	TryAddTask(const TaskData& data, TaskKernel kernel, const TaskID& parentID);
+			Task*	InitializeTask(TaskKernel kernel, TaskPriority priority, Task* parent, bool isBlocking);
 			void	FreeTask(Task* task);
 			void	QueueTask(Task* task);
+			void	QueueTasks(Task* first, uint32_t count, TaskPriority priority);
+			void	SignalWorkers(uint32_t count, TaskPriority priority);
 			void	ExecuteTask(Task* task);
-			void	ProcessTasks();
+			void	RunKernel(TaskKernel kernel, const TaskData& data);
+			TaskID	ExecuteInline(const TaskData& data, TaskKernel kernel, TaskPriority priority);
+			void	FinishTask(Task* task);
+			bool	TryExecuteTask(uint32_t queueIndex, TaskPriority lowestPriority);
+			void	ProcessTasks(uint32_t queueIndex);
 			void	JoinThreads();
+			void	AcquireLock(Mutex& mutex);
+			void*	CreateClosureTask(TaskKernel kernel, TaskPriority priority, const TaskID* parentID, TaskID* taskID);
+
+			template<class Callable>
+			TaskID	AddClosureTask(Callable&& callable, TaskPriority priority, const TaskID* parentID);
+
+			template<class Closure>
+			static void ClosureKernel(const TaskData& data);
+
+			template<class Function>
+			static void ParallelForKernel(const TaskData& data);
+		};
+
+		// Result of a task queued with AddTask(callable, future). Result must be default constructible and assignable.
+		template<class Result>
+		class TaskFuture
+		{
+		public:
+			TaskFuture() : mDispatcher(nullptr), mResult() {};
+
+			// Futures that were never queued are always ready.
+			bool IsReady() const
+			{
+				return !mDispatcher || mDispatcher->IsTaskFinished(mTaskID);
+			}
+
+			// Helps execute queued tasks until the result is available.
+			const Result& Get()
+			{
+				if (mDispatcher)
+				{
+					mDispatcher->WaitForTask(mTaskID);
+				}
+
+				return mResult;
+			}
+
+			TaskID GetTaskID() const
+			{
+				return mTaskID;
+			}
+
+		private:
+			friend class TaskDispatcher;
+
+			TaskDispatcher*	mDispatcher;
+			TaskID			mTaskID;
+			Result			mResult;
+		};
+
+		template<class Callable, class Result>
+		struct TaskFutureClosure
+		{
+			Callable	mCallable;
+			Result*		mResult;
+
+			void operator()()
+			{
+				*mResult = mCallable();
+			}
+		};
+
+		template<class Callable>
+		TaskID TaskDispatcher::AddTask(Callable&& callable, TaskPriority priority)
+		{
+			return AddClosureTask(std::forward<Callable>(callable), priority, nullptr);
+		}
+
+		template<class Callable>
+		TaskID TaskDispatcher::AddTask(Callable&& callable, const TaskID& parentID)
+		{
+			return AddClosureTask(std::forward<Callable>(callable), TASK_PRIORITY_NORMAL, &parentID);
+		}
+
+		template<class Callable, class Result>
+		TaskID TaskDispatcher::AddTask(Callable&& callable, TaskFuture<Result>* future, TaskPriority priority)
+		{
+			typedef TaskFutureClosure<typename std::decay<Callable>::type, Result> Closure;
+
+			future->mDispatcher = this;
+			future->mTaskID = AddClosureTask(Closure{ std::forward<Callable>(callable), &future->mResult }, priority, nullptr);
+			return future->mTaskID;
+		}
+
+		template<class Callable>
+		bool TaskDispatcher::TryAddTask(Callable&& callable, const TaskID& parentID)
+		{
+			typedef typename std::decay<Callable>::type Closure;
+			static_assert(sizeof(Closure) <= sizeof(Task::mClosure), "Task closure does not fit in the task slot. Capture less or use a TaskKernel.");
+			static_assert(alignof(Closure) <= alignof(uint64_t), "Task closure is over aligned.");
+
+			TaskID taskID;
+			void* closure = CreateClosureTask(&TaskDispatcher::ClosureKernel<Closure>, TASK_PRIORITY_NORMAL, &parentID, &taskID);
+			if (!closure)
+			{
+				return false;
+			}
+
+			new (closure) Closure(std::forward<Callable>(callable));
+			RunTask(taskID);
+			return true;
+		}
+
+		template<class Callable>
+		TaskID TaskDispatcher::AddClosureTask(Callable&& callable, TaskPriority priority, const TaskID* parentID)
+		{
+			typedef typename std::decay<Callable>::type Closure;
+			static_assert(sizeof(Closure) <= sizeof(Task::mClosure), "Task closure does not fit in the task slot. Capture less or use a TaskKernel.");
+			static_assert(alignof(Closure) <= alignof(uint64_t), "Task closure is over aligned.");
+
+			TaskID taskID;
+			void* closure = CreateClosureTask(&TaskDispatcher::ClosureKernel<Closure>, priority, parentID, &taskID);
+			if (!closure)
+			{
+				// No free slot. Build the closure in local storage the size of a task's and run it here instead.
+				alignas(TaskData) uint64_t storage[TASK_CLOSURE_SIZE / sizeof(uint64_t)];
+				new (storage) Closure(std::forward<Callable>(callable));
+				return ExecuteInline(*reinterpret_cast<const TaskData*>(storage), &TaskDispatcher::ClosureKernel<Closure>, priority);
+			}
+
+			new (closure) Closure(std::forward<Callable>(callable));
+			RunTask(taskID);
+			return taskID;
+		}
+
+		template<class Closure>
+		void TaskDispatcher::ClosureKernel(const TaskData& data)
+		{
+			// Task data and closure storage share the same slot memory.
+			Closure* closure = reinterpret_cast<Closure*>(const_cast<TaskData*>(&data));
+			(*closure)();
+			closure->~Closure();
+		}
+
+		template<class Function>
+		struct ParallelForData
+		{
+			TaskDispatcher*	mDispatcher;
+			const Function*	mFunction;
+			TaskID			mRootID;
+			uint32_t		mGrainSize;
 		};
+
+		template<class Function>
+		void TaskDispatcher::ParallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const Function& function)
+		{
+			if (end <= begin)
+			{
+				return;
+			}
+
+			uint32_t count = end - begin;
+			if (grainSize == 0)
+			{
+				// Aim for several ranges per thread so stealing can even out uneven work.
+				grainSize = count / ((mThreadCount + 1) * 8);
+				grainSize = (grainSize > 0) ? grainSize : 1;
+			}
+
+			if (count <= grainSize)
+			{
+				function(begin, end);
+				return;
+			}
+
+			ParallelForData<Function> forData;
+			forData.mDispatcher = this;
+			forData.mFunction = &function;
+			forData.mGrainSize = grainSize;
+
+			TaskData data;
+			data.mKernelData = &forData;
+			data.mStream.in[0] = reinterpret_cast<void*>(static_cast<uintptr_t>(begin));
+			data.mStream.in[1] = reinterpret_cast<void*>(static_cast<uintptr_t>(end));
+
+			if (!TryCreateTask(data, &TaskDispatcher::ParallelForKernel<Function>, &forData.mRootID))
+			{
+				function(begin, end);
+				return;
+			}
+
+			RunTask(forData.mRootID);
+			WaitForTask(forData.mRootID);
+		}
+
+		template<class Function>
+		void TaskDispatcher::ParallelForKernel(const TaskData& data)
+		{
+			const ParallelForData<Function>* forData = reinterpret_cast<const ParallelForData<Function>*>(data.mKernelData);
+			uint32_t begin = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(data.mStream.in[0]));
+			uint32_t end = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(data.mStream.in[1]));
+
+			// Hand the upper half to other threads until the remaining range fits the grain size. Without a free slot the
+			// whole remaining range runs here, since splitting further would only run the halves here one after the other.
+			while (end - begin > forData->mGrainSize)
+			{
+				uint32_t middle = begin + (end - begin) / 2;
+
+				TaskData split;
+				split.mKernelData = data.mKernelData;
+				split.mStream.in[0] = reinterpret_cast<void*>(static_cast<uintptr_t>(middle));
+				split.mStream.in[1] = reinterpret_cast<void*>(static_cast<uintptr_t>(end));
+				if (!forData->mDispatcher->TryAddTask(split, &TaskDispatcher::ParallelForKernel<Function>, forData->mRootID))
+				{
+					break;
+				}
+
+				end = middle;
+			}
+
+			(*forData->mFunction)(begin, end);
+		}
+
+		template<class T, class Reduce, class Combine>
+		T TaskDispatcher::ParallelReduce(uint32_t begin, uint32_t end, uint32_t chunkSize, const T& identity, const Reduce& reduce, const Combine& combine)
+		{
+			if (end <= begin)
+			{
+				return identity;
+			}
+
+			chunkSize = (chunkSize > 0) ? chunkSize : TASK_DISPATCHER_DEFAULT_CHUNK_SIZE;
+			uint32_t count = end - begin;
+			uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+			// Chunks are grouped into tasks by the automatic grain, so small chunks do not cost a task slot each.
+			std::vector<T> partials(chunkCount, identity);
+			ParallelFor(0, chunkCount, 0, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+			{
+				for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+				{
+					uint32_t first = begin + i * chunkSize;
+					uint32_t last = (i + 1 < chunkCount) ? first + chunkSize : end;
+					partials[i] = reduce(first, last);
+				}
+			});
+
+			T result = partials[0];
+			for (uint32_t i = 1; i < chunkCount; i++)
+			{
+				result = combine(result, partials[i]);
+			}
+
+			return result;
+		}
+
+		template<class T, class Combine>
+		T TaskDispatcher::ParallelExclusiveScan(const T* input, T* output, uint32_t count, uint32_t chunkSize, const T& identity, const Combine& combine)
+		{
+			if (count == 0)
+			{
+				return identity;
+			}
+
+			chunkSize = (chunkSize > 0) ? chunkSize : TASK_DISPATCHER_DEFAULT_CHUNK_SIZE;
+			uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+			// Totals of each chunk, then scanned serially into the starting value of each chunk.
+			std::vector<T> offsets(chunkCount + 1, identity);
+			ParallelFor(0, chunkCount, 0, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+			{
+				for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+				{
+					uint32_t first = i * chunkSize;
+					uint32_t last = (i + 1 < chunkCount) ? first + chunkSize : count;
+
+					T total = input[first];
+					for (uint32_t j = first + 1; j < last; j++)
+					{
+						total = combine(total, input[j]);
+					}
+
+					offsets[i + 1] = total;
+				}
+			});
+
+			offsets[0] = identity;
+			for (uint32_t i = 1; i <= chunkCount; i++)
+			{
+				offsets[i] = combine(offsets[i - 1], offsets[i]);
+			}
+
+			ParallelFor(0, chunkCount, 0, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+			{
+				for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+				{
+					uint32_t first = i * chunkSize;
+					uint32_t last = (i + 1 < chunkCount) ? first + chunkSize : count;
+
+					T running = offsets[i];
+					for (uint32_t j = first; j < last; j++)
+					{
+						T value = input[j];
+						output[j] = running;
+						running = combine(running, value);
+					}
+				}
+			});
+
+			return offsets[chunkCount];
+		}
 	}
 }
\ No newline at end of file
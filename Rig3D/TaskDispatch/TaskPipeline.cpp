@@ -0,0 +1,252 @@
+#include "TaskPipeline.h"
+
+using namespace cliqCity::multicore;
+
+TaskPipeline::TaskPipeline(TaskDispatcher* dispatcher) :
+	mDispatcher(dispatcher),
+	mInput(nullptr),
+	mInputData(nullptr),
+	mInputSequence(0),
+	mStageCount(0),
+	mTokenCount(0),
+	mActiveTokenCount(0),
+	mIsInputDone(true)
+{
+	for (uint32_t i = 0; i < TASK_PIPELINE_MAX_STAGES; i++)
+	{
+		mStages[i].mSlots = nullptr;
+	}
+}
+
+TaskPipeline::~TaskPipeline()
+{
+	for (uint32_t i = 0; i < mStageCount; i++)
+	{
+		delete[] mStages[i].mSlots;
+	}
+
+	mDispatcher = nullptr;
+}
+
+void TaskPipeline::SetInput(TaskPipelineInput input, void* userData)
+{
+	mInput = input;
+	mInputData = userData;
+}
+
+void TaskPipeline::AddStage(TaskPipelineFilter filter, void* userData, TaskPipelineStageMode mode)
+{
+	if (mStageCount == TASK_PIPELINE_MAX_STAGES)
+	{
+		return;
+	}
+
+	Stage& stage = mStages[mStageCount++];
+	stage.mFilter = filter;
+	stage.mUserData = userData;
+	stage.mMode = mode;
+}
+
+TaskID TaskPipeline::Start(uint32_t tokenCount, TaskPriority priority)
+{
+	mTokenCount = (tokenCount > 0) ? tokenCount : 1;
+	mActiveTokenCount = 0;
+	mInputSequence = 0;
+	mIsInputDone = (mInput == nullptr);
+
+	for (uint32_t i = 0; i < mStageCount; i++)
+	{
+		Stage& stage = mStages[i];
+		stage.mNextSequence = 0;
+		stage.mIsBusy = false;
+
+		delete[] stage.mSlots;
+		stage.mSlots = nullptr;
+
+		if (stage.mMode == TASK_PIPELINE_SERIAL_IN_ORDER)
+		{
+			stage.mSlots = new Slot[mTokenCount];
+			for (uint32_t j = 0; j < mTokenCount; j++)
+			{
+				stage.mSlots[j].mItem = nullptr;
+				stage.mSlots[j].mIsReady = false;
+			}
+		}
+	}
+
+	// Every token runs as a child of the root so the root only finishes with the last token.
+	mRootID = mDispatcher->CreateTask(TaskData(), nullptr, priority);
+	Feed();
+	mDispatcher->RunTask(mRootID);
+
+	return mRootID;
+}
+
+void TaskPipeline::Run(uint32_t tokenCount, TaskPriority priority)
+{
+	mDispatcher->WaitForTask(Start(tokenCount, priority));
+}
+
+void TaskPipeline::Feed()
+{
+	for (;;)
+	{
+		void* item;
+		uint64_t sequence;
+
+		{
+			ScopedLock lock(mInputLock);
+			if (mIsInputDone || mActiveTokenCount == mTokenCount)
+			{
+				return;
+			}
+
+			item = mInput(mInputData);
+			if (!item)
+			{
+				mIsInputDone = true;
+				return;
+			}
+
+			sequence = mInputSequence++;
+			mActiveTokenCount++;
+		}
+
+		// Queue outside the lock. Spawning may help run tokens while the pool is exhausted and those call back into Feed.
+		Work work = { item, sequence, 0, false };
+		Spawn(work);
+	}
+}
+
+void TaskPipeline::Spawn(const Work& work)
+{
+	if (mDispatcher->TryAddTask([this, work]() { Drive(work); }, mRootID))
+	{
+		return;
+	}
+
+	// No free slot. Running the work here would recurse once per token, so leave it to this thread's driver when there is one.
+	Driver* driver = GetDriver();
+	if (driver && driver->mPipeline == this)
+	{
+		driver->mPending.push_back(work);
+		return;
+	}
+
+	Drive(work);
+}
+
+void TaskPipeline::Drive(const Work& work)
+{
+	// Anything spawned without a slot while this runs is pushed here and run once the current work returns,
+	// so the stack stays flat however long the stream is. Pending work is bounded by the tokens and stages in flight.
+	Driver driver;
+	driver.mPipeline = this;
+	driver.mOuter = GetDriver();
+	driver.mPending.push_back(work);
+
+	GetDriver() = &driver;
+	while (!driver.mPending.empty())
+	{
+		Work next = driver.mPending.back();
+		driver.mPending.pop_back();
+		Execute(next);
+	}
+
+	GetDriver() = driver.mOuter;
+}
+
+void TaskPipeline::Execute(const Work& work)
+{
+	if (work.mIsHandover)
+	{
+		uint64_t sequence;
+		void* item = ProcessSerialStage(work.mStageIndex, &sequence);
+		ProcessToken(work.mStageIndex + 1, sequence, item);
+	}
+	else
+	{
+		ProcessToken(work.mStageIndex, work.mSequence, work.mItem);
+	}
+}
+
+void TaskPipeline::ProcessToken(uint32_t stageIndex, uint64_t sequence, void* item)
+{
+	for (; stageIndex < mStageCount; stageIndex++)
+	{
+		Stage& stage = mStages[stageIndex];
+		if (stage.mMode == TASK_PIPELINE_PARALLEL)
+		{
+			item = stage.mFilter(item, stage.mUserData);
+			continue;
+		}
+
+		// Park the item. If the stage is busy or an earlier item has not arrived yet, whoever runs that item picks this one up.
+		{
+			ScopedLock lock(stage.mLock);
+			Slot& slot = stage.mSlots[sequence % mTokenCount];
+			slot.mItem = item;
+			slot.mIsReady = true;
+
+			if (stage.mIsBusy || sequence != stage.mNextSequence)
+			{
+				return;
+			}
+
+			stage.mIsBusy = true;
+		}
+
+		item = ProcessSerialStage(stageIndex, &sequence);
+	}
+
+	FinishToken();
+}
+
+void* TaskPipeline::ProcessSerialStage(uint32_t stageIndex, uint64_t* sequence)
+{
+	Stage& stage = mStages[stageIndex];
+	void* item;
+
+	{
+		ScopedLock lock(stage.mLock);
+		Slot& slot = stage.mSlots[stage.mNextSequence % mTokenCount];
+		*sequence = stage.mNextSequence;
+		item = slot.mItem;
+		slot.mIsReady = false;
+	}
+
+	item = stage.mFilter(item, stage.mUserData);
+
+	bool isNextReady;
+	{
+		ScopedLock lock(stage.mLock);
+		stage.mNextSequence++;
+		isNextReady = stage.mSlots[stage.mNextSequence % mTokenCount].mIsReady;
+		stage.mIsBusy = isNextReady;
+	}
+
+	// The next item arrived while this one ran. Hand the stage over to a new task so this token can move on.
+	if (isNextReady)
+	{
+		Work work = { nullptr, 0, stageIndex, true };
+		Spawn(work);
+	}
+
+	return item;
+}
+
+TaskPipeline::Driver*& TaskPipeline::GetDriver()
+{
+	static thread_local Driver* driver = nullptr;
+	return driver;
+}
+
+void TaskPipeline::FinishToken()
+{
+	{
+		ScopedLock lock(mInputLock);
+		mActiveTokenCount--;
+	}
+
+	Feed();
+}
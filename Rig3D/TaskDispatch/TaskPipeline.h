@@ -0,0 +1,107 @@
+#pragma once
+#include <vector>
+#include "TaskDispatcher.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+#define TASK_PIPELINE_MAX_STAGES 8
+
+namespace cliqCity
+{
+	namespace multicore
+	{
+		// Returns the next item to send down the pipeline, or null once the input is exhausted. Always called serially.
+		typedef void*(*TaskPipelineInput)(void* userData);
+
+		// Transforms an item and returns what the next stage receives.
+		typedef void*(*TaskPipelineFilter)(void* item, void* userData);
+
+		enum TaskPipelineStageMode
+		{
+			TASK_PIPELINE_SERIAL_IN_ORDER,	// One item at a time, in the order the input produced them.
+			TASK_PIPELINE_PARALLEL			// Any number of items at once.
+		};
+
+		// Streams items from an input through a fixed sequence of stages on a TaskDispatcher, e.g. read, parse, upload.
+		// At most tokenCount items are in flight at once. The input is not called again until an item leaves the last stage.
+		class RIG3D TaskPipeline
+		{
+		public:
+			TaskPipeline(TaskDispatcher* dispatcher);
+			~TaskPipeline();
+
+			void SetInput(TaskPipelineInput input, void* userData);
+			void AddStage(TaskPipelineFilter filter, void* userData, TaskPipelineStageMode mode);
+
+			// Starts pulling from the input. The returned task finishes once the input is exhausted and every item has left the last stage.
+			TaskID	Start(uint32_t tokenCount, TaskPriority priority = TASK_PRIORITY_NORMAL);
+
+			// Start and wait for completion, helping the dispatcher meanwhile.
+			void	Run(uint32_t tokenCount, TaskPriority priority = TASK_PRIORITY_NORMAL);
+
+		private:
+			struct Slot
+			{
+				void*	mItem;
+				bool	mIsReady;
+			};
+
+			// A token entering the first stage, or a serial stage handed over to run its next parked item.
+			struct Work
+			{
+				void*		mItem;
+				uint64_t	mSequence;
+				uint32_t	mStageIndex;
+				bool		mIsHandover;
+			};
+
+			// Work that found no free task slot, run by a loop on the thread that produced it instead of recursing.
+			struct Driver
+			{
+				TaskPipeline*		mPipeline;
+				std::vector<Work>	mPending;
+				Driver*				mOuter;		// Driver of another pipeline further up this thread's stack.
+			};
+
+			struct Stage
+			{
+				TaskPipelineFilter		mFilter;
+				void*					mUserData;
+				TaskPipelineStageMode	mMode;
+				Mutex					mLock;			// Serial stages only.
+				Slot*					mSlots;			// Items waiting for their turn, indexed by sequence modulo the token count.
+				uint64_t				mNextSequence;
+				bool					mIsBusy;
+			};
+
+			TaskDispatcher*		mDispatcher;
+			TaskPipelineInput	mInput;
+			void*				mInputData;
+			Mutex				mInputLock;
+			Stage				mStages[TASK_PIPELINE_MAX_STAGES];
+			TaskID				mRootID;
+			uint64_t			mInputSequence;
+			uint32_t			mStageCount;
+			uint32_t			mTokenCount;
+			uint32_t			mActiveTokenCount;
+			bool				mIsInputDone;
+
+			void	Feed();
+			void	Spawn(const Work& work);
+			void	Drive(const Work& work);
+			void	Execute(const Work& work);
+			void	ProcessToken(uint32_t stageIndex, uint64_t sequence, void* item);
+			void*	ProcessSerialStage(uint32_t stageIndex, uint64_t* sequence);
+			void	FinishToken();
+
+			static Driver*& GetDriver();
+
+			TaskPipeline(TaskPipeline const&) = delete;
+			void operator=(TaskPipeline const&) = delete;
+		};
+	}
+}
@@ -0,0 +1,102 @@
+#include "TaskPool.h"
+#include <new>
+
+using namespace cliqCity::multicore;
+
+// Head layout: low 32 bits hold the free slot index + 1 (0 when empty), high 32 bits hold the tag.
+#define TASK_POOL_EMPTY			0xffffffff
+#define TASK_POOL_INDEX(head)	(static_cast<uint32_t>(head) - 1)
+#define TASK_POOL_TAG(head)		(static_cast<uint32_t>((head) >> 32))
+#define TASK_POOL_HEAD(index, tag)	((static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>((index) + 1))
+
+TaskPool::TaskPool(void* memory, size_t size) :
+	mHead(0),
+	mTasks(nullptr),
+	mCapacity(0)
+{
+	uintptr_t address = reinterpret_cast<uintptr_t>(memory);
+	size_t padding = (alignof(Task) - address % alignof(Task)) % alignof(Task);
+	if (memory && size > padding)
+	{
+		mTasks = reinterpret_cast<Task*>(address + padding);
+		mCapacity = static_cast<uint32_t>((size - padding) / sizeof(Task));
+	}
+
+	for (uint32_t i = 0; i < mCapacity; i++)
+	{
+		Task* task = new (&mTasks[i]) Task();
+		task->mNextFree.store((i + 1 < mCapacity) ? i + 1 : TASK_POOL_EMPTY, std::memory_order_relaxed);
+	}
+
+	if (mCapacity > 0)
+	{
+		mHead.store(TASK_POOL_HEAD(0, 0), std::memory_order_release);
+	}
+}
+
+TaskPool::~TaskPool()
+{
+	for (uint32_t i = 0; i < mCapacity; i++)
+	{
+		mTasks[i].~Task();
+	}
+}
+
+Task* TaskPool::Allocate()
+{
+	uint64_t head = mHead.load(std::memory_order_acquire);
+	uint64_t next;
+	Task* task;
+
+	do
+	{
+		if (static_cast<uint32_t>(head) == 0)
+		{
+			// Exhausted
+			return nullptr;
+		}
+
+		// The slot may be allocated and relinked by another thread after this read. The tag makes that CAS fail.
+		task = &mTasks[TASK_POOL_INDEX(head)];
+		next = TASK_POOL_HEAD(task->mNextFree.load(std::memory_order_relaxed), TASK_POOL_TAG(head) + 1);
+	} while (!mHead.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire));
+
+	task->mGeneration.fetch_add(1, std::memory_order_relaxed);
+	return task;
+}
+
+void TaskPool::Free(Task* task)
+{
+	// Release the generation before the slot becomes reusable so waiters see the task's writes.
+	task->mGeneration.fetch_add(1, std::memory_order_release);
+
+	uint32_t index = GetOffset(task);
+	uint64_t head = mHead.load(std::memory_order_relaxed);
+	uint64_t next;
+
+	do
+	{
+		task->mNextFree.store(TASK_POOL_INDEX(head), std::memory_order_relaxed);
+		next = TASK_POOL_HEAD(index, TASK_POOL_TAG(head) + 1);
+	} while (!mHead.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+Task* TaskPool::GetTask(uint32_t offset) const
+{
+	return mTasks + offset;
+}
+
+uint32_t TaskPool::GetOffset(const Task* task) const
+{
+	return static_cast<uint32_t>(task - mTasks);
+}
+
+uint32_t TaskPool::GetCapacity() const
+{
+	return mCapacity;
+}
+
+bool TaskPool::IsEmpty() const
+{
+	return static_cast<uint32_t>(mHead.load(std::memory_order_relaxed)) == 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "Task.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+namespace cliqCity
+{
+	namespace multicore
+	{
+		// Lock-free fixed size pool of Task slots. Free slots form a Treiber stack whose head packs the slot index
+		// with a tag that changes on every push and pop, so a stale head can never be swapped back in (ABA).
+		// Each slot's generation is bumped on allocate and on free, so live tasks have odd generations and a TaskID
+		// only matches its slot again after 2^31 reuses of that same slot.
+		class RIG3D TaskPool
+		{
+		public:
+			// Memory is aligned up to alignof(Task) first, so size should leave room for that when memory is not aligned.
+			TaskPool(void* memory, size_t size);
+			~TaskPool();
+
+			Task*	Allocate();
+			void	Free(Task* task);
+
+			Task*		GetTask(uint32_t offset) const;
+			uint32_t	GetOffset(const Task* task) const;
+			uint32_t	GetCapacity() const;
+			bool		IsEmpty() const;
+
+		private:
+			std::atomic<uint64_t>	mHead;
+			Task*					mTasks;
+			uint32_t				mCapacity;
+
+			TaskPool(TaskPool const&) = delete;
+			void operator=(TaskPool const&) = delete;
+		};
+	}
+}
@@ -0,0 +1,306 @@
+#include "TaskProfiler.h"
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdio.h>
+
+using namespace cliqCity::multicore;
+
+// Writes text as the contents of a JSON string, so names containing quotes, backslashes or control characters stay loadable.
+static void WriteJsonString(std::ostream& stream, const char* text)
+{
+	for (const char* c = text; *c; c++)
+	{
+		switch (*c)
+		{
+		case '"':
+			stream << "\\\"";
+			break;
+		case '\\':
+			stream << "\\\\";
+			break;
+		case '\n':
+			stream << "\\n";
+			break;
+		case '\r':
+			stream << "\\r";
+			break;
+		case '\t':
+			stream << "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(*c) < 0x20)
+			{
+				char escape[8];
+				snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(*c)));
+				stream << escape;
+			}
+			else
+			{
+				stream << *c;
+			}
+			break;
+		}
+	}
+}
+
+TaskProfiler::TaskProfiler(uint32_t threadCount, uint32_t eventsPerThread) :
+	mRings(nullptr),
+	mRingCount(threadCount + 1),
+	mRingCapacity(1)
+{
+	// Power of two so the write index can wrap with a mask.
+	while (mRingCapacity < eventsPerThread)
+	{
+		mRingCapacity <<= 1;
+	}
+
+	mRings = new EventRing[mRingCount];
+	for (uint32_t i = 0; i < mRingCount; i++)
+	{
+		mRings[i].mEvents = new TaskEvent[mRingCapacity];
+	}
+
+	Reset();
+}
+
+TaskProfiler::~TaskProfiler()
+{
+	for (uint32_t i = 0; i < mRingCount; i++)
+	{
+		delete[] mRings[i].mEvents;
+	}
+
+	delete[] mRings;
+}
+
+void TaskProfiler::Reset()
+{
+	for (uint32_t i = 0; i < mRingCount; i++)
+	{
+		mRings[i].mWriteIndex.store(0, std::memory_order_relaxed);
+		mRings[i].mContentionCount.store(0, std::memory_order_relaxed);
+	}
+
+	mEpoch = std::chrono::high_resolution_clock::now();
+}
+
+uint64_t TaskProfiler::GetTime() const
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - mEpoch).count());
+}
+
+void TaskProfiler::RecordEvent(uint32_t threadIndex, const TaskEvent& event)
+{
+	// Rings are per thread except the one shared by non worker threads, so claim the slot atomically.
+	EventRing& ring = mRings[GetRingIndex(threadIndex)];
+	uint64_t index = ring.mWriteIndex.fetch_add(1, std::memory_order_relaxed);
+	ring.mEvents[index & (mRingCapacity - 1)] = event;
+}
+
+void TaskProfiler::RecordContention(uint32_t threadIndex)
+{
+	mRings[GetRingIndex(threadIndex)].mContentionCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TaskProfiler::SetTaskCapacity(uint32_t capacity)
+{
+	mEnqueues.assign(capacity, TaskEnqueue());
+}
+
+void TaskProfiler::RecordEnqueue(uint32_t taskOffset, uint64_t time, uint32_t queueDepth)
+{
+	// Only the thread queueing a task writes its slot, and the queue orders the write before the executing thread's read.
+	if (taskOffset < mEnqueues.size())
+	{
+		mEnqueues[taskOffset].mTime = time;
+		mEnqueues[taskOffset].mQueueDepth = queueDepth;
+	}
+}
+
+void TaskProfiler::GetEnqueue(uint32_t taskOffset, TaskEvent* event) const
+{
+	if (taskOffset < mEnqueues.size())
+	{
+		event->mEnqueueTime = mEnqueues[taskOffset].mTime;
+		event->mQueueDepth = mEnqueues[taskOffset].mQueueDepth;
+	}
+	else
+	{
+		event->mEnqueueTime = event->mStartTime;
+		event->mQueueDepth = 0;
+	}
+}
+
+void TaskProfiler::SetKernelName(TaskKernel kernel, const char* name)
+{
+	mKernelNames[kernel] = name;
+}
+
+void TaskProfiler::GetStats(TaskProfilerStats* stats) const
+{
+	std::vector<uint64_t> waitTimes;
+	uint64_t firstTime = UINT64_MAX;
+	uint64_t lastTime = 0;
+	uint64_t busyTime = 0;
+	uint64_t idleTime = 0;
+	uint64_t queueDepth = 0;
+
+	stats->mSleepCount = 0;
+	stats->mInlineCount = 0;
+	stats->mContentionCount = 0;
+	stats->mDroppedEventCount = 0;
+
+	for (uint32_t r = 0; r < mRingCount; r++)
+	{
+		const EventRing& ring = mRings[r];
+		uint64_t written = ring.mWriteIndex.load(std::memory_order_acquire);
+		uint64_t count = std::min<uint64_t>(written, mRingCapacity);
+
+		stats->mDroppedEventCount += static_cast<uint32_t>(written - count);
+		stats->mContentionCount += ring.mContentionCount.load(std::memory_order_relaxed);
+
+		for (uint64_t i = written - count; i < written; i++)
+		{
+			const TaskEvent& event = ring.mEvents[i & (mRingCapacity - 1)];
+			firstTime = std::min(firstTime, event.mStartTime);
+			lastTime = std::max(lastTime, event.mEndTime);
+
+			if (event.mType == TASK_EVENT_IDLE)
+			{
+				idleTime += event.mEndTime - event.mStartTime;
+				stats->mSleepCount++;
+				continue;
+			}
+
+			// The last ring is shared by threads the dispatcher does not own, which are not part of its worker time.
+			if (r + 1 < mRingCount || mRingCount == 1)
+			{
+				busyTime += event.mEndTime - event.mStartTime;
+			}
+
+			if (event.mType == TASK_EVENT_INLINE)
+			{
+				stats->mInlineCount++;
+			}
+			else
+			{
+				queueDepth += event.mQueueDepth;
+				waitTimes.push_back(event.mStartTime - event.mEnqueueTime);
+			}
+		}
+	}
+
+	uint64_t elapsedTime = (lastTime > firstTime) ? lastTime - firstTime : 0;
+	uint32_t workerCount = (mRingCount > 1) ? mRingCount - 1 : 1;
+
+	stats->mTaskCount = static_cast<uint32_t>(waitTimes.size());
+	stats->mElapsedTime = elapsedTime * 1e-6;
+	stats->mIdleTime = idleTime * 1e-6;
+	stats->mUtilization = (elapsedTime > 0) ? static_cast<double>(busyTime) / (static_cast<double>(elapsedTime) * workerCount) : 0.0;
+	stats->mMeanWaitTime = 0.0;
+	stats->mP99WaitTime = 0.0;
+	stats->mMeanQueueDepth = 0.0;
+
+	if (!waitTimes.empty())
+	{
+		uint64_t totalWaitTime = 0;
+		for (uint64_t waitTime : waitTimes)
+		{
+			totalWaitTime += waitTime;
+		}
+
+		size_t p99 = (waitTimes.size() * 99) / 100;
+		std::nth_element(waitTimes.begin(), waitTimes.begin() + p99, waitTimes.end());
+
+		stats->mMeanWaitTime = (totalWaitTime * 1e-6) / waitTimes.size();
+		stats->mP99WaitTime = waitTimes[p99] * 1e-6;
+		stats->mMeanQueueDepth = static_cast<double>(queueDepth) / waitTimes.size();
+	}
+}
+
+bool TaskProfiler::ExportChromeTrace(const char* filename) const
+{
+	std::ofstream trace(filename);
+	if (!trace.is_open())
+	{
+		return false;
+	}
+
+	// Chrome trace event format: https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+	trace << std::fixed << std::setprecision(3);
+	trace << "{\"traceEvents\":[\n";
+
+	bool first = true;
+	for (uint32_t r = 0; r < mRingCount; r++)
+	{
+		trace << (first ? "" : ",\n");
+		char threadName[32];
+		if (r + 1 < mRingCount)
+		{
+			snprintf(threadName, sizeof(threadName), "Worker %u", r);
+		}
+		else
+		{
+			snprintf(threadName, sizeof(threadName), "Main");
+		}
+
+		trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << r << ",\"args\":{\"name\":\"";
+		WriteJsonString(trace, threadName);
+		trace << "\"}}";
+		first = false;
+	}
+
+	char name[32];
+	for (uint32_t r = 0; r < mRingCount; r++)
+	{
+		const EventRing& ring = mRings[r];
+		uint64_t written = ring.mWriteIndex.load(std::memory_order_acquire);
+		uint64_t count = std::min<uint64_t>(written, mRingCapacity);
+
+		for (uint64_t i = written - count; i < written; i++)
+		{
+			const TaskEvent& event = ring.mEvents[i & (mRingCapacity - 1)];
+			const char* eventName = "Idle";
+
+			if (event.mType != TASK_EVENT_IDLE)
+			{
+				auto kernelName = mKernelNames.find(event.mKernel);
+				if (kernelName != mKernelNames.end())
+				{
+					eventName = kernelName->second;
+				}
+				else
+				{
+					snprintf(name, sizeof(name), "Task %p", reinterpret_cast<void*>(event.mKernel));
+					eventName = name;
+				}
+			}
+
+			trace << ",\n{\"name\":\"";
+			WriteJsonString(trace, eventName);
+			trace << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.mThreadIndex
+				<< ",\"ts\":" << event.mStartTime * 1e-3
+				<< ",\"dur\":" << (event.mEndTime - event.mStartTime) * 1e-3;
+
+			if (event.mType != TASK_EVENT_IDLE)
+			{
+				trace << ",\"args\":{\"wait_us\":" << (event.mStartTime - event.mEnqueueTime) * 1e-3
+					<< ",\"queue_depth\":" << event.mQueueDepth
+					<< ",\"priority\":" << static_cast<uint32_t>(event.mPriority)
+					<< ",\"inline\":" << ((event.mType == TASK_EVENT_INLINE) ? "true" : "false") << "}";
+			}
+
+			trace << "}";
+		}
+	}
+
+	trace << "\n]}\n";
+	return trace.good();
+}
+
+inline uint32_t TaskProfiler::GetRingIndex(uint32_t threadIndex) const
+{
+	return (threadIndex < mRingCount) ? threadIndex : mRingCount - 1;
+}
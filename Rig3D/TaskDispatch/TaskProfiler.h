@@ -0,0 +1,108 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <vector>
+#include "Task.h"
+
+#pragma warning (disable: 4251)
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+namespace cliqCity
+{
+	namespace multicore
+	{
+		enum TaskEventType
+		{
+			TASK_EVENT_EXECUTE,		// A kernel ran. mEnqueueTime is when it was queued.
+			TASK_EVENT_IDLE,		// A worker slept on the task signal.
+			TASK_EVENT_INLINE		// A kernel ran on the thread adding it because no task slot was free.
+		};
+
+		struct RIG3D TaskEvent
+		{
+			TaskKernel		mKernel;
+			uint64_t		mEnqueueTime;	// Nanoseconds since the profiler was reset.
+			uint64_t		mStartTime;
+			uint64_t		mEndTime;
+			uint32_t		mQueueDepth;	// Tasks pending at the same priority when this one was queued.
+			uint16_t		mThreadIndex;	// Worker index, or the worker count for non worker threads.
+			uint8_t			mPriority;
+			uint8_t			mType;
+		};
+
+		struct RIG3D TaskProfilerStats
+		{
+			double		mElapsedTime;		// Milliseconds between the first and last recorded event.
+			double		mUtilization;		// Fraction of worker time spent running kernels. Kernels run by non worker threads are not counted.
+			double		mMeanWaitTime;		// Milliseconds between enqueue and start.
+			double		mP99WaitTime;
+			double		mMeanQueueDepth;
+			double		mIdleTime;			// Total milliseconds workers spent asleep.
+			uint32_t	mTaskCount;			// Queued tasks. Wait and queue depth stats cover these only.
+			uint32_t	mInlineCount;		// Tasks run inline because the task pool was empty.
+			uint32_t	mSleepCount;
+			uint32_t	mContentionCount;	// Times a dispatcher lock was already held when requested.
+			uint32_t	mDroppedEventCount;	// Events overwritten because a ring buffer wrapped.
+		};
+
+		// Optional instrumentation for a TaskDispatcher. Each thread writes to its own ring buffer without locks. Stats and exports
+		// read every ring and should only be called while the dispatcher is idle (after Synchronize(TASK_PRIORITY_BACKGROUND) or Pause).
+		class RIG3D TaskProfiler
+		{
+		public:
+			TaskProfiler(uint32_t threadCount, uint32_t eventsPerThread);
+			~TaskProfiler();
+
+			void Reset();
+
+			uint64_t GetTime() const;
+			void RecordEvent(uint32_t threadIndex, const TaskEvent& event);
+			void RecordContention(uint32_t threadIndex);
+
+			// Enqueue time and queue depth of each task slot, kept here so task slots do not carry profiler state.
+			// Sized by the dispatcher when the profiler is attached. Slots beyond the capacity are not tracked.
+			void SetTaskCapacity(uint32_t capacity);
+			void RecordEnqueue(uint32_t taskOffset, uint64_t time, uint32_t queueDepth);
+			void GetEnqueue(uint32_t taskOffset, TaskEvent* event) const;
+
+			void SetKernelName(TaskKernel kernel, const char* name);
+
+			void GetStats(TaskProfilerStats* stats) const;
+			bool ExportChromeTrace(const char* filename) const;
+
+		private:
+			struct EventRing
+			{
+				TaskEvent*				mEvents;
+				std::atomic<uint64_t>	mWriteIndex;
+				std::atomic<uint32_t>	mContentionCount;
+				char					mPadding[64];
+			};
+
+			struct TaskEnqueue
+			{
+				uint64_t	mTime;
+				uint32_t	mQueueDepth;
+			};
+
+			std::map<TaskKernel, const char*>				mKernelNames;
+			std::vector<TaskEnqueue>						mEnqueues;		// Indexed by task slot.
+			std::chrono::high_resolution_clock::time_point	mEpoch;
+			EventRing*		mRings;
+			uint32_t		mRingCount;
+			uint32_t		mRingCapacity;
+
+			uint32_t GetRingIndex(uint32_t threadIndex) const;
+
+			TaskProfiler(TaskProfiler const&) = delete;
+			void operator=(TaskProfiler const&) = delete;
+		};
+	}
+}
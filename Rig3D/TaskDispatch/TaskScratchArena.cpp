@@ -0,0 +1,67 @@
+#include "TaskScratchArena.h"
+
+using namespace cliqCity::multicore;
+
+TaskScratchArena::TaskScratchArena() :
+	mMemory(nullptr),
+	mSize(0),
+	mOffset(0),
+	mPeakSize(0)
+{
+
+}
+
+TaskScratchArena::~TaskScratchArena()
+{
+	mMemory = nullptr;
+}
+
+void TaskScratchArena::Initialize(void* memory, size_t size)
+{
+	mMemory = reinterpret_cast<uint8_t*>(memory);
+	mSize = size;
+	mOffset = 0;
+	mPeakSize = 0;
+}
+
+void* TaskScratchArena::Allocate(size_t size, size_t alignment)
+{
+	// Align the address rather than the offset since the block itself may not be aligned.
+	uintptr_t address = reinterpret_cast<uintptr_t>(mMemory) + mOffset;
+	uintptr_t aligned = (address + (alignment - 1)) & ~static_cast<uintptr_t>(alignment - 1);
+	size_t offset = mOffset + (aligned - address);
+
+	if (offset + size > mSize)
+	{
+		return nullptr;
+	}
+
+	mOffset = offset + size;
+	mPeakSize = (mOffset > mPeakSize) ? mOffset : mPeakSize;
+	return reinterpret_cast<void*>(aligned);
+}
+
+size_t TaskScratchArena::GetMarker() const
+{
+	return mOffset;
+}
+
+void TaskScratchArena::Rewind(size_t marker)
+{
+	mOffset = marker;
+}
+
+void TaskScratchArena::Reset()
+{
+	mOffset = 0;
+}
+
+size_t TaskScratchArena::GetCapacity() const
+{
+	return mSize;
+}
+
+size_t TaskScratchArena::GetPeakSize() const
+{
+	return mPeakSize;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+namespace cliqCity
+{
+	namespace multicore
+	{
+		// Bump allocator over a fixed block owned by a single thread. Allocations are released all at once by rewinding to a marker.
+		// TaskDispatcher rewinds each worker's arena after every task, so kernels never free scratch memory themselves.
+		class RIG3D TaskScratchArena
+		{
+		public:
+			TaskScratchArena();
+			~TaskScratchArena();
+
+			void Initialize(void* memory, size_t size);
+
+			// Returns null when the arena is exhausted. alignment must be a power of two.
+			void* Allocate(size_t size, size_t alignment = 16);
+
+			template<class T>
+			T* Allocate(uint32_t count)
+			{
+				return reinterpret_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+			}
+
+			size_t	GetMarker() const;
+			void	Rewind(size_t marker);
+			void	Reset();
+
+			size_t	GetCapacity() const;
+			size_t	GetPeakSize() const;		// Most bytes in use at once since Initialize.
+
+		private:
+			uint8_t*	mMemory;
+			size_t		mSize;
+			size_t		mOffset;
+			size_t		mPeakSize;
+
+			TaskScratchArena(TaskScratchArena const&) = delete;
+			void operator=(TaskScratchArena const&) = delete;
+		};
+	}
+}
@@ -0,0 +1,250 @@
+#include "TaskTopology.h"
+#include <thread>
+#include <vector>
+#include <map>
+#include <utility>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace cliqCity::multicore;
+
+#if defined(__linux__)
+static bool ReadTopologyValue(uint32_t processor, const char* name, int* value)
+{
+	char path[128];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/%s", processor, name);
+
+	FILE* file = fopen(path, "r");
+	if (!file)
+	{
+		return false;
+	}
+
+	bool result = fscanf(file, "%d", value) == 1;
+	fclose(file);
+	return result;
+}
+#endif
+
+static bool QueryTaskTopology(TaskTopology* topology)
+{
+	uint32_t count = topology->mLogicalProcessorCount;
+
+#if defined(_WIN32)
+	DWORD length = 0;
+	GetLogicalProcessorInformation(nullptr, &length);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+	{
+		return false;
+	}
+
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> processors(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (!GetLogicalProcessorInformation(processors.data(), &length))
+	{
+		return false;
+	}
+
+	// Only the calling thread's processor group (at most 64 logical processors) is reported.
+	uint16_t coreCount = 0;
+	uint16_t packageCount = 0;
+	for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& info : processors)
+	{
+		if (info.Relationship != RelationProcessorCore && info.Relationship != RelationProcessorPackage)
+		{
+			continue;
+		}
+
+		for (uint32_t i = 0; i < count && i < sizeof(ULONG_PTR) * 8; i++)
+		{
+			if (info.ProcessorMask & (static_cast<ULONG_PTR>(1) << i))
+			{
+				if (info.Relationship == RelationProcessorCore)
+				{
+					topology->mProcessorCores[i] = coreCount;
+				}
+				else
+				{
+					topology->mProcessorPackages[i] = packageCount;
+				}
+			}
+		}
+
+		if (info.Relationship == RelationProcessorCore)
+		{
+			coreCount++;
+		}
+		else
+		{
+			packageCount++;
+		}
+	}
+
+	if (coreCount == 0)
+	{
+		return false;
+	}
+
+	topology->mPhysicalCoreCount = coreCount;
+	topology->mPackageCount = (packageCount > 0) ? packageCount : 1;
+	return true;
+#elif defined(__linux__)
+	// Core ids are only unique within a package, so key cores by both.
+	std::map<std::pair<int, int>, uint16_t> cores;
+	std::map<int, uint16_t> packages;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int package, core;
+		if (!ReadTopologyValue(i, "physical_package_id", &package) || !ReadTopologyValue(i, "core_id", &core))
+		{
+			return false;
+		}
+
+		auto packageIndex = packages.insert(std::make_pair(package, static_cast<uint16_t>(packages.size()))).first;
+		auto coreIndex = cores.insert(std::make_pair(std::make_pair(package, core), static_cast<uint16_t>(cores.size()))).first;
+
+		topology->mProcessorPackages[i] = packageIndex->second;
+		topology->mProcessorCores[i] = coreIndex->second;
+	}
+
+	topology->mPhysicalCoreCount = static_cast<uint32_t>(cores.size());
+	topology->mPackageCount = static_cast<uint32_t>(packages.size());
+	return true;
+#else
+	return false;
+#endif
+}
+
+static TaskTopology CreateTaskTopology()
+{
+	TaskTopology topology;
+
+	uint32_t count = std::thread::hardware_concurrency();
+	count = (count > 0) ? count : 1;
+	count = (count < TASK_MAX_LOGICAL_PROCESSORS) ? count : TASK_MAX_LOGICAL_PROCESSORS;
+
+	topology.mLogicalProcessorCount = count;
+
+	if (!QueryTaskTopology(&topology))
+	{
+		topology.mPhysicalCoreCount = count;
+		topology.mPackageCount = 1;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			topology.mProcessorCores[i] = static_cast<uint16_t>(i);
+			topology.mProcessorPackages[i] = 0;
+		}
+	}
+
+	return topology;
+}
+
+const TaskTopology& cliqCity::multicore::GetTaskTopology()
+{
+	static const TaskTopology topology = CreateTaskTopology();
+	return topology;
+}
+
+uint32_t cliqCity::multicore::GetCurrentProcessor(const TaskTopology& topology)
+{
+#if defined(_WIN32)
+	uint32_t processor = GetCurrentProcessorNumber();
+#elif defined(__linux__)
+	int cpu = sched_getcpu();
+	uint32_t processor = (cpu >= 0) ? static_cast<uint32_t>(cpu) : 0;
+#else
+	uint32_t processor = 0;
+#endif
+
+	return (processor < topology.mLogicalProcessorCount) ? processor : 0;
+}
+
+uint8_t cliqCity::multicore::GetDefaultTaskThreadCount(const TaskTopology& topology)
+{
+	uint16_t reservedCore = topology.mProcessorCores[GetCurrentProcessor(topology)];
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < topology.mLogicalProcessorCount; i++)
+	{
+		if (topology.mProcessorCores[i] != reservedCore)
+		{
+			count++;
+		}
+	}
+
+	// Keep at least one worker so queued work still runs asynchronously on single core machines.
+	count = (count > 0) ? count : 1;
+	return static_cast<uint8_t>((count < UINT8_MAX) ? count : UINT8_MAX);
+}
+
+void cliqCity::multicore::CreateTaskThreadLayout(const TaskTopology& topology, uint8_t threadCount, bool pinThreads, TaskThreadLayout* layout)
+{
+	layout->mThreadCount = threadCount;
+	layout->mIsPinned = pinThreads;
+	layout->mReservedProcessor = static_cast<uint16_t>(GetCurrentProcessor(topology));
+	layout->mReservedCore = topology.mProcessorCores[layout->mReservedProcessor];
+
+	// SMT rank of each logical processor: 0 for the first processor on a core, 1 for its sibling and so on.
+	uint16_t ranks[TASK_MAX_LOGICAL_PROCESSORS];
+	uint16_t maxRank = 0;
+	for (uint32_t i = 0; i < topology.mLogicalProcessorCount; i++)
+	{
+		ranks[i] = 0;
+		for (uint32_t j = 0; j < i; j++)
+		{
+			if (topology.mProcessorCores[j] == topology.mProcessorCores[i])
+			{
+				ranks[i]++;
+			}
+		}
+
+		maxRank = (ranks[i] > maxRank) ? ranks[i] : maxRank;
+	}
+
+	// Order processors by rank, other cores before the reserved one.
+	uint16_t order[TASK_MAX_LOGICAL_PROCESSORS];
+	uint32_t orderCount = 0;
+	for (int reserved = 0; reserved < 2; reserved++)
+	{
+		for (uint16_t rank = 0; rank <= maxRank; rank++)
+		{
+			for (uint32_t i = 0; i < topology.mLogicalProcessorCount; i++)
+			{
+				if ((topology.mProcessorCores[i] == layout->mReservedCore) == (reserved == 1) && ranks[i] == rank)
+				{
+					order[orderCount++] = static_cast<uint16_t>(i);
+				}
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		layout->mWorkerProcessors[i] = order[i % orderCount];
+	}
+}
+
+bool cliqCity::multicore::PinCurrentThread(uint32_t logicalProcessor)
+{
+#if defined(_WIN32)
+	if (logicalProcessor >= sizeof(DWORD_PTR) * 8)
+	{
+		return false;
+	}
+
+	return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << logicalProcessor) != 0;
+#elif defined(__linux__)
+	cpu_set_t processors;
+	CPU_ZERO(&processors);
+	CPU_SET(logicalProcessor, &processors);
+	return pthread_setaffinity_np(pthread_self(), sizeof(processors), &processors) == 0;
+#else
+	return false;
+#endif
+}
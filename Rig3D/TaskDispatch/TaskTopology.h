@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+#define TASK_MAX_LOGICAL_PROCESSORS 256
+
+namespace cliqCity
+{
+	namespace multicore
+	{
+		// Logical processors as reported by the OS. SMT siblings share a core index.
+		struct RIG3D TaskTopology
+		{
+			uint32_t	mLogicalProcessorCount;
+			uint32_t	mPhysicalCoreCount;
+			uint32_t	mPackageCount;
+			uint16_t	mProcessorCores[TASK_MAX_LOGICAL_PROCESSORS];		// Dense physical core index of each logical processor.
+			uint16_t	mProcessorPackages[TASK_MAX_LOGICAL_PROCESSORS];
+		};
+
+		// Worker placement chosen by a TaskDispatcher. Exposed for diagnostics.
+		struct RIG3D TaskThreadLayout
+		{
+			uint16_t	mWorkerProcessors[TASK_MAX_LOGICAL_PROCESSORS];	// Logical processor each worker runs on when pinned.
+			uint16_t	mReservedProcessor;	// Logical processor the thread creating the layout was running on.
+			uint16_t	mReservedCore;		// Its physical core, left to that thread.
+			uint8_t		mThreadCount;
+			bool		mIsPinned;
+		};
+
+		// Queried once from GetLogicalProcessorInformation on Windows or /sys/devices/system/cpu on Linux.
+		// Falls back to one core per hardware thread when neither is available.
+		RIG3D const TaskTopology& GetTaskTopology();
+
+		// Logical processor the calling thread is running on right now, or 0 when the OS cannot tell. Unpinned threads may move at any time.
+		RIG3D uint32_t GetCurrentProcessor(const TaskTopology& topology);
+
+		// One worker per logical processor except those on the calling thread's current core, and at least one.
+		RIG3D uint8_t GetDefaultTaskThreadCount(const TaskTopology& topology);
+
+		// Reserves the calling thread's current core. Spreads workers over distinct physical cores before doubling up on SMT siblings,
+		// skipping the reserved core while others are free.
+		RIG3D void CreateTaskThreadLayout(const TaskTopology& topology, uint8_t threadCount, bool pinThreads, TaskThreadLayout* layout);
+
+		RIG3D bool PinCurrentThread(uint32_t logicalProcessor);
+	}
+}
@@ -0,0 +1,112 @@
+#include "WorkStealingQueue.h"
+
+using namespace cliqCity::multicore;
+
+WorkStealingQueue::WorkStealingQueue() :
+	mTop(0),
+	mBottom(0),
+	mEntries(nullptr),
+	mMask(0)
+{
+
+}
+
+WorkStealingQueue::~WorkStealingQueue()
+{
+	delete[] mEntries;
+}
+
+void WorkStealingQueue::Initialize(uint32_t capacity)
+{
+	// Round capacity up to a power of two so indices can wrap with a mask.
+	int64_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	delete[] mEntries;
+	mEntries = new std::atomic<Task*>[size];
+	mMask = size - 1;
+	mTop.store(0, std::memory_order_relaxed);
+	mBottom.store(0, std::memory_order_relaxed);
+}
+
+bool WorkStealingQueue::Push(Task* task)
+{
+	int64_t bottom = mBottom.load(std::memory_order_relaxed);
+	int64_t top = mTop.load(std::memory_order_acquire);
+
+	if (bottom - top > mMask)
+	{
+		// Full
+		return false;
+	}
+
+	mEntries[bottom & mMask].store(task, std::memory_order_relaxed);
+
+	// Publish the entry before making it visible to thieves.
+	std::atomic_thread_fence(std::memory_order_release);
+	mBottom.store(bottom + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Task* WorkStealingQueue::Pop()
+{
+	int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+	mBottom.store(bottom, std::memory_order_relaxed);
+
+	// Reserve the bottom entry before reading top so a concurrent Steal sees the reservation.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = mTop.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		// Empty
+		mBottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Task* task = mEntries[bottom & mMask].load(std::memory_order_relaxed);
+	if (top == bottom)
+	{
+		// Last entry. Race any thieves for it.
+		if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			task = nullptr;
+		}
+
+		mBottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	return task;
+}
+
+Task* WorkStealingQueue::Steal()
+{
+	int64_t top = mTop.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t bottom = mBottom.load(std::memory_order_acquire);
+
+	if (top >= bottom)
+	{
+		// Empty
+		return nullptr;
+	}
+
+	Task* task = mEntries[top & mMask].load(std::memory_order_relaxed);
+	if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		// Lost the race to another thief or the owner.
+		return nullptr;
+	}
+
+	return task;
+}
+
+bool WorkStealingQueue::IsEmpty() const
+{
+	int64_t top = mTop.load(std::memory_order_relaxed);
+	int64_t bottom = mBottom.load(std::memory_order_relaxed);
+	return bottom <= top;
+}
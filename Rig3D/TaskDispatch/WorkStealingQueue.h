@@ -0,0 +1,47 @@
+// Resources: http://blog.molecular-matters.com/2015/09/25/job-system-2-0-lock-free-work-stealing-part-3-going-lock-free/
+//			  Le, Pop, Cohen, Zappa Nardelli - Correct and Efficient Work-Stealing for Weak Memory Models (PPoPP 2013)
+
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "Task.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+namespace cliqCity
+{
+	namespace multicore
+	{
+		// Fixed capacity Chase-Lev deque. Push and Pop may only be called by the owning thread and operate on the bottom (LIFO).
+		// Steal may be called by any thread and operates on the top (FIFO).
+		class RIG3D WorkStealingQueue
+		{
+		public:
+			WorkStealingQueue();
+			~WorkStealingQueue();
+
+			void Initialize(uint32_t capacity);
+
+			bool  Push(Task* task);
+			Task* Pop();
+			Task* Steal();
+
+			bool IsEmpty() const;
+
+		private:
+			std::atomic<int64_t>	mTop;
+			char					mTopPadding[64 - sizeof(std::atomic<int64_t>)];
+			std::atomic<int64_t>	mBottom;
+			char					mBottomPadding[64 - sizeof(std::atomic<int64_t>)];
+			std::atomic<Task*>*		mEntries;
+			int64_t					mMask;
+
+			WorkStealingQueue(WorkStealingQueue const&) = delete;
+			void operator=(WorkStealingQueue const&) = delete;
+		};
+	}
+}
@@ -0,0 +1,178 @@
+#include "UniformGrid.h"
+#include <math.h>
+#include <float.h>
+
+using namespace Rig3D;
+
+UniformGrid::UniformGrid() :
+	mCount(0),
+	mCellSize(1.0f),
+	mInverseCellSize(1.0f)
+{
+	mMin = { 0.0f, 0.0f, 0.0f };
+	mDimensions[0] = mDimensions[1] = mDimensions[2] = 1;
+}
+
+UniformGrid::~UniformGrid()
+{
+
+}
+
+void UniformGrid::Build(const vec3f* positions, uint32_t count, float cellSize)
+{
+	mCount = count;
+
+	// Points with an infinite or NaN coordinate are left out of the bounds and end up in the cells on the grid's edge.
+	vec3f max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	mMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+	uint32_t boundedCount = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!isfinite(positions[i].x) || !isfinite(positions[i].y) || !isfinite(positions[i].z))
+		{
+			continue;
+		}
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			mMin[axis] = std::min(mMin[axis], positions[i][axis]);
+			max[axis] = std::max(max[axis], positions[i][axis]);
+		}
+
+		boundedCount++;
+	}
+
+	if (boundedCount == 0)
+	{
+		mMin = { 0.0f, 0.0f, 0.0f };
+		max = { 0.0f, 0.0f, 0.0f };
+	}
+
+	// Growing a cell size that is not positive would never end.
+	if (!(cellSize > 0.0f) || !isfinite(cellSize))
+	{
+		cellSize = 1.0f;
+	}
+
+	// Grow the cells until the grid fits the budget. Extents and dimensions are counted in double so huge bounds cannot overflow,
+	// which keeps every step finite until the cells cover the bounds.
+	double budget = std::max(static_cast<double>(count) * RIG_UNIFORM_GRID_CELLS_PER_POINT, static_cast<double>(RIG_UNIFORM_GRID_MIN_CELLS));
+	double dimensions[3];
+	for (;;)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			dimensions[axis] = floor((static_cast<double>(max[axis]) - static_cast<double>(mMin[axis])) / cellSize) + 1.0;
+		}
+
+		if (dimensions[0] * dimensions[1] * dimensions[2] <= budget)
+		{
+			break;
+		}
+
+		cellSize *= 1.26f;	// Doubles the cell volume.
+	}
+
+	mCellSize = cellSize;
+	mInverseCellSize = 1.0f / cellSize;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		mDimensions[axis] = static_cast<int32_t>(dimensions[axis]);
+	}
+
+	uint32_t cellCount = static_cast<uint32_t>(mDimensions[0] * mDimensions[1] * mDimensions[2]);
+	mCellStart.assign(cellCount + 1, 0);
+	mPointCells.resize(count);
+	mX.resize(count);
+	mY.resize(count);
+	mZ.resize(count);
+	mIndices.resize(count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int32_t x = GetCell(positions[i].x, 0);
+		int32_t y = GetCell(positions[i].y, 1);
+		int32_t z = GetCell(positions[i].z, 2);
+
+		uint32_t cell = static_cast<uint32_t>((z * mDimensions[1] + y) * mDimensions[0] + x);
+		mPointCells[i] = cell;
+		mCellStart[cell]++;
+	}
+
+	// Running totals leave each entry at the end of its cell. Filling backwards walks them down to the start
+	// and keeps points of the same cell in caller order.
+	uint32_t sum = 0;
+	for (uint32_t c = 0; c <= cellCount; c++)
+	{
+		sum += mCellStart[c];
+		mCellStart[c] = sum;
+	}
+
+	for (uint32_t i = count; i-- > 0;)
+	{
+		uint32_t slot = --mCellStart[mPointCells[i]];
+		mX[slot] = positions[i].x;
+		mY[slot] = positions[i].y;
+		mZ[slot] = positions[i].z;
+		mIndices[slot] = i;
+	}
+}
+
+void UniformGrid::Clear()
+{
+	mX.clear();
+	mY.clear();
+	mZ.clear();
+	mIndices.clear();
+	mCellStart.clear();
+	mPointCells.clear();
+	mCount = 0;
+}
+
+uint32_t UniformGrid::QueryRadius(const vec3f& point, float radius, std::vector<uint32_t>& indices) const
+{
+	size_t first = indices.size();
+	const uint32_t* sortedIndices = mIndices.data();
+
+	ForEachNeighbor(point, radius, [&indices, sortedIndices](uint32_t slot, float)
+	{
+		indices.push_back(sortedIndices[slot]);
+	});
+
+	return static_cast<uint32_t>(indices.size() - first);
+}
+
+const float* UniformGrid::GetPositionsX() const
+{
+	return mX.data();
+}
+
+const float* UniformGrid::GetPositionsY() const
+{
+	return mY.data();
+}
+
+const float* UniformGrid::GetPositionsZ() const
+{
+	return mZ.data();
+}
+
+const uint32_t* UniformGrid::GetIndices() const
+{
+	return mIndices.data();
+}
+
+uint32_t UniformGrid::GetCount() const
+{
+	return mCount;
+}
+
+uint32_t UniformGrid::GetCellCount() const
+{
+	return mCellStart.empty() ? 0 : static_cast<uint32_t>(mCellStart.size() - 1);
+}
+
+float UniformGrid::GetCellSize() const
+{
+	return mCellSize;
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "Parametric.h"
+
+#ifdef _WINDLL
+#define RIG3D __declspec(dllexport)
+#else
+#define RIG3D __declspec(dllimport)
+#endif
+
+#define RIG_UNIFORM_GRID_CELLS_PER_POINT	4
+#define RIG_UNIFORM_GRID_MIN_CELLS			64
+
+namespace Rig3D
+{
+	// Neighbor index for points that move every frame. Build fits a grid to the points' bounds and counting sorts them into cell order,
+	// x fastest, so a row of cells is one run of slots in the SoA arrays and a radius query reads a few contiguous runs. Cells are
+	// grown past the requested size when the bounds would need more than RIG_UNIFORM_GRID_CELLS_PER_POINT cells per point, so memory
+	// stays linear in the point count however far apart the points drift. Sorted slots index the arrays returned by the getters.
+	class RIG3D UniformGrid
+	{
+	public:
+		UniformGrid();
+		~UniformGrid();
+
+		// Use the usual query radius as the cell size, so a query searches 3 x 3 x 3 cells.
+		void Build(const vec3f* positions, uint32_t count, float cellSize);
+		void Clear();
+
+		// Calls function(sortedSlot, distanceSquared) for every point no farther than radius from point, in slot order per row of cells.
+		template<class Function>
+		void ForEachNeighbor(const vec3f& point, float radius, const Function& function) const;
+
+		// Appends the caller's index of every point no farther than radius from point and returns how many were added.
+		uint32_t QueryRadius(const vec3f& point, float radius, std::vector<uint32_t>& indices) const;
+
+		// Copies values from caller order into sorted order. destination must hold GetCount() values.
+		template<class T>
+		void Gather(const T* source, T* destination) const;
+
+		const float*	GetPositionsX() const;
+		const float*	GetPositionsY() const;
+		const float*	GetPositionsZ() const;
+		const uint32_t*	GetIndices() const;		// Caller's index of each sorted slot.
+		uint32_t		GetCount() const;
+		uint32_t		GetCellCount() const;
+		float			GetCellSize() const;	// May be larger than requested, see above.
+
+	private:
+		std::vector<float>		mX;
+		std::vector<float>		mY;
+		std::vector<float>		mZ;
+		std::vector<uint32_t>	mIndices;
+		std::vector<uint32_t>	mCellStart;		// Cell c holds slots [mCellStart[c], mCellStart[c + 1]).
+		std::vector<uint32_t>	mPointCells;	// Cell of each point in caller order. A member only so Build reuses its allocation.
+		vec3f					mMin;
+		int32_t					mDimensions[3];
+		uint32_t				mCount;
+		float					mCellSize;
+		float					mInverseCellSize;
+
+		// Cell of value along axis, clamped to the grid.
+		inline int32_t GetCell(float value, int axis) const;
+
+		UniformGrid(UniformGrid const&) = delete;
+		void operator=(UniformGrid const&) = delete;
+	};
+
+	inline int32_t UniformGrid::GetCell(float value, int axis) const
+	{
+		// Clamp before converting so far away points cannot overflow the integer. NaN fails the comparison and lands in the first cell.
+		float cell = (value - mMin[axis]) * mInverseCellSize;
+		if (!(cell > 0.0f))
+		{
+			return 0;
+		}
+
+		cell = std::min(cell, static_cast<float>(mDimensions[axis] - 1));
+		return static_cast<int32_t>(cell);
+	}
+
+	template<class Function>
+	void UniformGrid::ForEachNeighbor(const vec3f& point, float radius, const Function& function) const
+	{
+		if (mCount == 0)
+		{
+			return;
+		}
+
+		int32_t minX = GetCell(point.x - radius, 0);
+		int32_t minY = GetCell(point.y - radius, 1);
+		int32_t minZ = GetCell(point.z - radius, 2);
+		int32_t maxX = GetCell(point.x + radius, 0);
+		int32_t maxY = GetCell(point.y + radius, 1);
+		int32_t maxZ = GetCell(point.z + radius, 2);
+
+		const float* px = mX.data();
+		const float* py = mY.data();
+		const float* pz = mZ.data();
+		const uint32_t* cellStart = mCellStart.data();
+		float radiusSquared = radius * radius;
+
+		for (int32_t z = minZ; z <= maxZ; z++)
+		{
+			for (int32_t y = minY; y <= maxY; y++)
+			{
+				// The cells from minX to maxX of this row are one run of slots.
+				uint32_t row = static_cast<uint32_t>((z * mDimensions[1] + y) * mDimensions[0]);
+				uint32_t end = cellStart[row + maxX + 1];
+
+				for (uint32_t slot = cellStart[row + minX]; slot < end; slot++)
+				{
+					float dx = px[slot] - point.x;
+					float dy = py[slot] - point.y;
+					float dz = pz[slot] - point.z;
+					float distanceSquared = dx * dx + dy * dy + dz * dz;
+
+					if (distanceSquared <= radiusSquared)
+					{
+						function(slot, distanceSquared);
+					}
+				}
+			}
+		}
+	}
+
+	template<class T>
+	void UniformGrid::Gather(const T* source, T* destination) const
+	{
+		for (uint32_t slot = 0; slot < mCount; slot++)
+		{
+			destination[slot] = source[mIndices[slot]];
+		}
+	}
+}
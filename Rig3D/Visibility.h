@@ -1,6 +1,7 @@
 #pragma once
 #include "GraphicsMath/cgm.h"
 #include "Rig3D/Parametric.h"
+#include "Rig3D/TaskDispatch/TaskDispatcher.h"
 #include <vector>
 
 namespace Rig3D
@@ -113,10 +114,8 @@ namespace Rig3D
 		frustum->top.distance = -distance;
 	}
 
-	inline void Cull(const Frustum& frustum, Sphere<vec3f>* spheres, std::vector<uint32_t>& indices, const uint32_t& count)
+	inline bool IsVisible(const Frustum& frustum, const Sphere<vec3f>& sphere)
 	{
-
-		float distance;
 		const Plane<vec3f>* planes[6] =
 		{
 			&frustum.front,
@@ -127,20 +126,44 @@ namespace Rig3D
 			&frustum.top,
 		};
 
+		for (uint32_t p = 0; p < 6; p++)
+		{
+			float distance = cliqCity::graphicsMath::dot(planes[p]->normal, sphere.origin) - (planes[p]->distance - sphere.radius);
+			if (distance < 0)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	inline void Cull(const Frustum& frustum, Sphere<vec3f>* spheres, std::vector<uint32_t>& indices, const uint32_t& count)
+	{
 		for (uint32_t i = 0; i < count; i++)
 		{
-			bool shouldCull = false;
-			for (uint32_t p = 0; p < 6; p++)
+			if (IsVisible(frustum, spheres[i])) 
 			{
-				distance = cliqCity::graphicsMath::dot(planes[p]->normal, spheres[i].origin) - (planes[p]->distance - spheres[i].radius);
-				if (distance < 0)
-				{
-					shouldCull = true;
-					break;
-				}
+				indices.push_back(i);
+			}
+		}
+	}
+
+	// Tests the spheres on the dispatcher's threads. Indices are appended in the same ascending order as the serial Cull.
+	inline void Cull(const Frustum& frustum, Sphere<vec3f>* spheres, std::vector<uint32_t>& indices, const uint32_t& count, cliqCity::multicore::TaskDispatcher& dispatcher)
+	{
+		std::vector<uint8_t> isVisible(count);
+		dispatcher.ParallelFor(0, count, 0, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				isVisible[i] = IsVisible(frustum, spheres[i]);
 			}
+		});
 
-			if (!shouldCull) 
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (isVisible[i])
 			{
 				indices.push_back(i);
 			}
@@ -11,6 +11,7 @@
 #include "Rig3D/Visibility.h"
 #include "Rig3D/Graphics/Camera.h"
 #include "Rig3D/Geometry.h"
+#include "Rig3D/RigidBodySystem.h"
 #include <d3d11.h>
 #include "Rig3D/Graphics/DirectX11/DX11ShaderResource.h"
 
@@ -56,7 +57,8 @@ struct Terrain
 	float patchDepthCount;
 };
 
-struct RigidBody
+// Matches RigidBody in RigidBodyComputeShader.hlsl.
+struct GPURigidBody
 {
 	vec3f position;
 	vec3f velocity;
@@ -78,7 +80,8 @@ public:
 
 	mat4f				mTerrainWorldMatrices[TERRAIN_PATCH_WIDTH_COUNT * TERRAIN_PATCH_DEPTH_COUNT];
 	mat4f				mDynamicWorldMatrics[INSTANCE_COUNT];
-	RigidBody			mRigidBodies[INSTANCE_COUNT];
+	RigidBodySystem		mRigidBodies;
+	GPURigidBody		mGPURigidBodies[INSTANCE_COUNT];
 
 	TSingleton<IRenderer, DX3D11Renderer>*	mRenderer;
 	IShader*			mTerrainVertexShader;
@@ -116,11 +119,12 @@ public:
 	void UpdateInput(Input& input);
 	void UpdateCamera();
 
-	void UpdateCollisions(RigidBody* rigidBodies, uint32_t count);
-	void UpdateForces(RigidBody* rigidBodies, uint32_t count);
-	void Integrate(RigidBody* rigidBodies, uint32_t count, float milliseconds);
-	void RK4(RigidBody* rigidBodies, uint32_t count, float milliseconds);
-	void Euler(RigidBody* rigidBodies, uint32_t count, float milliseconds);
+	void UpdateCollisions(RigidBodySystem& rigidBodies);
+	void UpdateForces(RigidBodySystem& rigidBodies);
+	void Integrate(RigidBodySystem& rigidBodies, float milliseconds);
+
+	void PackGPURigidBodies();
+	void UnpackGPURigidBodies();
 
 };
 
@@ -224,10 +228,10 @@ void SurfaceConstrainedMotionSample::InitializePhysics()
 {
 	for (uint32_t i = 0; i < INSTANCE_COUNT; i++)
 	{
-		mRigidBodies[i].position = { 0.0f, 5.0f, 0.0f };
-		mRigidBodies[i].velocity = { 0.0f, 0.0f, 0.0f };
-		mRigidBodies[i].inverseMass = 50.0f;
+		mRigidBodies.AddBody({ 0.0f, 5.0f, 0.0f }, 50.0f, { 0.0f, 0.0f, 0.0f });
 	}
+
+	PackGPURigidBodies();
 }
 
 void SurfaceConstrainedMotionSample::InitializeShaders()
@@ -315,12 +319,12 @@ void SurfaceConstrainedMotionSample::InitializeShaderResources()
 	D3D11_BUFFER_DESC bufferDesc;
 	ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
 	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
-	bufferDesc.ByteWidth = sizeof(RigidBody) * INSTANCE_COUNT;
+	bufferDesc.ByteWidth = sizeof(GPURigidBody) * INSTANCE_COUNT;
 	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-	bufferDesc.StructureByteStride = sizeof(RigidBody);
+	bufferDesc.StructureByteStride = sizeof(GPURigidBody);
 
 	D3D11_SUBRESOURCE_DATA data;
-	data.pSysMem = &mRigidBodies;
+	data.pSysMem = &mGPURigidBodies;
 
 	ID3D11Device* device = mRenderer->GetDevice();
 	device->CreateBuffer(&bufferDesc, &data, &mRigidBodyComputeBuffer);
@@ -344,8 +348,8 @@ void SurfaceConstrainedMotionSample::VUpdate(double milliseconds)
 {
 	UpdateInput(Input::SharedInstance());
 	UpdateCamera();
-	UpdateForces(mRigidBodies, INSTANCE_COUNT);
-	Integrate(mRigidBodies, INSTANCE_COUNT, static_cast<float>(milliseconds));
+	UpdateForces(mRigidBodies);
+	Integrate(mRigidBodies, static_cast<float>(milliseconds));
 
 	UpdateShaderResources();
 }
@@ -357,7 +361,7 @@ void SurfaceConstrainedMotionSample::UpdateShaderResources()
 
 	for (uint32_t i = 0; i < INSTANCE_COUNT; i++)
 	{
-		mDynamicWorldMatrics[i] = mat4f::translate(mRigidBodies[i].position).transpose();
+		mDynamicWorldMatrics[i] = mat4f::translate(mRigidBodies.GetPosition(i)).transpose();
 	}
 
 
@@ -403,29 +407,29 @@ void SurfaceConstrainedMotionSample::UpdateInput(Input& input)
 
 	if (input.GetKey(KEYCODE_UP))
 	{
-		mRigidBodies[0].position.z += CAMERA_SPEED;
+		mRigidBodies.SetPosition(0, mRigidBodies.GetPosition(0) + vec3f{ 0.0f, 0.0f, CAMERA_SPEED });
 	}
 
 	if (input.GetKey(KEYCODE_DOWN))
 	{
-		mRigidBodies[0].position.z -= CAMERA_SPEED;
+		mRigidBodies.SetPosition(0, mRigidBodies.GetPosition(0) + vec3f{ 0.0f, 0.0f, -CAMERA_SPEED });
 	}
 
 	if (input.GetKey(KEYCODE_RIGHT))
 	{
-		mRigidBodies[0].position.x += CAMERA_SPEED;
+		mRigidBodies.SetPosition(0, mRigidBodies.GetPosition(0) + vec3f{ CAMERA_SPEED, 0.0f, 0.0f });
 	}
 
 	if (input.GetKey(KEYCODE_LEFT))
 	{
-		mRigidBodies[0].position.x -= CAMERA_SPEED;
+		mRigidBodies.SetPosition(0, mRigidBodies.GetPosition(0) + vec3f{ -CAMERA_SPEED, 0.0f, 0.0f });
 	}
 
 	if (input.GetKeyDown(KEYCODE_R))
 	{
-		mRigidBodies[0].position = {0.0f, 5.0f, 0.0f };
-		mRigidBodies[0].velocity = { 0.0f, 0.0f, 0.0f };
-		mRigidBodies[0].forces = { 0.0f, 0.0f, 0.0f };
+		mRigidBodies.SetPosition(0, { 0.0f, 5.0f, 0.0f });
+		mRigidBodies.SetVelocity(0, { 0.0f, 0.0f, 0.0f });
+		mRigidBodies.ClearForces();
 	}
 }
 
@@ -434,21 +438,21 @@ void SurfaceConstrainedMotionSample::UpdateCamera()
 	mCamera.SetViewMatrix(mat4f::lookAtLH(mCamera.mTransform.GetPosition() + mCamera.mTransform.GetForward(), mCamera.mTransform.GetPosition(), vec3f(0.0f, 1.0f, 0.0f)));
 }
 
-void SurfaceConstrainedMotionSample::UpdateCollisions(RigidBody* rigidBodies, uint32_t count)
+void SurfaceConstrainedMotionSample::UpdateCollisions(RigidBodySystem& rigidBodies)
 {
 
 
 }
 
-void SurfaceConstrainedMotionSample::UpdateForces(RigidBody* rigidBodies, uint32_t count)
+void SurfaceConstrainedMotionSample::UpdateForces(RigidBodySystem& rigidBodies)
 {
-	for (uint32_t i = 0; i < count;i++)
+	for (uint32_t i = 0; i < rigidBodies.GetCount(); i++)
 	{
-		rigidBodies[i].forces += { 0.0f, -GRAVITY_CONSTANT, 0.0f };
+		rigidBodies.AddForce(i, { 0.0f, -GRAVITY_CONSTANT, 0.0f });
 	}
 }
 
-void SurfaceConstrainedMotionSample::Integrate(RigidBody* rigidBodies, uint32_t count, float deltaTime)
+void SurfaceConstrainedMotionSample::Integrate(RigidBodySystem& rigidBodies, float deltaTime)
 {
 	if (deltaTime > 16.67f)
 	{
@@ -461,24 +465,31 @@ void SurfaceConstrainedMotionSample::Integrate(RigidBody* rigidBodies, uint32_t
 	int i = 0;
 	while (accumulator >= PHYSICS_TIME_STEP)
 	{
-		Euler(mRigidBodies, count, PHYSICS_TIME_STEP);
+		rigidBodies.IntegrateEuler(PHYSICS_TIME_STEP);
+		rigidBodies.ClearForces();
 		accumulator -= PHYSICS_TIME_STEP;
 		i++;
 	}
 }
 
-void SurfaceConstrainedMotionSample::RK4(RigidBody* rigidBodies, uint32_t count, float deltaTime)
+void SurfaceConstrainedMotionSample::PackGPURigidBodies()
 {
+	for (uint32_t i = 0; i < INSTANCE_COUNT; i++)
+	{
+		mGPURigidBodies[i].position		= mRigidBodies.GetPosition(i);
+		mGPURigidBodies[i].velocity		= mRigidBodies.GetVelocity(i);
+		mGPURigidBodies[i].forces		= mRigidBodies.GetForce(i);
+		mGPURigidBodies[i].inverseMass	= mRigidBodies.GetInverseMass(i);
+	}
 }
 
-void SurfaceConstrainedMotionSample::Euler(RigidBody* rigidBodies, uint32_t count, float deltaTime)
+// The compute shader only moves bodies out of the terrain and changes their velocity.
+void SurfaceConstrainedMotionSample::UnpackGPURigidBodies()
 {
-	for (uint32_t i = 0; i < count; i++)
+	for (uint32_t i = 0; i < INSTANCE_COUNT; i++)
 	{
-		vec3f acceleration = rigidBodies[i].forces * rigidBodies[i].inverseMass;
-		rigidBodies[i].velocity += acceleration * deltaTime;
-		rigidBodies[i].position += rigidBodies[i].velocity * deltaTime;
-		rigidBodies[i].forces = { 0.0f, 0.0f, 0.0f };
+		mRigidBodies.SetPosition(i, mGPURigidBodies[i].position);
+		mRigidBodies.SetVelocity(i, mGPURigidBodies[i].velocity);
 	}
 }
 
@@ -520,7 +531,8 @@ void SurfaceConstrainedMotionSample::VRender()
 	deviceContext->CSSetConstantBuffers(0, 1, &constantBuffers[1]);
 	deviceContext->CSSetShaderResources(0, 2, SRVs);
 	deviceContext->CSSetSamplers(0, 1, samplerStates);
-	deviceContext->UpdateSubresource(mRigidBodyComputeBuffer, 0, nullptr, &mRigidBodies, 0, 0);
+	PackGPURigidBodies();
+	deviceContext->UpdateSubresource(mRigidBodyComputeBuffer, 0, nullptr, &mGPURigidBodies, 0, 0);
 	deviceContext->CSSetUnorderedAccessViews(0, 1, &mRigidBodyUAV, nullptr);
 	deviceContext->Dispatch(1, 1, 1);
 	deviceContext->CSSetShader(nullptr, nullptr, 0);
@@ -530,9 +542,10 @@ void SurfaceConstrainedMotionSample::VRender()
 
 	D3D11_MAPPED_SUBRESOURCE mappedSubresource;
 	deviceContext->Map(mRigidBodyStagingBuffer, 0, D3D11_MAP_READ, 0, &mappedSubresource);
-	RigidBody* rigidbodies = reinterpret_cast<RigidBody*>(mappedSubresource.pData);
-	memcpy(mRigidBodies, rigidbodies, sizeof(RigidBody) * INSTANCE_COUNT);
+	GPURigidBody* rigidbodies = reinterpret_cast<GPURigidBody*>(mappedSubresource.pData);
+	memcpy(mGPURigidBodies, rigidbodies, sizeof(GPURigidBody) * INSTANCE_COUNT);
 	deviceContext->Unmap(mRigidBodyStagingBuffer, 0);
+	UnpackGPURigidBodies();
 
 	mRenderer->VSetVertexShader(mCapsuleVertexShader);
 	mRenderer->VSetPixelShader(mCapsulePixelShader);